@@ -0,0 +1,21 @@
+#ifndef ASMARM_DMA_CONTIGUOUS_H
+#define ASMARM_DMA_CONTIGUOUS_H
+
+#ifdef __KERNEL__
+#ifdef CONFIG_CMA
+
+#include <linux/types.h>
+#include <asm-generic/dma-contiguous.h>
+
+/*
+ * The linear mapping of CMA areas is left alone: coherent buffers get a
+ * second, uncached mapping in the consistent area just like buffers from
+ * alloc_pages() always did.
+ */
+static inline void
+dma_contiguous_early_fixup(phys_addr_t base, unsigned long size) { }
+
+#endif
+#endif
+
+#endif
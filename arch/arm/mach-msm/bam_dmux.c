@@ -27,6 +27,7 @@
 #include <linux/clk.h>
 #include <linux/wakelock.h>
 #include <linux/kfifo.h>
+#include <linux/dma-mapping.h>
 
 #include <mach/sps.h>
 #include <mach/bam_dmux.h>
@@ -47,9 +48,7 @@
 #define BAM_MUX_HDR_CMD_STATUS		3 /* unused */
 #define BAM_MUX_HDR_CMD_OPEN_NO_A2_PC	4
 
-#define POLLING_MIN_SLEEP	950	/* 0.95 ms */
-#define POLLING_MAX_SLEEP	1050	/* 1.05 ms */
-#define POLLING_INACTIVITY	40	/* cycles before switch to intr mode */
+#define BAM_MUX_NAPI_WEIGHT	32	/* rx buffers per poll */
 
 #define LOW_WATERMARK		2
 #define HIGH_WATERMARK		4
@@ -58,6 +57,22 @@ static int msm_bam_dmux_debug_enable;
 module_param_named(debug_enable, msm_bam_dmux_debug_enable,
 		   int, S_IRUGO | S_IWUSR | S_IWGRP);
 
+/* data frames up to this size are copied and their rx buffer reused */
+static int rx_copybreak = 256;
+module_param(rx_copybreak, int, S_IRUGO | S_IWUSR | S_IWGRP);
+
+/*
+ * Loop uplink data back to the downlink in software instead of talking
+ * to the A2, so the mux and its clients can be exercised and profiled
+ * without a modem.
+ */
+static int bam_dmux_loopback;
+module_param_named(loopback, bam_dmux_loopback, int, S_IRUGO);
+
+static int bam_dmux_loopback_aggr;
+module_param_named(loopback_aggr, bam_dmux_loopback_aggr,
+		   int, S_IRUGO | S_IWUSR | S_IWGRP);
+
 #if defined(DEBUG)
 static uint32_t bam_dmux_read_cnt;
 static uint32_t bam_dmux_write_cnt;
@@ -65,6 +80,15 @@ static uint32_t bam_dmux_write_cpy_cnt;
 static uint32_t bam_dmux_write_cpy_bytes;
 static uint32_t bam_dmux_tx_sps_failure_cnt;
 static uint32_t bam_dmux_tx_stall_cnt;
+static uint32_t bam_dmux_rx_poll_cnt;
+static uint32_t bam_dmux_rx_buf_cnt;
+static uint32_t bam_dmux_rx_pkt_cnt;
+static uint32_t bam_dmux_rx_aggr_cnt;
+static uint32_t bam_dmux_rx_copy_cnt;
+static uint32_t bam_dmux_rx_recycle_cnt;
+static uint32_t bam_dmux_rx_alloc_cnt;
+static uint32_t bam_dmux_rx_drop_cnt;
+static unsigned long long bam_dmux_rx_poll_ns;
 
 #define DBG(x...) do {		                 \
 		if (msm_bam_dmux_debug_enable)  \
@@ -102,6 +126,14 @@ static uint32_t bam_dmux_tx_stall_cnt;
 	bam_dmux_tx_stall_cnt++; \
 } while (0)
 
+#define DBG_INC_RX_STAT(x) do { \
+	(x)++; \
+} while (0)
+
+#define DBG_ADD_RX_POLL_NS(x) do { \
+	bam_dmux_rx_poll_ns += (x); \
+} while (0)
+
 #else
 #define DBG(x...) do { } while (0)
 #define DBG_INC_READ_CNT(x...) do { } while (0)
@@ -109,6 +141,8 @@ static uint32_t bam_dmux_tx_stall_cnt;
 #define DBG_INC_WRITE_CPY(x...) do { } while (0)
 #define DBG_INC_TX_SPS_FAILURE_CNT() do { } while (0)
 #define DBG_INC_TX_STALL_CNT() do { } while (0)
+#define DBG_INC_RX_STAT(x) do { } while (0)
+#define DBG_ADD_RX_POLL_NS(x) do { } while (0)
 #endif
 
 struct bam_ch_info {
@@ -116,6 +150,8 @@ struct bam_ch_info {
 	void (*notify)(void *, int, unsigned long);
 	void *priv;
 	spinlock_t lock;
+	atomic_t notify_refs;	/* notify calls in progress */
+	wait_queue_head_t notify_wait;
 	struct platform_device *pdev;
 	char name[BAM_DMUX_CH_NAME_MAX_LEN];
 	int num_tx_pkts;
@@ -136,6 +172,7 @@ struct tx_pkt_info {
 struct rx_pkt_info {
 	struct sk_buff *skb;
 	dma_addr_t dma_address;
+	uint32_t len;
 	struct work_struct work;
 	struct list_head list_node;
 };
@@ -162,9 +199,11 @@ static struct bam_ch_info bam_ch[BAM_DMUX_NUM_CHANNELS];
 static int bam_mux_initialized;
 
 static int polling_mode;
+static struct net_device bam_napi_dev;
+static struct napi_struct bam_napi;
 
 static LIST_HEAD(bam_rx_pool);
-static DEFINE_MUTEX(bam_rx_pool_mutexlock);
+static DEFINE_SPINLOCK(bam_rx_pool_spinlock);
 static int bam_rx_pool_len;
 static LIST_HEAD(bam_tx_pool);
 static DEFINE_SPINLOCK(bam_tx_pool_spinlock);
@@ -182,9 +221,9 @@ struct bam_mux_hdr {
 static void notify_all(int event, unsigned long data);
 static void bam_mux_write_done(struct work_struct *work);
 static void handle_bam_mux_cmd(struct work_struct *work);
-static void rx_timer_work_func(struct work_struct *work);
+static void rx_refill_work_func(struct work_struct *work);
 
-static DECLARE_WORK(rx_timer_work, rx_timer_work_func);
+static DECLARE_WORK(rx_refill_work, rx_refill_work_func);
 
 static struct workqueue_struct *bam_mux_rx_workqueue;
 static struct workqueue_struct *bam_mux_tx_workqueue;
@@ -368,63 +407,102 @@ static inline void verify_tx_queue_is_empty(const char *func)
 	spin_unlock_irqrestore(&bam_tx_pool_spinlock, flags);
 }
 
-static void queue_rx(void)
+static int bam_rx_buf_map(struct rx_pkt_info *info)
+{
+	void *ptr = info->skb->data;
+
+	/* the loopback transport fills the buffers with the CPU */
+	if (bam_dmux_loopback) {
+		info->dma_address = virt_to_phys(ptr);
+		return 0;
+	}
+
+	info->dma_address = dma_map_single(NULL, ptr, BUFFER_SIZE,
+						DMA_FROM_DEVICE);
+	if (info->dma_address == 0 || info->dma_address == ~0) {
+		DMUX_LOG_KERR("%s: dma_map_single failure %p for %p\n",
+			__func__, (void *)info->dma_address, ptr);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void bam_rx_buf_unmap(struct rx_pkt_info *info)
+{
+	if (!bam_dmux_loopback)
+		dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE,
+					DMA_FROM_DEVICE);
+}
+
+static void bam_rx_buf_free(struct rx_pkt_info *info)
+{
+	bam_rx_buf_unmap(info);
+	dev_kfree_skb_any(info->skb);
+	kfree(info);
+}
+
+/*
+ * Hand an rx buffer to the BAM.  Must be called with
+ * bam_rx_pool_spinlock held and the buffer already on bam_rx_pool.
+ */
+static int bam_rx_transfer_one(struct rx_pkt_info *info)
+{
+	info->len = 0;
+	if (bam_dmux_loopback)
+		return 0;
+
+	return sps_transfer_one(bam_rx_pipe, info->dma_address,
+		BUFFER_SIZE, info, SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
+}
+
+static void queue_rx(gfp_t gfp)
 {
-	void *ptr;
 	struct rx_pkt_info *info;
 	int ret;
 	int rx_len_cached;
+	unsigned long flags;
 
-	mutex_lock(&bam_rx_pool_mutexlock);
+	spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
 	rx_len_cached = bam_rx_pool_len;
-	mutex_unlock(&bam_rx_pool_mutexlock);
+	spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
 
 	while (rx_len_cached < NUM_BUFFERS) {
 		if (in_global_reset)
 			goto fail;
 
-		info = kmalloc(sizeof(struct rx_pkt_info), GFP_KERNEL);
+		info = kmalloc(sizeof(struct rx_pkt_info), gfp);
 		if (!info) {
 			pr_err("%s: unable to alloc rx_pkt_info\n", __func__);
 			goto fail;
 		}
 
-		INIT_WORK(&info->work, handle_bam_mux_cmd);
-
-		info->skb = __dev_alloc_skb(BUFFER_SIZE, GFP_KERNEL);
+		info->skb = __dev_alloc_skb(BUFFER_SIZE, gfp);
 		if (info->skb == NULL) {
 			DMUX_LOG_KERR("%s: unable to alloc skb\n", __func__);
 			goto fail_info;
 		}
-		ptr = skb_put(info->skb, BUFFER_SIZE);
+		skb_put(info->skb, BUFFER_SIZE);
 
-		info->dma_address = dma_map_single(NULL, ptr, BUFFER_SIZE,
-							DMA_FROM_DEVICE);
-		if (info->dma_address == 0 || info->dma_address == ~0) {
-			DMUX_LOG_KERR("%s: dma_map_single failure %p for %p\n",
-				__func__, (void *)info->dma_address, ptr);
+		if (bam_rx_buf_map(info))
 			goto fail_skb;
-		}
+		DBG_INC_RX_STAT(bam_dmux_rx_alloc_cnt);
 
-		mutex_lock(&bam_rx_pool_mutexlock);
+		spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
 		list_add_tail(&info->list_node, &bam_rx_pool);
 		rx_len_cached = ++bam_rx_pool_len;
-		ret = sps_transfer_one(bam_rx_pipe, info->dma_address,
-			BUFFER_SIZE, info,
-			SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
+		ret = bam_rx_transfer_one(info);
 		if (ret) {
 			list_del(&info->list_node);
 			rx_len_cached = --bam_rx_pool_len;
-			mutex_unlock(&bam_rx_pool_mutexlock);
+			spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
 			DMUX_LOG_KERR("%s: sps_transfer_one failed %d\n",
 				__func__, ret);
 
-			dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE,
-						DMA_FROM_DEVICE);
+			bam_rx_buf_unmap(info);
 
 			goto fail_skb;
 		}
-		mutex_unlock(&bam_rx_pool_mutexlock);
+		spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
 
 	}
 	return;
@@ -436,37 +514,358 @@ fail_info:
 	kfree(info);
 
 fail:
+	if (gfp == GFP_ATOMIC && !in_global_reset) {
+		/* try again from process context */
+		queue_work(bam_mux_rx_workqueue, &rx_refill_work);
+		return;
+	}
 	if (rx_len_cached == 0) {
 		DMUX_LOG_KERR("%s: RX queue failure\n", __func__);
 		in_global_reset = 1;
 	}
 }
 
-static void bam_mux_process_data(struct sk_buff *rx_skb)
+static void rx_refill_work_func(struct work_struct *work)
+{
+	if (bam_connection_is_active)
+		queue_rx(GFP_KERNEL);
+}
+
+/*
+ * Give a buffer whose contents have been copied out back to the BAM
+ * without unmapping and remapping it.
+ */
+static void bam_rx_recycle(struct rx_pkt_info *info)
 {
 	unsigned long flags;
+	int ret;
+
+	if (in_global_reset || !bam_connection_is_active) {
+		bam_rx_buf_free(info);
+		return;
+	}
+
+	if (!bam_dmux_loopback)
+		dma_sync_single_for_device(NULL, info->dma_address,
+					BUFFER_SIZE, DMA_FROM_DEVICE);
+
+	spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
+	list_add_tail(&info->list_node, &bam_rx_pool);
+	++bam_rx_pool_len;
+	ret = bam_rx_transfer_one(info);
+	if (ret) {
+		list_del(&info->list_node);
+		--bam_rx_pool_len;
+		spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+		DMUX_LOG_KERR("%s: sps_transfer_one failed %d\n",
+			__func__, ret);
+		bam_rx_buf_free(info);
+		return;
+	}
+	spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+	DBG_INC_RX_STAT(bam_dmux_rx_recycle_cnt);
+}
+
+/*
+ * Loopback transport: uplink data frames are copied into the posted rx
+ * buffers, in order, as if the A2 had looped them back.  With
+ * loopback_aggr set, consecutive frames are packed into the same buffer
+ * until it is full or the poll loop runs out of completed buffers, which
+ * exercises the multi-packet receive path.
+ *
+ * bam_loopback_done counts the filled buffers at the head of bam_rx_pool;
+ * the buffer after them is the one being filled, its fill level is kept
+ * in info->len.  All of it is protected by bam_rx_pool_spinlock.
+ */
+static int bam_loopback_done;
+
+static struct rx_pkt_info *bam_loopback_cur(void)
+{
+	struct rx_pkt_info *info;
+	int i = 0;
+
+	list_for_each_entry(info, &bam_rx_pool, list_node)
+		if (i++ == bam_loopback_done)
+			return info;
+	return NULL;
+}
+
+static void bam_loopback_rx(void *data, uint32_t len)
+{
+	struct rx_pkt_info *info;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
+	info = bam_loopback_cur();
+	if (info && info->len + len > BUFFER_SIZE) {
+		++bam_loopback_done;
+		info = bam_loopback_cur();
+	}
+	if (!info) {
+		spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+		DBG_INC_RX_STAT(bam_dmux_rx_drop_cnt);
+		return;
+	}
+	memcpy(info->skb->data + info->len, data, len);
+	info->len += len;
+	if (!bam_dmux_loopback_aggr)
+		++bam_loopback_done;
+	spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+
+	napi_schedule(&bam_napi);
+}
+
+/* Must be called with bam_rx_pool_spinlock held. */
+static int bam_loopback_get_iovec(struct sps_iovec *iov)
+{
+	struct rx_pkt_info *info;
+
+	iov->addr = 0;
+	if (!bam_loopback_done) {
+		/* nothing else completed, flush the partial buffer */
+		info = bam_loopback_cur();
+		if (!info || !info->len)
+			return 0;
+		++bam_loopback_done;
+	}
+	info = list_first_entry(&bam_rx_pool, struct rx_pkt_info, list_node);
+	iov->addr = info->dma_address;
+	iov->size = info->len;
+	--bam_loopback_done;
+	return 0;
+}
+
+/*
+ * Take the next completed buffer off the rx pool, NULL if there is
+ * none.  The A2 completes buffers in the order they were queued.
+ */
+static struct rx_pkt_info *bam_rx_dequeue(void)
+{
+	struct sps_iovec iov;
+	struct rx_pkt_info *info;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
+	if (bam_dmux_loopback)
+		ret = bam_loopback_get_iovec(&iov);
+	else
+		ret = sps_get_iovec(bam_rx_pipe, &iov);
+	if (ret) {
+		spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+		pr_err("%s: sps_get_iovec failed %d\n", __func__, ret);
+		return NULL;
+	}
+	if (iov.addr == 0) {
+		spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+		return NULL;
+	}
+
+	if (unlikely(list_empty(&bam_rx_pool))) {
+		spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+		DMUX_LOG_KERR("%s: have iovec %p but rx pool empty\n",
+			__func__, (void *)iov.addr);
+		return NULL;
+	}
+	info = list_first_entry(&bam_rx_pool, struct rx_pkt_info, list_node);
+	if (info->dma_address != iov.addr) {
+		DMUX_LOG_KERR("%s: iovec %p != dma %p\n",
+			__func__,
+			(void *)iov.addr,
+			(void *)info->dma_address);
+		list_for_each_entry(info, &bam_rx_pool, list_node) {
+			DMUX_LOG_KERR("%s: dma %p\n", __func__,
+				(void *)info->dma_address);
+			if (iov.addr == info->dma_address)
+				break;
+		}
+	}
+	BUG_ON(info->dma_address != iov.addr);
+	list_del(&info->list_node);
+	--bam_rx_pool_len;
+	info->len = iov.size;
+	spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
+
+	return info;
+}
+
+static int bam_mux_hdr_valid(struct bam_mux_hdr *rx_hdr)
+{
+	DBG("%s: magic %x reserved %d cmd %d pad %d ch %d len %d\n", __func__,
+			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
+			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
+	if (rx_hdr->magic_num != BAM_MUX_HDR_MAGIC_NO) {
+		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
+			" reserved %d cmd %d"
+			" pad %d ch %d len %d\n", __func__,
+			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
+			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
+		return 0;
+	}
+
+	if (rx_hdr->ch_id >= BAM_DMUX_NUM_CHANNELS) {
+		DMUX_LOG_KERR("%s: dropping invalid LCID %d"
+			" reserved %d cmd %d"
+			" pad %d ch %d len %d\n", __func__,
+			rx_hdr->ch_id, rx_hdr->reserved, rx_hdr->cmd,
+			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * The notify callback is not called under the channel lock: in NAPI
+ * context the client hands the packet straight to the network stack,
+ * which may transmit on the same channel before returning.  Instead a
+ * reference is taken under the lock for the duration of the call, and
+ * msm_bam_dmux_close() waits for all references to be dropped, so a
+ * client never sees a callback after close has returned.
+ *
+ * Returns 0 if the channel has no client, the caller then owns @data.
+ */
+static int bam_ch_notify(uint8_t ch_id, int event, unsigned long data)
+{
+	void (*notify)(void *, int, unsigned long);
+	void *priv;
+	unsigned long flags;
+
+	spin_lock_irqsave(&bam_ch[ch_id].lock, flags);
+	notify = bam_ch[ch_id].notify;
+	priv = bam_ch[ch_id].priv;
+	if (notify)
+		atomic_inc(&bam_ch[ch_id].notify_refs);
+	spin_unlock_irqrestore(&bam_ch[ch_id].lock, flags);
+
+	if (!notify)
+		return 0;
+
+	notify(priv, event, data);
+	if (atomic_dec_and_test(&bam_ch[ch_id].notify_refs))
+		wake_up(&bam_ch[ch_id].notify_wait);
+	return 1;
+}
+
+/* Must not be called from the channel's own notify callback. */
+static void bam_ch_notify_sync(uint8_t ch_id)
+{
+	wait_event(bam_ch[ch_id].notify_wait,
+		   !atomic_read(&bam_ch[ch_id].notify_refs));
+}
+
+/* Pass a data packet to the channel's client. */
+static void bam_mux_deliver(uint8_t ch_id, struct sk_buff *skb)
+{
+	DBG_INC_RX_STAT(bam_dmux_rx_pkt_cnt);
+	if (!bam_ch_notify(ch_id, BAM_DMUX_RECEIVE, (unsigned long)(skb)))
+		dev_kfree_skb_any(skb);
+}
+
+/* Defer a control frame to the rx workqueue, it needs process context. */
+static void bam_mux_queue_cmd(struct bam_mux_hdr *rx_hdr)
+{
+	struct rx_pkt_info *info;
+
+	info = kmalloc(sizeof(struct rx_pkt_info), GFP_ATOMIC);
+	if (!info) {
+		DMUX_LOG_KERR("%s: unable to alloc rx_pkt_info\n", __func__);
+		return;
+	}
+	info->skb = __dev_alloc_skb(sizeof(struct bam_mux_hdr), GFP_ATOMIC);
+	if (!info->skb) {
+		DMUX_LOG_KERR("%s: unable to alloc skb\n", __func__);
+		kfree(info);
+		return;
+	}
+	memcpy(skb_put(info->skb, sizeof(struct bam_mux_hdr)), rx_hdr,
+			sizeof(struct bam_mux_hdr));
+	INIT_WORK(&info->work, handle_bam_mux_cmd);
+	queue_work(bam_mux_rx_workqueue, &info->work);
+}
+
+/*
+ * Process one completed rx buffer.  The A2 may pack several mux frames,
+ * each a bam_mux_hdr followed by payload and padding, into one buffer;
+ * info->len is the number of bytes it wrote (0 if not reported, in which
+ * case the buffer holds a single frame).
+ *
+ * A data frame that is alone in its buffer and longer than rx_copybreak
+ * is passed up in the buffer's own skb, and the buffer is replaced by
+ * the next refill.  Everything else is copied into a right-sized skb and
+ * the still mapped buffer goes straight back to the BAM.
+ *
+ * Returns the number of data packets delivered.
+ */
+static int bam_mux_rx_buffer(struct rx_pkt_info *info)
+{
+	struct sk_buff *rx_skb = info->skb;
+	struct sk_buff *skb;
 	struct bam_mux_hdr *rx_hdr;
-	unsigned long event_data;
+	uint32_t len = info->len ? info->len : BUFFER_SIZE;
+	uint32_t offset = 0;
+	uint32_t frame_len;
+	int pkts = 0;
+
+	if (!bam_dmux_loopback)
+		dma_sync_single_for_cpu(NULL, info->dma_address, BUFFER_SIZE,
+					DMA_FROM_DEVICE);
+
+	while (offset + sizeof(struct bam_mux_hdr) <= len) {
+		rx_hdr = (struct bam_mux_hdr *)(rx_skb->data + offset);
+		DBG_INC_READ_CNT(sizeof(struct bam_mux_hdr));
+		if (!bam_mux_hdr_valid(rx_hdr))
+			break;
+		frame_len = sizeof(struct bam_mux_hdr) + rx_hdr->pkt_len +
+				rx_hdr->pad_len;
+		if (offset + frame_len > BUFFER_SIZE) {
+			DMUX_LOG_KERR("%s: frame overruns buffer, offset %u"
+				" len %u\n", __func__, offset, frame_len);
+			break;
+		}
 
-	rx_hdr = (struct bam_mux_hdr *)rx_skb->data;
+		if (rx_hdr->cmd != BAM_MUX_HDR_CMD_DATA) {
+			bam_mux_queue_cmd(rx_hdr);
+		} else if (offset == 0 && (!info->len || frame_len >= len) &&
+			   rx_hdr->pkt_len > rx_copybreak) {
+			DBG_INC_READ_CNT(rx_hdr->pkt_len);
+			bam_rx_buf_unmap(info);
+			info->skb = NULL;
+			rx_skb->data = (unsigned char *)(rx_hdr + 1);
+			rx_skb->tail = rx_skb->data + rx_hdr->pkt_len;
+			rx_skb->len = rx_hdr->pkt_len;
+			rx_skb->truesize = rx_hdr->pkt_len +
+						sizeof(struct sk_buff);
+			bam_mux_deliver(rx_hdr->ch_id, rx_skb);
+			++pkts;
+			break;
+		} else {
+			DBG_INC_READ_CNT(rx_hdr->pkt_len);
+			skb = __dev_alloc_skb(rx_hdr->pkt_len, GFP_ATOMIC);
+			if (skb) {
+				memcpy(skb_put(skb, rx_hdr->pkt_len),
+					rx_hdr + 1, rx_hdr->pkt_len);
+				DBG_INC_RX_STAT(bam_dmux_rx_copy_cnt);
+				bam_mux_deliver(rx_hdr->ch_id, skb);
+				++pkts;
+			} else {
+				DBG_INC_RX_STAT(bam_dmux_rx_drop_cnt);
+			}
+		}
 
-	rx_skb->data = (unsigned char *)(rx_hdr + 1);
-	rx_skb->tail = rx_skb->data + rx_hdr->pkt_len;
-	rx_skb->len = rx_hdr->pkt_len;
-	rx_skb->truesize = rx_hdr->pkt_len + sizeof(struct sk_buff);
+		offset += frame_len;
+		if (!info->len)
+			break;
+	}
 
-	event_data = (unsigned long)(rx_skb);
+	if (pkts > 1)
+		DBG_INC_RX_STAT(bam_dmux_rx_aggr_cnt);
 
-	spin_lock_irqsave(&bam_ch[rx_hdr->ch_id].lock, flags);
-	if (bam_ch[rx_hdr->ch_id].notify)
-		bam_ch[rx_hdr->ch_id].notify(
-			bam_ch[rx_hdr->ch_id].priv, BAM_DMUX_RECEIVE,
-							event_data);
+	if (info->skb)
+		bam_rx_recycle(info);
 	else
-		dev_kfree_skb_any(rx_skb);
-	spin_unlock_irqrestore(&bam_ch[rx_hdr->ch_id].lock, flags);
+		kfree(info);
 
-	queue_rx();
+	return pkts;
 }
 
 static inline void handle_bam_mux_cmd_open(struct bam_mux_hdr *rx_hdr)
@@ -479,7 +878,6 @@ static inline void handle_bam_mux_cmd_open(struct bam_mux_hdr *rx_hdr)
 		bam_dmux_log("%s: open cid %d aborted due to ssr\n",
 				__func__, rx_hdr->ch_id);
 		mutex_unlock(&bam_pdev_mutexlock);
-		queue_rx();
 		return;
 	}
 	spin_lock_irqsave(&bam_ch[rx_hdr->ch_id].lock, flags);
@@ -491,9 +889,13 @@ static inline void handle_bam_mux_cmd_open(struct bam_mux_hdr *rx_hdr)
 		pr_err("%s: platform_device_add() error: %d\n",
 				__func__, ret);
 	mutex_unlock(&bam_pdev_mutexlock);
-	queue_rx();
 }
 
+/*
+ * Control frames are copied out of the rx buffer by bam_mux_rx_buffer()
+ * and handled here, in process context, since opening and closing a
+ * channel registers and unregisters its platform device.
+ */
 static void handle_bam_mux_cmd(struct work_struct *work)
 {
 	unsigned long flags;
@@ -503,42 +905,11 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 
 	info = container_of(work, struct rx_pkt_info, work);
 	rx_skb = info->skb;
-	dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE, DMA_FROM_DEVICE);
 	kfree(info);
 
 	rx_hdr = (struct bam_mux_hdr *)rx_skb->data;
 
-	DBG_INC_READ_CNT(sizeof(struct bam_mux_hdr));
-	DBG("%s: magic %x reserved %d cmd %d pad %d ch %d len %d\n", __func__,
-			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
-			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-	if (rx_hdr->magic_num != BAM_MUX_HDR_MAGIC_NO) {
-		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
-			" reserved %d cmd %d"
-			" pad %d ch %d len %d\n", __func__,
-			rx_hdr->magic_num, rx_hdr->reserved, rx_hdr->cmd,
-			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
-		return;
-	}
-
-	if (rx_hdr->ch_id >= BAM_DMUX_NUM_CHANNELS) {
-		DMUX_LOG_KERR("%s: dropping invalid LCID %d"
-			" reserved %d cmd %d"
-			" pad %d ch %d len %d\n", __func__,
-			rx_hdr->ch_id, rx_hdr->reserved, rx_hdr->cmd,
-			rx_hdr->pad_len, rx_hdr->ch_id, rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
-		return;
-	}
-
 	switch (rx_hdr->cmd) {
-	case BAM_MUX_HDR_CMD_DATA:
-		DBG_INC_READ_CNT(rx_hdr->pkt_len);
-		bam_mux_process_data(rx_skb);
-		break;
 	case BAM_MUX_HDR_CMD_OPEN:
 		bam_dmux_log("%s: opening cid %d PC enabled\n", __func__,
 				rx_hdr->ch_id);
@@ -547,7 +918,6 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			bam_dmux_log("%s: activating disconnect ack\n");
 			disconnect_ack = 1;
 		}
-		dev_kfree_skb_any(rx_skb);
 		break;
 	case BAM_MUX_HDR_CMD_OPEN_NO_A2_PC:
 		bam_dmux_log("%s: opening cid %d PC disabled\n", __func__,
@@ -559,7 +929,6 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 		}
 
 		handle_bam_mux_cmd_open(rx_hdr);
-		dev_kfree_skb_any(rx_skb);
 		break;
 	case BAM_MUX_HDR_CMD_CLOSE:
 		/* probably should drop pending write */
@@ -581,8 +950,6 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 		if (!bam_ch[rx_hdr->ch_id].pdev)
 			pr_err("%s: platform_device_alloc failed\n", __func__);
 		mutex_unlock(&bam_pdev_mutexlock);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
 		break;
 	default:
 		DMUX_LOG_KERR("%s: dropping invalid hdr. magic %x"
@@ -590,10 +957,42 @@ static void handle_bam_mux_cmd(struct work_struct *work)
 			__func__, rx_hdr->magic_num, rx_hdr->reserved,
 			rx_hdr->cmd, rx_hdr->pad_len, rx_hdr->ch_id,
 			rx_hdr->pkt_len);
-		dev_kfree_skb_any(rx_skb);
-		queue_rx();
-		return;
+		break;
 	}
+	dev_kfree_skb_any(rx_skb);
+}
+
+static void bam_mux_tx_complete(struct tx_pkt_info *pkt)
+{
+	if (!pkt->is_cmd)
+		dma_unmap_single(NULL, pkt->dma_address,
+					pkt->skb->len,
+					DMA_TO_DEVICE);
+	else
+		dma_unmap_single(NULL, pkt->dma_address,
+					pkt->len,
+					DMA_TO_DEVICE);
+	queue_work(bam_mux_tx_workqueue, &pkt->work);
+}
+
+/*
+ * Hand a tx packet to the BAM.  Must be called with bam_tx_pool_spinlock
+ * held and the packet already on bam_tx_pool.  In loopback mode data
+ * frames are copied into the rx pool and the packet completed at once;
+ * commands have nobody to talk to and are just completed.
+ */
+static int bam_tx_transfer_one(struct tx_pkt_info *pkt, void *data,
+				uint32_t len)
+{
+	if (bam_dmux_loopback) {
+		if (!pkt->is_cmd)
+			bam_loopback_rx(data, len);
+		bam_mux_tx_complete(pkt);
+		return 0;
+	}
+
+	return sps_transfer_one(bam_tx_pipe, pkt->dma_address, len,
+				pkt, SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
 }
 
 static int bam_mux_write_cmd(void *data, uint32_t len)
@@ -626,8 +1025,7 @@ static int bam_mux_write_cmd(void *data, uint32_t len)
 	INIT_WORK(&pkt->work, bam_mux_write_done);
 	spin_lock_irqsave(&bam_tx_pool_spinlock, flags);
 	list_add_tail(&pkt->list_node, &bam_tx_pool);
-	rc = sps_transfer_one(bam_tx_pipe, dma_address, len,
-				pkt, SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
+	rc = bam_tx_transfer_one(pkt, data, len);
 	if (rc) {
 		DMUX_LOG_KERR("%s sps_transfer_one failed rc=%d\n",
 			__func__, rc);
@@ -697,11 +1095,7 @@ static void bam_mux_write_done(struct work_struct *work)
 	spin_lock_irqsave(&bam_ch[hdr->ch_id].lock, flags);
 	bam_ch[hdr->ch_id].num_tx_pkts--;
 	spin_unlock_irqrestore(&bam_ch[hdr->ch_id].lock, flags);
-	if (bam_ch[hdr->ch_id].notify)
-		bam_ch[hdr->ch_id].notify(
-			bam_ch[hdr->ch_id].priv, BAM_DMUX_WRITE_DONE,
-							event_data);
-	else
+	if (!bam_ch_notify(hdr->ch_id, BAM_DMUX_WRITE_DONE, event_data))
 		dev_kfree_skb_any(skb);
 }
 
@@ -799,8 +1193,7 @@ int msm_bam_dmux_write(uint32_t id, struct sk_buff *skb)
 	INIT_WORK(&pkt->work, bam_mux_write_done);
 	spin_lock_irqsave(&bam_tx_pool_spinlock, flags);
 	list_add_tail(&pkt->list_node, &bam_tx_pool);
-	rc = sps_transfer_one(bam_tx_pipe, dma_address, skb->len,
-				pkt, SPS_IOVEC_FLAG_INT | SPS_IOVEC_FLAG_EOT);
+	rc = bam_tx_transfer_one(pkt, skb->data, skb->len);
 	if (rc) {
 		DMUX_LOG_KERR("%s sps_transfer_one failed rc=%d\n",
 			__func__, rc);
@@ -935,6 +1328,7 @@ int msm_bam_dmux_close(uint32_t id)
 	if (bam_ch_is_in_reset(id)) {
 		read_unlock(&ul_wakeup_lock);
 		bam_ch[id].status &= ~BAM_CH_IN_RESET;
+		bam_ch_notify_sync(id);
 		return 0;
 	}
 
@@ -942,6 +1336,7 @@ int msm_bam_dmux_close(uint32_t id)
 	if (hdr == NULL) {
 		pr_err("%s: hdr kmalloc failed. ch: %d\n", __func__, id);
 		read_unlock(&ul_wakeup_lock);
+		bam_ch_notify_sync(id);
 		return -ENOMEM;
 	}
 	hdr->magic_num = BAM_MUX_HDR_MAGIC_NO;
@@ -953,6 +1348,7 @@ int msm_bam_dmux_close(uint32_t id)
 
 	rc = bam_mux_write_cmd((void *)hdr, sizeof(struct bam_mux_hdr));
 	read_unlock(&ul_wakeup_lock);
+	bam_ch_notify_sync(id);
 
 	DBG("%s: closed ch %d\n", __func__, id);
 	return rc;
@@ -1002,11 +1398,9 @@ int msm_bam_dmux_is_ch_low(uint32_t id)
 	return ret;
 }
 
-static void rx_switch_to_interrupt_mode(void)
+static int rx_switch_to_interrupt_mode(void)
 {
 	struct sps_connect cur_rx_conn;
-	struct sps_iovec iov;
-	struct rx_pkt_info *info;
 	int ret;
 
 	/*
@@ -1035,111 +1429,77 @@ static void rx_switch_to_interrupt_mode(void)
 	}
 	polling_mode = 0;
 	release_wakelock();
-
-	/* handle any rx packets before interrupt was enabled */
-	while (bam_connection_is_active && !polling_mode) {
-		ret = sps_get_iovec(bam_rx_pipe, &iov);
-		if (ret) {
-			pr_err("%s: sps_get_iovec failed %d\n",
-					__func__, ret);
-			break;
-		}
-		if (iov.addr == 0)
-			break;
-
-		mutex_lock(&bam_rx_pool_mutexlock);
-		if (unlikely(list_empty(&bam_rx_pool))) {
-			DMUX_LOG_KERR("%s: have iovec %p but rx pool empty\n",
-				__func__, (void *)iov.addr);
-			mutex_unlock(&bam_rx_pool_mutexlock);
-			continue;
-		}
-		info = list_first_entry(&bam_rx_pool, struct rx_pkt_info,
-							list_node);
-		if (info->dma_address != iov.addr) {
-			DMUX_LOG_KERR("%s: iovec %p != dma %p\n",
-				__func__,
-				(void *)iov.addr,
-				(void *)info->dma_address);
-			list_for_each_entry(info, &bam_rx_pool, list_node) {
-				DMUX_LOG_KERR("%s: dma %p\n", __func__,
-					(void *)info->dma_address);
-				if (iov.addr == info->dma_address)
-					break;
-			}
-		}
-		BUG_ON(info->dma_address != iov.addr);
-		list_del(&info->list_node);
-		--bam_rx_pool_len;
-		mutex_unlock(&bam_rx_pool_mutexlock);
-		handle_bam_mux_cmd(&info->work);
-	}
-	return;
+	return 0;
 
 fail:
 	pr_err("%s: reverting to polling\n", __func__);
-	queue_work(bam_mux_rx_workqueue, &rx_timer_work);
+	return ret;
 }
 
-static void rx_timer_work_func(struct work_struct *work)
+static int bam_loopback_pending(void)
 {
-	struct sps_iovec iov;
 	struct rx_pkt_info *info;
-	int inactive_cycles = 0;
-	int ret;
+	unsigned long flags;
+	int pending;
 
-	while (bam_connection_is_active) { /* timer loop */
-		++inactive_cycles;
-		while (bam_connection_is_active) { /* deplete queue loop */
-			if (in_global_reset)
-				return;
+	spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
+	info = bam_loopback_cur();
+	pending = bam_loopback_done || (info && info->len);
+	spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
 
-			ret = sps_get_iovec(bam_rx_pipe, &iov);
-			if (ret) {
-				pr_err("%s: sps_get_iovec failed %d\n",
-						__func__, ret);
+	return pending;
+}
+
+/*
+ * NAPI poll, one unit of budget per rx buffer.  The EOT interrupt is
+ * disabled while polling; once the pipe runs dry it is re-enabled and
+ * the pipe drained once more, so buffers that completed before the
+ * interrupt was back on are not left behind.  If re-enabling fails the
+ * full budget is reported to stay on the poll list and retry.
+ */
+static int bam_mux_rx_poll(struct napi_struct *napi, int budget)
+{
+	struct rx_pkt_info *info;
+	unsigned long long t_start;
+	int done = 0;
+
+	t_start = sched_clock();
+	DBG_INC_RX_STAT(bam_dmux_rx_poll_cnt);
+
+	while (done < budget) {
+		if (in_global_reset || !bam_connection_is_active)
+			break;
+
+		info = bam_rx_dequeue();
+		if (!info) {
+			if (!polling_mode)
 				break;
-			}
-			if (iov.addr == 0)
+			if (rx_switch_to_interrupt_mode()) {
+				done = budget;
 				break;
-			inactive_cycles = 0;
-			mutex_lock(&bam_rx_pool_mutexlock);
-			if (unlikely(list_empty(&bam_rx_pool))) {
-				DMUX_LOG_KERR(
-					"%s: have iovec %p but rx pool empty\n",
-					__func__, (void *)iov.addr);
-				mutex_unlock(&bam_rx_pool_mutexlock);
-				continue;
 			}
-			info = list_first_entry(&bam_rx_pool,
-					struct rx_pkt_info,	list_node);
-			if (info->dma_address != iov.addr) {
-				DMUX_LOG_KERR("%s: iovec %p != dma %p\n",
-					__func__,
-					(void *)iov.addr,
-					(void *)info->dma_address);
-				list_for_each_entry(info, &bam_rx_pool,
-						list_node) {
-					DMUX_LOG_KERR("%s: dma %p\n", __func__,
-						(void *)info->dma_address);
-					if (iov.addr == info->dma_address)
-						break;
-				}
-			}
-			BUG_ON(info->dma_address != iov.addr);
-			list_del(&info->list_node);
-			--bam_rx_pool_len;
-			mutex_unlock(&bam_rx_pool_mutexlock);
-			handle_bam_mux_cmd(&info->work);
+			continue;
 		}
 
-		if (inactive_cycles == POLLING_INACTIVITY) {
-			rx_switch_to_interrupt_mode();
-			break;
-		}
+		DBG_INC_RX_STAT(bam_dmux_rx_buf_cnt);
+		bam_mux_rx_buffer(info);
+		++done;
+	}
+
+	if (done)
+		queue_rx(GFP_ATOMIC);
+
+	DBG_ADD_RX_POLL_NS(sched_clock() - t_start);
 
-		usleep_range(POLLING_MIN_SLEEP, POLLING_MAX_SLEEP);
+	if (done < budget) {
+		napi_complete(napi);
+		/* an EOT or loopback frame may have raced napi_complete() */
+		if (polling_mode ||
+		    (bam_dmux_loopback && bam_loopback_pending()))
+			napi_schedule(napi);
 	}
+
+	return done;
 }
 
 static void bam_mux_tx_notify(struct sps_event_notify *notify)
@@ -1154,15 +1514,7 @@ static void bam_mux_tx_notify(struct sps_event_notify *notify)
 	switch (notify->event_id) {
 	case SPS_EVENT_EOT:
 		pkt = notify->data.transfer.user;
-		if (!pkt->is_cmd)
-			dma_unmap_single(NULL, pkt->dma_address,
-						pkt->skb->len,
-						DMA_TO_DEVICE);
-		else
-			dma_unmap_single(NULL, pkt->dma_address,
-						pkt->len,
-						DMA_TO_DEVICE);
-		queue_work(bam_mux_tx_workqueue, &pkt->work);
+		bam_mux_tx_complete(pkt);
 		break;
 	default:
 		pr_err("%s: recieved unexpected event id %d\n", __func__,
@@ -1200,7 +1552,7 @@ static void bam_mux_rx_notify(struct sps_event_notify *notify)
 			}
 			grab_wakelock();
 			polling_mode = 1;
-			queue_work(bam_mux_rx_workqueue, &rx_timer_work);
+			napi_schedule(&bam_napi);
 		}
 		break;
 	default:
@@ -1250,12 +1602,32 @@ static int debug_stats(char *buf, int max)
 			"skb copy bytes:  %u\n"
 			"sps tx failures: %u\n"
 			"sps tx stalls:   %u\n"
-			"rx queue len:    %d\n",
+			"rx queue len:    %d\n"
+			"rx polls:        %u\n"
+			"rx buffers:      %u\n"
+			"rx packets:      %u\n"
+			"rx aggr buffers: %u\n"
+			"rx copies:       %u\n"
+			"rx recycled:     %u\n"
+			"rx allocs:       %u\n"
+			"rx drops:        %u\n"
+			"rx ns per pkt:   %llu\n",
 			bam_dmux_write_cpy_cnt,
 			bam_dmux_write_cpy_bytes,
 			bam_dmux_tx_sps_failure_cnt,
 			bam_dmux_tx_stall_cnt,
-			bam_rx_pool_len
+			bam_rx_pool_len,
+			bam_dmux_rx_poll_cnt,
+			bam_dmux_rx_buf_cnt,
+			bam_dmux_rx_pkt_cnt,
+			bam_dmux_rx_aggr_cnt,
+			bam_dmux_rx_copy_cnt,
+			bam_dmux_rx_recycle_cnt,
+			bam_dmux_rx_alloc_cnt,
+			bam_dmux_rx_drop_cnt,
+			bam_dmux_rx_pkt_cnt ?
+				div_u64(bam_dmux_rx_poll_ns,
+					bam_dmux_rx_pkt_cnt) : 0
 			);
 
 	return i;
@@ -1658,11 +2030,12 @@ static void reconnect_to_bam(void)
 		pr_err("%s: rx event reg failed rc = %d\n", __func__, i);
 
 	bam_connection_is_active = 1;
+	napi_enable(&bam_napi);
 
 	if (polling_mode)
 		rx_switch_to_interrupt_mode();
 
-	queue_rx();
+	queue_rx(GFP_KERNEL);
 
 	toggle_apps_ack();
 	complete_all(&bam_connection_completion);
@@ -1693,18 +2066,19 @@ static void disconnect_to_bam(void)
 	__memzero(rx_desc_mem_buf.base, rx_desc_mem_buf.size);
 	__memzero(tx_desc_mem_buf.base, tx_desc_mem_buf.size);
 
-	mutex_lock(&bam_rx_pool_mutexlock);
+	/* wait out a poll that may still be using the rx pool */
+	napi_disable(&bam_napi);
+	cancel_work_sync(&rx_refill_work);
+
+	spin_lock_irqsave(&bam_rx_pool_spinlock, flags);
 	while (!list_empty(&bam_rx_pool)) {
 		node = bam_rx_pool.next;
 		list_del(node);
 		info = container_of(node, struct rx_pkt_info, list_node);
-		dma_unmap_single(NULL, info->dma_address, BUFFER_SIZE,
-							DMA_FROM_DEVICE);
-		dev_kfree_skb_any(info->skb);
-		kfree(info);
+		bam_rx_buf_free(info);
 	}
 	bam_rx_pool_len = 0;
-	mutex_unlock(&bam_rx_pool_mutexlock);
+	spin_unlock_irqrestore(&bam_rx_pool_spinlock, flags);
 
 	if (disconnect_ack)
 		toggle_apps_ack();
@@ -1988,7 +2362,8 @@ static int bam_init(void)
 	}
 
 	bam_mux_initialized = 1;
-	queue_rx();
+	napi_enable(&bam_napi);
+	queue_rx(GFP_KERNEL);
 	toggle_apps_ack();
 	bam_connection_is_active = 1;
 	complete_all(&bam_connection_completion);
@@ -2168,6 +2543,8 @@ static int bam_dmux_probe(struct platform_device *pdev)
 
 	for (rc = 0; rc < BAM_DMUX_NUM_CHANNELS; ++rc) {
 		spin_lock_init(&bam_ch[rc].lock);
+		atomic_set(&bam_ch[rc].notify_refs, 0);
+		init_waitqueue_head(&bam_ch[rc].notify_wait);
 		scnprintf(bam_ch[rc].name, BAM_DMUX_CH_NAME_MAX_LEN,
 					"bam_dmux_ch_%d", rc);
 		/* bus 2, ie a2 stream 2 */
@@ -2219,6 +2596,60 @@ static int bam_dmux_probe(struct platform_device *pdev)
 	return 0;
 }
 
+/*
+ * Bring the mux up without the A2: no clocks, SMSM or BAM, every channel
+ * is reported open by the "remote" end and uplink data is looped back by
+ * bam_tx_transfer_one().
+ */
+static int bam_dmux_loopback_init(void)
+{
+	int rc;
+
+	bam_mux_rx_workqueue = create_singlethread_workqueue("bam_dmux_rx");
+	if (!bam_mux_rx_workqueue)
+		return -ENOMEM;
+
+	bam_mux_tx_workqueue = create_singlethread_workqueue("bam_dmux_tx");
+	if (!bam_mux_tx_workqueue) {
+		destroy_workqueue(bam_mux_rx_workqueue);
+		return -ENOMEM;
+	}
+
+	init_completion(&ul_wakeup_ack_completion);
+	init_completion(&bam_connection_completion);
+	init_completion(&dfab_unvote_completion);
+	INIT_DELAYED_WORK(&ul_timeout_work, ul_timeout);
+	wake_lock_init(&bam_wakelock, WAKE_LOCK_SUSPEND, "bam_dmux_wakelock");
+
+	bam_is_connected = 1;
+	bam_connection_is_active = 1;
+	bam_mux_initialized = 1;
+	napi_enable(&bam_napi);
+	queue_rx(GFP_KERNEL);
+	complete_all(&bam_connection_completion);
+
+	mutex_lock(&bam_pdev_mutexlock);
+	for (rc = 0; rc < BAM_DMUX_NUM_CHANNELS; ++rc) {
+		spin_lock_init(&bam_ch[rc].lock);
+		atomic_set(&bam_ch[rc].notify_refs, 0);
+		init_waitqueue_head(&bam_ch[rc].notify_wait);
+		scnprintf(bam_ch[rc].name, BAM_DMUX_CH_NAME_MAX_LEN,
+					"bam_dmux_ch_%d", rc);
+		bam_ch[rc].pdev = platform_device_alloc(bam_ch[rc].name, 2);
+		if (!bam_ch[rc].pdev) {
+			pr_err("%s: platform device alloc failed\n", __func__);
+			continue;
+		}
+		bam_ch[rc].status |= BAM_CH_REMOTE_OPEN;
+		if (platform_device_add(bam_ch[rc].pdev))
+			pr_err("%s: platform_device_add() failed\n", __func__);
+	}
+	mutex_unlock(&bam_pdev_mutexlock);
+
+	pr_info("%s: bam_dmux in loopback mode\n", __func__);
+	return 0;
+}
+
 static struct platform_driver bam_dmux_driver = {
 	.probe		= bam_dmux_probe,
 	.driver		= {
@@ -2248,6 +2679,13 @@ static int __init bam_dmux_init(void)
 		bam_dmux_state_logging_disabled = 1;
 	}
 
+	init_dummy_netdev(&bam_napi_dev);
+	netif_napi_add(&bam_napi_dev, &bam_napi, bam_mux_rx_poll,
+			BAM_MUX_NAPI_WEIGHT);
+
+	if (bam_dmux_loopback)
+		return bam_dmux_loopback_init();
+
 	subsys_notif_register_notifier("modem", &restart_notifier);
 	return platform_driver_register(&bam_dmux_driver);
 }
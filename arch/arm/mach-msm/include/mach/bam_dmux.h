@@ -33,7 +33,7 @@ enum {
 
 /* event type enum */
 enum {
-	BAM_DMUX_RECEIVE, /* data is struct sk_buff */
+	BAM_DMUX_RECEIVE, /* data is struct sk_buff, in softirq context */
 	BAM_DMUX_WRITE_DONE, /* data is struct sk_buff */
 	BAM_DMUX_UL_CONNECTED, /* data is null */
 	BAM_DMUX_UL_DISCONNECTED, /*data is null */
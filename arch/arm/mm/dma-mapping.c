@@ -18,6 +18,7 @@
 #include <linux/device.h>
 #include <linux/dma-mapping.h>
 #include <linux/highmem.h>
+#include <linux/dma-contiguous.h>
 
 #include <asm/memory.h>
 #include <asm/highmem.h>
@@ -55,11 +56,14 @@ static u64 get_coherent_dma_mask(struct device *dev)
 /*
  * Allocate a DMA buffer for 'dev' of size 'size' using the
  * specified gfp mask.  Note that 'size' must be page aligned.
+ *
+ * Callers which may sleep are served from the contiguous memory area
+ * first, falling back to the buddy allocator.
  */
 static struct page *__dma_alloc_buffer(struct device *dev, size_t size, gfp_t gfp)
 {
 	unsigned long order = get_order(size);
-	struct page *page, *p, *e;
+	struct page *page = NULL, *p, *e;
 	void *ptr;
 	u64 mask = get_coherent_dma_mask(dev);
 
@@ -78,16 +82,22 @@ static struct page *__dma_alloc_buffer(struct device *dev, size_t size, gfp_t gf
 	if (mask < 0xffffffffULL)
 		gfp |= GFP_DMA;
 
-	page = alloc_pages(gfp, order);
-	if (!page)
-		return NULL;
+	if (gfp & __GFP_WAIT)
+		page = dma_alloc_from_contiguous(dev, size >> PAGE_SHIFT,
+						 order);
+	if (!page) {
+		page = alloc_pages(gfp, order);
+		if (!page)
+			return NULL;
 
-	/*
-	 * Now split the huge page and free the excess pages
-	 */
-	split_page(page, order);
-	for (p = page + (size >> PAGE_SHIFT), e = page + (1 << order); p < e; p++)
-		__free_page(p);
+		/*
+		 * Now split the huge page and free the excess pages
+		 */
+		split_page(page, order);
+		for (p = page + (size >> PAGE_SHIFT), e = page + (1 << order);
+		     p < e; p++)
+			__free_page(p);
+	}
 
 	/*
 	 * Ensure that the allocated pages are zeroed, and that any data
@@ -104,10 +114,14 @@ static struct page *__dma_alloc_buffer(struct device *dev, size_t size, gfp_t gf
 /*
  * Free a DMA buffer.  'size' must be page aligned.
  */
-static void __dma_free_buffer(struct page *page, size_t size)
+static void __dma_free_buffer(struct device *dev, struct page *page,
+			      size_t size)
 {
 	struct page *e = page + (size >> PAGE_SHIFT);
 
+	if (dma_release_from_contiguous(dev, page, size >> PAGE_SHIFT))
+		return;
+
 	while (page < e) {
 		__free_page(page);
 		page++;
@@ -323,7 +337,7 @@ __dma_alloc(struct device *dev, size_t size, dma_addr_t *handle, gfp_t gfp,
 	if (addr)
 		*handle = pfn_to_dma(dev, page_to_pfn(page));
 	else
-		__dma_free_buffer(page, size);
+		__dma_free_buffer(dev, page, size);
 
 	return addr;
 }
@@ -418,7 +432,7 @@ void dma_free_coherent(struct device *dev, size_t size, void *cpu_addr, dma_addr
 	if (!arch_is_coherent())
 		__dma_free_remap(cpu_addr, size);
 
-	__dma_free_buffer(pfn_to_page(dma_to_pfn(dev, handle)), size);
+	__dma_free_buffer(dev, pfn_to_page(dma_to_pfn(dev, handle)), size);
 }
 EXPORT_SYMBOL(dma_free_coherent);
 
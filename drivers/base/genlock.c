@@ -31,6 +31,9 @@
 #define _RDLOCK  GENLOCK_RDLOCK
 #define _WRLOCK GENLOCK_WRLOCK
 
+/* Value of genlock.count while the lock is held as a write lock */
+#define _WRCOUNT -1
+
 #define GENLOCK_LOG_ERR(fmt, args...) \
 pr_err("genlock: %s: " fmt, __func__, ##args)
 
@@ -41,21 +44,33 @@ pr_err("genlock: %s: " fmt, __func__, ##args)
 #define GENLOCK_MAGIC_OK  0xD2EAD10C
 #define GENLOCK_MAGIC_BAD 0xD2EADBAD
 
+/*
+ * The state of a lock is a single atomic counter, so that uncontended
+ * lock and unlock operations are one atomic instruction:
+ *
+ *   count == 0         unlocked
+ *   count > 0          read lock, count is the number of read locks held
+ *                      (recursive read locks by one handle count each)
+ *   count == _WRCOUNT  write lock
+ *
+ * Readers, and genlock_wait() callers, sleep on queue and are all woken
+ * when they can proceed.  Writers sleep on wr_queue and are woken one at
+ * a time when the lock becomes free.
+ */
+
 struct genlock {
 	unsigned int magic;       /* Magic for attach verification */
-	struct list_head active;  /* List of handles holding lock */
-	spinlock_t lock;          /* Spinlock to protect the lock internals */
-	wait_queue_head_t queue;  /* Holding pen for processes pending lock */
+	atomic_t count;           /* Current state of the lock */
+	wait_queue_head_t queue;  /* Holding pen for readers and waiters */
+	wait_queue_head_t wr_queue; /* Holding pen for writers */
 	struct file *file;        /* File structure for exported lock */
-	int state;                /* Current state of the lock */
 	struct kref refcount;
 };
 
 struct genlock_handle {
 	struct genlock *lock;     /* Lock currently attached to the handle */
-	struct list_head entry;   /* List node for attaching to a lock */
 	struct file *file;        /* File structure associated with handle */
-	int active;		  /* Number of times the active lock has been
+	atomic_t active;	  /* Number of times the active lock has been
 				     taken */
 };
 
@@ -133,12 +148,11 @@ struct genlock *genlock_create_lock(struct genlock_handle *handle)
 		return ERR_PTR(-ENOMEM);
 	}
 
-	INIT_LIST_HEAD(&lock->active);
 	init_waitqueue_head(&lock->queue);
-	spin_lock_init(&lock->lock);
+	init_waitqueue_head(&lock->wr_queue);
+	atomic_set(&lock->count, 0);
 
 	lock->magic = GENLOCK_MAGIC_OK;
-	lock->state = _UNLOCKED;
 
 	/*
 	 * Create an anonyonmous inode for the object that can exported to
@@ -238,63 +252,147 @@ fail_invalid:
 }
 EXPORT_SYMBOL(genlock_attach_lock);
 
+/* Helper function that returns the current state of the lock */
+
+static int genlock_state(struct genlock *lock)
+{
+	int count = atomic_read(&lock->count);
+
+	if (count == 0)
+		return _UNLOCKED;
+
+	return (count == _WRCOUNT) ? _WRLOCK : _RDLOCK;
+}
+
 /* Helper function that returns 1 if the specified handle holds the lock */
 
 static int handle_has_lock(struct genlock *lock, struct genlock_handle *handle)
 {
-	struct genlock_handle *h;
+	return handle->lock == lock && atomic_read(&handle->active) > 0;
+}
 
-	list_for_each_entry(h, &lock->active, entry) {
-		if (h == handle)
+/*
+ * Try to take the lock without blocking.  Returns 1 if the lock was taken.
+ * A read lock can be taken while the lock is free or read locked, a write
+ * lock only while it is free.
+ */
+
+static int genlock_trylock(struct genlock *lock, int op)
+{
+	int count, old;
+
+	if (op == _WRLOCK)
+		return atomic_cmpxchg(&lock->count, 0, _WRCOUNT) == 0;
+
+	count = atomic_read(&lock->count);
+
+	while (count >= 0) {
+		old = atomic_cmpxchg(&lock->count, count, count + 1);
+		if (old == count)
 			return 1;
+		count = old;
 	}
 
 	return 0;
 }
 
-/* If the lock just became available, signal the next entity waiting for it */
+/*
+ * The lock just became available, signal the entities waiting for it.
+ * All the readers can go ahead together, but only one writer can win so
+ * only one is woken.  The caller must have updated the count with a fully
+ * ordered atomic operation before calling this.
+ */
 
 static void _genlock_signal(struct genlock *lock)
 {
-	if (list_empty(&lock->active)) {
-		/* If the list is empty, then the lock is free */
-		lock->state = _UNLOCKED;
-		/* Wake up the first process sitting in the queue */
+	if (waitqueue_active(&lock->queue))
 		wake_up(&lock->queue);
-	}
+	if (waitqueue_active(&lock->wr_queue))
+		wake_up(&lock->wr_queue);
 }
 
-/* Attempt to release the handle's ownership of the lock */
+/* Drop nr references held by a handle, nr is 1 for a write lock */
 
-static int _genlock_unlock(struct genlock *lock, struct genlock_handle *handle)
+static void genlock_put(struct genlock *lock, int nr)
 {
-	int ret = -EINVAL;
-	unsigned long irqflags;
+	int count;
 
-	spin_lock_irqsave(&lock->lock, irqflags);
+	if (atomic_read(&lock->count) == _WRCOUNT)
+		count = atomic_inc_return(&lock->count);
+	else
+		count = atomic_sub_return(nr, &lock->count);
 
-	if (lock->state == _UNLOCKED) {
+	if (count == 0)
+		_genlock_signal(lock);
+}
+
+/* Attempt to release the handle's ownership of the lock */
+
+static int _genlock_unlock(struct genlock *lock, struct genlock_handle *handle)
+{
+	if (genlock_state(lock) == _UNLOCKED) {
 		GENLOCK_LOG_ERR("Trying to unlock an unlocked handle\n");
-		goto done;
+		return -EINVAL;
 	}
 
 	/* Make sure this handle is an owner of the lock */
-	if (!handle_has_lock(lock, handle)) {
+	if (!atomic_add_unless(&handle->active, -1, 0)) {
 		GENLOCK_LOG_ERR("handle does not have lock attached to it\n");
-		goto done;
+		return -EINVAL;
 	}
-	/* If the handle holds no more references to the lock then
-	   release it (maybe) */
 
-	if (--handle->active == 0) {
-		list_del(&handle->entry);
-		_genlock_signal(lock);
+	genlock_put(lock, 1);
+
+	return 0;
+}
+
+/*
+ * Sleep until the lock can be taken for op, or the timeout expires.
+ * Returns 0 once the lock has been taken.
+ */
+
+static int genlock_wait_lock(struct genlock *lock, int op, long ticks)
+{
+	wait_queue_head_t *wq = (op == _WRLOCK) ? &lock->wr_queue :
+		&lock->queue;
+	DEFINE_WAIT(wait);
+	int ret;
+
+	for (;;) {
+		if (op == _WRLOCK)
+			prepare_to_wait_exclusive(wq, &wait,
+				TASK_INTERRUPTIBLE);
+		else
+			prepare_to_wait(wq, &wait, TASK_INTERRUPTIBLE);
+
+		if (genlock_trylock(lock, op)) {
+			ret = 0;
+			break;
+		}
+
+		if (ticks == 0) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+
+		ticks = schedule_timeout(ticks);
 	}
 
-	ret = 0;
+	finish_wait(wq, &wait);
+
+	/*
+	 * A writer that gives up may have been woken in place of another
+	 * one, so pass the wakeup on if the lock is still free
+	 */
+
+	if (ret && op == _WRLOCK && atomic_read(&lock->count) == 0)
+		wake_up(&lock->wr_queue);
 
-done:
-	spin_unlock_irqrestore(&lock->lock, irqflags);
 	return ret;
 }
 
@@ -303,11 +401,7 @@ done:
 static int _genlock_lock(struct genlock *lock, struct genlock_handle *handle,
 	int op, int flags, uint32_t timeout)
 {
-	unsigned long irqflags;
-	int ret = 0;
-	unsigned long ticks = msecs_to_jiffies(timeout);
-
-	spin_lock_irqsave(&lock->lock, irqflags);
+	int ret;
 
 	/* Sanity check - no blocking locks in a debug context. Even if it
 	 * succeed to not block, the mere idea is too dangerous to continue
@@ -316,9 +410,13 @@ static int _genlock_lock(struct genlock *lock, struct genlock_handle *handle,
 	if (in_interrupt() && !(flags & GENLOCK_NOBLOCK))
 		BUG();
 
-	/* Fast path - the lock is unlocked, so go do the needful */
+	/*
+	 * Fast path - the lock is unlocked, or read locked and we want to
+	 * read, so take it with a single atomic operation.  This also covers
+	 * recursive read locks by a handle that already holds a read lock.
+	 */
 
-	if (lock->state == _UNLOCKED)
+	if (!(flags & GENLOCK_WRITE_TO_READ) && genlock_trylock(lock, op))
 		goto dolock;
 
 	if (handle_has_lock(lock, handle)) {
@@ -332,30 +430,28 @@ static int _genlock_lock(struct genlock *lock, struct genlock_handle *handle,
 		 * handle.
 		 */
 
-		if (lock->state == _RDLOCK && op == _RDLOCK) {
-			handle->active++;
-			goto done;
-		}
+		if (op == _RDLOCK && genlock_state(lock) == _RDLOCK &&
+			genlock_trylock(lock, op))
+			goto dolock;
 
 		/*
 		 * If the handle holds a write lock then the owner can switch
 		 * to a read lock if they want. Do the transition atomically
-		 * then wake up any pending waiters in case they want a read
-		 * lock too. In order to support synchronization within a
-		 * process the caller must explicity request to convert the
-		 * lock type with the GENLOCK_WRITE_TO_READ flag.
+		 * then wake up any pending readers. In order to support
+		 * synchronization within a process the caller must explicity
+		 * request to convert the lock type with the
+		 * GENLOCK_WRITE_TO_READ flag.
 		 */
 
 		if (flags & GENLOCK_WRITE_TO_READ) {
-			if (lock->state == _WRLOCK && op == _RDLOCK) {
-				lock->state = _RDLOCK;
+			if (op == _RDLOCK && atomic_cmpxchg(&lock->count,
+					_WRCOUNT, 1) == _WRCOUNT) {
 				wake_up(&lock->queue);
-				goto done;
+				return 0;
 			} else {
 				GENLOCK_LOG_ERR("Invalid state to convert"
 					"write to read\n");
-				ret = -EINVAL;
-				goto done;
+				return -EINVAL;
 			}
 		}
 	} else {
@@ -368,26 +464,15 @@ static int _genlock_lock(struct genlock *lock, struct genlock_handle *handle,
 		if (flags & GENLOCK_WRITE_TO_READ) {
 			GENLOCK_LOG_ERR("Handle must have lock to convert"
 				"write to read\n");
-			ret = -EINVAL;
-			goto done;
+			return -EINVAL;
 		}
-
-		/*
-		 * If we request a read and the lock is held by a read, then go
-		 * ahead and share the lock
-		 */
-
-		if (op == GENLOCK_RDLOCK && lock->state == _RDLOCK)
-			goto dolock;
 	}
 
 	/* Treat timeout 0 just like a NOBLOCK flag and return if the
 	   lock cannot be aquired without blocking */
 
-	if (flags & GENLOCK_NOBLOCK || timeout == 0) {
-		ret = -EAGAIN;
-		goto done;
-	}
+	if (flags & GENLOCK_NOBLOCK || timeout == 0)
+		return -EAGAIN;
 
 	/*
 	 * Wait while the lock remains in an incompatible state
@@ -399,38 +484,15 @@ static int _genlock_lock(struct genlock *lock, struct genlock_handle *handle,
 	 * write    n/a   yes
 	 */
 
-	while ((lock->state == _RDLOCK && op == _WRLOCK) ||
-			lock->state == _WRLOCK) {
-		signed long elapsed;
-
-		spin_unlock_irqrestore(&lock->lock, irqflags);
-
-		elapsed = wait_event_interruptible_timeout(lock->queue,
-			lock->state == _UNLOCKED ||
-			(lock->state == _RDLOCK && op == _RDLOCK),
-			ticks);
-
-		spin_lock_irqsave(&lock->lock, irqflags);
-
-		if (elapsed <= 0) {
-			ret = (elapsed < 0) ? elapsed : -ETIMEDOUT;
-			goto done;
-		}
-
-		ticks = (unsigned long) elapsed;
-	}
+	ret = genlock_wait_lock(lock, op, msecs_to_jiffies(timeout));
+	if (ret)
+		return ret;
 
 dolock:
-	/* We can now get the lock, add ourselves to the list of owners */
-
-	list_add_tail(&handle->entry, &lock->active);
-	lock->state = op;
-	handle->active++;
-
-done:
-	spin_unlock_irqrestore(&lock->lock, irqflags);
-	return ret;
+	/* We now hold the lock, account for it in the handle */
 
+	atomic_inc(&handle->active);
+	return 0;
 }
 
 /**
@@ -447,7 +509,6 @@ int genlock_lock(struct genlock_handle *handle, int op, int flags,
 	uint32_t timeout)
 {
 	struct genlock *lock;
-	unsigned long irqflags;
 
 	int ret = 0;
 
@@ -468,12 +529,10 @@ int genlock_lock(struct genlock_handle *handle, int op, int flags,
 		ret = _genlock_unlock(lock, handle);
 		break;
 	case GENLOCK_RDLOCK:
-		spin_lock_irqsave(&lock->lock, irqflags);
 		if (handle_has_lock(lock, handle)) {
 			/* request the WRITE_TO_READ flag for compatibility */
 			flags |= GENLOCK_WRITE_TO_READ;
 		}
-		spin_unlock_irqrestore(&lock->lock, irqflags);
 		/* fall through to take lock */
 	case GENLOCK_WRLOCK:
 		ret = _genlock_lock(lock, handle, op, flags, timeout);
@@ -544,9 +603,8 @@ EXPORT_SYMBOL(genlock_dreadlock);
 int genlock_wait(struct genlock_handle *handle, uint32_t timeout)
 {
 	struct genlock *lock;
-	unsigned long irqflags;
-	int ret = 0;
 	unsigned long ticks = msecs_to_jiffies(timeout);
+	long elapsed;
 
 	if (IS_ERR_OR_NULL(handle)) {
 		GENLOCK_LOG_ERR("Invalid handle\n");
@@ -560,63 +618,40 @@ int genlock_wait(struct genlock_handle *handle, uint32_t timeout)
 		return -EINVAL;
 	}
 
-	spin_lock_irqsave(&lock->lock, irqflags);
-
 	/*
 	 * if timeout is 0 and the lock is already unlocked, then success
 	 * otherwise return -EAGAIN
 	 */
 
-	if (timeout == 0) {
-		ret = (lock->state == _UNLOCKED) ? 0 : -EAGAIN;
-		goto done;
-	}
-
-	while (lock->state != _UNLOCKED) {
-		signed long elapsed;
-
-		spin_unlock_irqrestore(&lock->lock, irqflags);
+	if (timeout == 0)
+		return (genlock_state(lock) == _UNLOCKED) ? 0 : -EAGAIN;
 
-		elapsed = wait_event_interruptible_timeout(lock->queue,
-			lock->state == _UNLOCKED, ticks);
-
-		spin_lock_irqsave(&lock->lock, irqflags);
-
-		if (elapsed <= 0) {
-			ret = (elapsed < 0) ? elapsed : -ETIMEDOUT;
-			break;
-		}
+	elapsed = wait_event_interruptible_timeout(lock->queue,
+		genlock_state(lock) == _UNLOCKED, ticks);
 
-		ticks = (unsigned long) elapsed;
-	}
+	if (elapsed <= 0)
+		return (elapsed < 0) ? elapsed : -ETIMEDOUT;
 
-done:
-	spin_unlock_irqrestore(&lock->lock, irqflags);
-	return ret;
+	return 0;
 }
 
 static void genlock_release_lock(struct genlock_handle *handle)
 {
-	unsigned long flags;
+	int active;
 
 	if (handle == NULL || handle->lock == NULL)
 		return;
 
-	spin_lock_irqsave(&handle->lock->lock, flags);
-
 	/* If the handle is holding the lock, then force it closed */
 
-	if (handle_has_lock(handle->lock, handle)) {
-		list_del(&handle->entry);
-		_genlock_signal(handle->lock);
-	}
-	spin_unlock_irqrestore(&handle->lock->lock, flags);
+	active = atomic_xchg(&handle->active, 0);
+	if (active > 0)
+		genlock_put(handle->lock, active);
 
 	spin_lock(&genlock_ref_lock);
 	kref_put(&handle->lock->refcount, genlock_destroy);
 	spin_unlock(&genlock_ref_lock);
 	handle->lock = NULL;
-	handle->active = 0;
 }
 
 /*
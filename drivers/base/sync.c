@@ -23,6 +23,7 @@
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/sync.h>
 #include <linux/uaccess.h>
 
@@ -141,15 +142,20 @@ void sync_timeline_signal(struct sync_timeline *obj)
 
 	spin_lock_irqsave(&obj->active_list_lock, flags);
 
+	/*
+	 * The active list is kept in signaling order, so only its signaled
+	 * prefix needs to be looked at.
+	 */
 	list_for_each_safe(pos, n, &obj->active_list_head) {
 		struct sync_pt *pt =
 			container_of(pos, struct sync_pt, active_list);
 
-		if (_sync_pt_has_signaled(pt)) {
-			list_del_init(pos);
-			list_add(&pt->signaled_list, &signaled_pts);
-			kref_get(&pt->fence->kref);
-		}
+		if (!_sync_pt_has_signaled(pt))
+			break;
+
+		list_del_init(pos);
+		list_add_tail(&pt->signaled_list, &signaled_pts);
+		kref_get(&pt->fence->kref);
 	}
 
 	spin_unlock_irqrestore(&obj->active_list_lock, flags);
@@ -219,10 +225,17 @@ static struct sync_pt *sync_pt_dup(struct sync_pt *pt)
 	return pt->parent->ops->dup(pt);
 }
 
-/* Adds a sync pt to the active queue.  Called when added to a fence */
+/*
+ * Adds a sync pt to the active queue.  Called when added to a fence
+ *
+ * The queue is sorted by ops->compare().  New pts are nearly always the
+ * latest on their timeline, so the insertion point is searched from the
+ * tail.
+ */
 static void sync_pt_activate(struct sync_pt *pt)
 {
 	struct sync_timeline *obj = pt->parent;
+	struct sync_pt *pos;
 	unsigned long flags;
 	int err;
 
@@ -232,7 +245,11 @@ static void sync_pt_activate(struct sync_pt *pt)
 	if (err != 0)
 		goto out;
 
-	list_add_tail(&pt->active_list, &obj->active_list_head);
+	list_for_each_entry_reverse(pos, &obj->active_list_head, active_list) {
+		if (obj->ops->compare(pos, pt) <= 0)
+			break;
+	}
+	list_add(&pt->active_list, &pos->active_list);
 
 out:
 	spin_unlock_irqrestore(&obj->active_list_lock, flags);
@@ -310,73 +327,70 @@ struct sync_fence *sync_fence_create(const char *name, struct sync_pt *pt)
 }
 EXPORT_SYMBOL(sync_fence_create);
 
-static int sync_fence_copy_pts(struct sync_fence *dst, struct sync_fence *src)
+static int sync_pt_cmp(const void *a, const void *b)
 {
-	struct list_head *pos;
+	struct sync_pt *pt_a = *(struct sync_pt **)a;
+	struct sync_pt *pt_b = *(struct sync_pt **)b;
 
-	list_for_each(pos, &src->pt_list_head) {
-		struct sync_pt *orig_pt =
-			container_of(pos, struct sync_pt, pt_list);
-		struct sync_pt *new_pt = sync_pt_dup(orig_pt);
+	if (pt_a->parent != pt_b->parent)
+		return pt_a->parent < pt_b->parent ? -1 : 1;
 
-		if (new_pt == NULL)
-			return -ENOMEM;
+	return pt_a->parent->ops->compare(pt_a, pt_b);
+}
 
-		new_pt->fence = dst;
-		list_add(&new_pt->pt_list, &dst->pt_list_head);
-		sync_pt_activate(new_pt);
-	}
+static int sync_fence_count_pts(struct sync_fence *fence)
+{
+	struct list_head *pos;
+	int count = 0;
 
-	return 0;
+	list_for_each(pos, &fence->pt_list_head)
+		count++;
+
+	return count;
 }
 
-static int sync_fence_merge_pts(struct sync_fence *dst, struct sync_fence *src)
-{
-	struct list_head *src_pos, *dst_pos, *n;
-
-	list_for_each(src_pos, &src->pt_list_head) {
-		struct sync_pt *src_pt =
-			container_of(src_pos, struct sync_pt, pt_list);
-		bool collapsed = false;
-
-		list_for_each_safe(dst_pos, n, &dst->pt_list_head) {
-			struct sync_pt *dst_pt =
-				container_of(dst_pos, struct sync_pt, pt_list);
-			/* collapse two sync_pts on the same timeline
-			 * to a single sync_pt that will signal at
-			 * the later of the two
-			 */
-			if (dst_pt->parent == src_pt->parent) {
-				if (dst_pt->parent->ops->compare(dst_pt, src_pt) == -1) {
-					struct sync_pt *new_pt =
-						sync_pt_dup(src_pt);
-					if (new_pt == NULL)
-						return -ENOMEM;
-
-					new_pt->fence = dst;
-					list_replace(&dst_pt->pt_list,
-						     &new_pt->pt_list);
-					sync_pt_activate(new_pt);
-					sync_pt_free(dst_pt);
-				}
-				collapsed = true;
-				break;
-			}
-		}
+/*
+ * Collapse the sync_pts of a and b to a single sync_pt per timeline, the
+ * one that will signal last.  Sorting them by timeline and then by
+ * signaling order leaves the one to keep at the end of each run.
+ */
+static int sync_fence_merge_pts(struct sync_fence *dst,
+				struct sync_fence *a, struct sync_fence *b)
+{
+	struct sync_pt **pts, *pt;
+	int i, n = 0, err = 0;
+
+	pts = kcalloc(sync_fence_count_pts(a) + sync_fence_count_pts(b),
+		      sizeof(*pts), GFP_KERNEL);
+	if (pts == NULL)
+		return -ENOMEM;
+
+	list_for_each_entry(pt, &a->pt_list_head, pt_list)
+		pts[n++] = pt;
+	list_for_each_entry(pt, &b->pt_list_head, pt_list)
+		pts[n++] = pt;
+
+	sort(pts, n, sizeof(*pts), sync_pt_cmp, NULL);
 
-		if (!collapsed) {
-			struct sync_pt *new_pt = sync_pt_dup(src_pt);
+	for (i = 0; i < n; i++) {
+		struct sync_pt *new_pt;
 
-			if (new_pt == NULL)
-				return -ENOMEM;
+		if (i + 1 < n && pts[i + 1]->parent == pts[i]->parent)
+			continue;
 
-			new_pt->fence = dst;
-			list_add(&new_pt->pt_list, &dst->pt_list_head);
-			sync_pt_activate(new_pt);
+		new_pt = sync_pt_dup(pts[i]);
+		if (new_pt == NULL) {
+			err = -ENOMEM;
+			break;
 		}
+
+		new_pt->fence = dst;
+		list_add_tail(&new_pt->pt_list, &dst->pt_list_head);
+		sync_pt_activate(new_pt);
 	}
 
-	return 0;
+	kfree(pts);
+	return err;
 }
 
 static void sync_fence_detach_pts(struct sync_fence *fence)
@@ -459,11 +473,7 @@ struct sync_fence *sync_fence_merge(const char *name,
 	if (fence == NULL)
 		return NULL;
 
-	err = sync_fence_copy_pts(fence, a);
-	if (err < 0)
-		goto err;
-
-	err = sync_fence_merge_pts(fence, b);
+	err = sync_fence_merge_pts(fence, a, b);
 	if (err < 0)
 		goto err;
 
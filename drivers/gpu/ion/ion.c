@@ -19,12 +19,18 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/anon_inodes.h>
+#include <linux/dma-buf.h>
+#include <linux/freezer.h>
 #include <linux/ion.h>
+#include <linux/ktime.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
 #include <linux/mm_types.h>
 #include <linux/rbtree.h>
+#include <linux/rculist.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 #include <linux/seq_file.h>
@@ -39,15 +45,19 @@
  * struct ion_device - the metadata of the ion device node
  * @dev:		the actual misc device
  * @buffers:	an rb tree of all the existing buffers
- * @lock:		lock protecting the buffers & heaps trees
- * @heaps:		list of all the heaps in the system
+ * @buffer_lock:	lock protecting the tree of buffers
+ * @lock:		lock protecting the client trees
+ * @heaps:		rcu list of all the heaps in the system, sorted by id
+ * @heap_lock:	serializes additions to the list of heaps
  * @user_clients:	list of all the clients created from userspace
  */
 struct ion_device {
 	struct miscdevice dev;
 	struct rb_root buffers;
+	struct mutex buffer_lock;
 	struct mutex lock;
-	struct rb_root heaps;
+	struct list_head heaps;
+	struct mutex heap_lock;
 	long (*custom_ioctl) (struct ion_client *client, unsigned int cmd,
 			      unsigned long arg);
 	struct rb_root user_clients;
@@ -109,7 +119,7 @@ struct ion_handle {
 
 static void ion_iommu_release(struct kref *kref);
 
-/* this function should only be called while dev->lock is held */
+/* this function should only be called while dev->buffer_lock is held */
 static void ion_buffer_add(struct ion_device *dev,
 			   struct ion_buffer *buffer)
 {
@@ -190,7 +200,86 @@ static struct ion_iommu_map *ion_iommu_lookup(struct ion_buffer *buffer,
 	return NULL;
 }
 
-/* this function should only be called while dev->lock is held */
+static void ion_buffer_release(struct ion_buffer *buffer)
+{
+	struct ion_heap *heap = buffer->heap;
+
+	mutex_lock(&heap->lock);
+	heap->ops->free(buffer);
+	mutex_unlock(&heap->lock);
+	kfree(buffer);
+}
+
+static void ion_heap_freelist_add(struct ion_heap *heap,
+				  struct ion_buffer *buffer)
+{
+	spin_lock(&heap->free_lock);
+	list_add_tail(&buffer->list, &heap->free_list);
+	heap->free_list_size += buffer->size;
+	spin_unlock(&heap->free_lock);
+	wake_up(&heap->waitqueue);
+}
+
+static size_t ion_heap_freelist_size(struct ion_heap *heap)
+{
+	size_t size;
+
+	spin_lock(&heap->free_lock);
+	size = heap->free_list_size;
+	spin_unlock(&heap->free_lock);
+	return size;
+}
+
+/*
+ * Release everything on the heap's free list.  Called from the deferred
+ * free thread, and from allocators that need the memory back right away.
+ */
+static size_t ion_heap_freelist_drain(struct ion_heap *heap)
+{
+	struct ion_buffer *buffer;
+	size_t freed = 0;
+
+	spin_lock(&heap->free_lock);
+	while (!list_empty(&heap->free_list)) {
+		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
+					  list);
+		list_del(&buffer->list);
+		heap->free_list_size -= buffer->size;
+		spin_unlock(&heap->free_lock);
+		freed += buffer->size;
+		ion_buffer_release(buffer);
+		spin_lock(&heap->free_lock);
+	}
+	spin_unlock(&heap->free_lock);
+	return freed;
+}
+
+static int ion_heap_deferred_free(void *data)
+{
+	struct ion_heap *heap = data;
+
+	set_freezable();
+	while (true) {
+		wait_event_freezable(heap->waitqueue,
+				     ion_heap_freelist_size(heap) > 0);
+		ion_heap_freelist_drain(heap);
+	}
+
+	return 0;
+}
+
+/* this function should only be called while heap->lock is held */
+static void ion_heap_account_latency(struct ion_heap *heap, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, ilog2(us) + 1,
+			       ION_HEAP_LATENCY_BUCKETS - 1);
+	heap->alloc_latency[bucket]++;
+}
+
 static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     struct ion_device *dev,
 				     unsigned long len,
@@ -198,6 +287,8 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 				     unsigned long flags)
 {
 	struct ion_buffer *buffer;
+	bool drained = false;
+	ktime_t start;
 	int ret;
 
 	buffer = kzalloc(sizeof(struct ion_buffer), GFP_KERNEL);
@@ -207,7 +298,22 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->heap = heap;
 	kref_init(&buffer->ref);
 
+	start = ktime_get();
+retry:
+	mutex_lock(&heap->lock);
 	ret = heap->ops->allocate(heap, buffer, len, align, flags);
+	if (ret && !drained && (heap->flags & ION_HEAP_FLAG_DEFER_FREE) &&
+	    ion_heap_freelist_size(heap)) {
+		/* the memory may only be waiting for the free thread */
+		mutex_unlock(&heap->lock);
+		ion_heap_freelist_drain(heap);
+		drained = true;
+		goto retry;
+	}
+	if (!ret)
+		ion_heap_account_latency(heap, start);
+	mutex_unlock(&heap->lock);
+
 	if (ret) {
 		kfree(buffer);
 		return ERR_PTR(ret);
@@ -216,7 +322,9 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	buffer->size = len;
 	buffer->flags = flags;
 	mutex_init(&buffer->lock);
+	mutex_lock(&dev->buffer_lock);
 	ion_buffer_add(dev, buffer);
+	mutex_unlock(&dev->buffer_lock);
 	return buffer;
 }
 
@@ -255,14 +363,18 @@ static void ion_iommu_delayed_unmap(struct ion_buffer *buffer)
 static void ion_buffer_destroy(struct kref *kref)
 {
 	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
+	struct ion_heap *heap = buffer->heap;
 	struct ion_device *dev = buffer->dev;
 
 	ion_iommu_delayed_unmap(buffer);
-	buffer->heap->ops->free(buffer);
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->buffer_lock);
 	rb_erase(&buffer->node, &dev->buffers);
-	mutex_unlock(&dev->lock);
-	kfree(buffer);
+	mutex_unlock(&dev->buffer_lock);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_freelist_add(heap, buffer);
+	else
+		ion_buffer_release(buffer);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -377,7 +489,7 @@ static void ion_handle_add(struct ion_client *client, struct ion_handle *handle)
 struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 			     size_t align, unsigned int flags)
 {
-	struct rb_node *n;
+	struct ion_heap *heap;
 	struct ion_handle *handle;
 	struct ion_device *dev = client->dev;
 	struct ion_buffer *buffer = NULL;
@@ -392,11 +504,12 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	 * traverse the list of heaps available in this system in priority
 	 * order.  If the heap type is supported by the client, and matches the
 	 * request of the caller allocate from it.  Repeat until allocate has
-	 * succeeded or all heaps have been tried
+	 * succeeded or all heaps have been tried.  Heaps are never removed,
+	 * so the list can be walked without holding rcu_read_lock() across
+	 * the allocations, which may sleep.  Only the heap being allocated
+	 * from is locked.
 	 */
-	mutex_lock(&dev->lock);
-	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
-		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
+	list_for_each_entry_rcu(heap, &dev->heaps, list) {
 		/* if the client doesn't support this heap type */
 		if (!((1 << heap->type) & client->heap_mask))
 			continue;
@@ -425,7 +538,6 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 			}
 		}
 	}
-	mutex_unlock(&dev->lock);
 
 	if (IS_ERR_OR_NULL(buffer)) {
 		pr_debug("ION is unable to allocate 0x%x bytes (alignment: "
@@ -874,6 +986,255 @@ end:
 }
 EXPORT_SYMBOL(ion_import);
 
+static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
+					enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+	struct scatterlist *sg;
+	struct sg_table *table;
+
+	if (!buffer->heap->ops->map_dma)
+		return ERR_PTR(-ENODEV);
+
+	table = kzalloc(sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_lock(&buffer->lock);
+	if (!buffer->dmap_cnt) {
+		sg = buffer->heap->ops->map_dma(buffer->heap, buffer);
+		if (IS_ERR_OR_NULL(sg)) {
+			mutex_unlock(&buffer->lock);
+			kfree(table);
+			return sg ? ERR_CAST(sg) : ERR_PTR(-ENOMEM);
+		}
+		buffer->sglist = sg;
+	}
+	buffer->dmap_cnt++;
+	mutex_unlock(&buffer->lock);
+
+	/*
+	 * The table shares the heap's scatterlist rather than copying it;
+	 * it stays valid until the last dma mapping of the buffer is gone.
+	 */
+	table->sgl = buffer->sglist;
+	for (sg = table->sgl; sg; sg = sg_next(sg))
+		table->nents++;
+	table->orig_nents = table->nents;
+	return table;
+}
+
+static void ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
+			      struct sg_table *table,
+			      enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+
+	mutex_lock(&buffer->lock);
+	BUG_ON(buffer->dmap_cnt == 0);
+	if (--buffer->dmap_cnt == 0) {
+		buffer->heap->ops->unmap_dma(buffer->heap, buffer);
+		buffer->sglist = NULL;
+	}
+	mutex_unlock(&buffer->lock);
+	kfree(table);
+}
+
+/* this function should only be called while buffer->lock is held */
+static void *ion_buffer_kmap_get(struct ion_buffer *buffer)
+{
+	void *vaddr;
+
+	if (buffer->kmap_cnt) {
+		buffer->kmap_cnt++;
+		return buffer->vaddr;
+	}
+	if (!buffer->heap->ops->map_kernel)
+		return ERR_PTR(-ENODEV);
+	vaddr = buffer->heap->ops->map_kernel(buffer->heap, buffer,
+					      buffer->flags);
+	if (IS_ERR_OR_NULL(vaddr))
+		return vaddr ? vaddr : ERR_PTR(-ENOMEM);
+	buffer->vaddr = vaddr;
+	buffer->kmap_cnt++;
+	return vaddr;
+}
+
+/* this function should only be called while buffer->lock is held */
+static void ion_buffer_kmap_put(struct ion_buffer *buffer)
+{
+	BUG_ON(buffer->kmap_cnt == 0);
+	if (--buffer->kmap_cnt == 0) {
+		buffer->heap->ops->unmap_kernel(buffer->heap, buffer);
+		buffer->vaddr = NULL;
+	}
+}
+
+static int ion_dma_buf_begin_cpu_access(struct dma_buf *dmabuf, size_t start,
+					size_t len,
+					enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+	void *vaddr;
+
+	mutex_lock(&buffer->lock);
+	vaddr = ion_buffer_kmap_get(buffer);
+	mutex_unlock(&buffer->lock);
+	return IS_ERR(vaddr) ? PTR_ERR(vaddr) : 0;
+}
+
+static void ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf, size_t start,
+				       size_t len,
+				       enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	mutex_lock(&buffer->lock);
+	ion_buffer_kmap_put(buffer);
+	mutex_unlock(&buffer->lock);
+}
+
+/* only valid between begin_cpu_access and end_cpu_access */
+static void *ion_dma_buf_kmap(struct dma_buf *dmabuf, unsigned long offset)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	WARN_ON(!buffer->vaddr);
+	return buffer->vaddr + offset * PAGE_SIZE;
+}
+
+static void *ion_dma_buf_vmap(struct dma_buf *dmabuf)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+	void *vaddr;
+
+	mutex_lock(&buffer->lock);
+	vaddr = ion_buffer_kmap_get(buffer);
+	mutex_unlock(&buffer->lock);
+	return IS_ERR(vaddr) ? NULL : vaddr;
+}
+
+static void ion_dma_buf_vunmap(struct dma_buf *dmabuf, void *vaddr)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	mutex_lock(&buffer->lock);
+	ion_buffer_kmap_put(buffer);
+	mutex_unlock(&buffer->lock);
+}
+
+static void ion_dma_buf_vma_close(struct vm_area_struct *vma)
+{
+	struct ion_buffer *buffer = vma->vm_private_data;
+
+	buffer->heap->ops->unmap_user(buffer->heap, buffer);
+}
+
+static struct vm_operations_struct ion_dma_buf_vm_ops = {
+	.close = ion_dma_buf_vma_close,
+};
+
+static int ion_dma_buf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+	int ret;
+
+	if (!buffer->heap->ops->map_user) {
+		pr_err("%s: this heap does not define a method for mapping "
+		       "to userspace\n", __func__);
+		return -EINVAL;
+	}
+
+	mutex_lock(&buffer->lock);
+	ret = buffer->heap->ops->map_user(buffer->heap, buffer, vma,
+					  buffer->flags);
+	mutex_unlock(&buffer->lock);
+	if (ret) {
+		pr_err("%s: failure mapping buffer to userspace\n", __func__);
+		return ret;
+	}
+
+	if (buffer->heap->ops->unmap_user) {
+		vma->vm_private_data = buffer;
+		vma->vm_ops = &ion_dma_buf_vm_ops;
+	}
+	return 0;
+}
+
+static void ion_dma_buf_release(struct dma_buf *dmabuf)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	ion_buffer_put(buffer);
+}
+
+static const struct dma_buf_ops ion_dma_buf_ops = {
+	.map_dma_buf = ion_map_dma_buf,
+	.unmap_dma_buf = ion_unmap_dma_buf,
+	.mmap = ion_dma_buf_mmap,
+	.release = ion_dma_buf_release,
+	.begin_cpu_access = ion_dma_buf_begin_cpu_access,
+	.end_cpu_access = ion_dma_buf_end_cpu_access,
+	.kmap_atomic = ion_dma_buf_kmap,
+	.kmap = ion_dma_buf_kmap,
+	.vmap = ion_dma_buf_vmap,
+	.vunmap = ion_dma_buf_vunmap,
+};
+
+int ion_share_dma_buf(struct ion_client *client, struct ion_handle *handle)
+{
+	struct ion_buffer *buffer;
+	struct dma_buf *dmabuf;
+	bool valid_handle;
+	int fd;
+
+	mutex_lock(&client->lock);
+	valid_handle = ion_handle_validate(client, handle);
+	if (!valid_handle) {
+		mutex_unlock(&client->lock);
+		pr_err("%s: invalid handle passed to share.\n", __func__);
+		return -EINVAL;
+	}
+	buffer = handle->buffer;
+	/* the dma-buf keeps the buffer alive after the handle is freed */
+	ion_buffer_get(buffer);
+	mutex_unlock(&client->lock);
+
+	dmabuf = dma_buf_export(buffer, &ion_dma_buf_ops, buffer->size,
+				O_RDWR);
+	if (IS_ERR(dmabuf)) {
+		ion_buffer_put(buffer);
+		return PTR_ERR(dmabuf);
+	}
+	fd = dma_buf_fd(dmabuf, O_CLOEXEC);
+	if (fd < 0)
+		dma_buf_put(dmabuf);
+
+	return fd;
+}
+EXPORT_SYMBOL(ion_share_dma_buf);
+
+struct ion_handle *ion_import_dma_buf(struct ion_client *client, int fd)
+{
+	struct dma_buf *dmabuf;
+	struct ion_handle *handle;
+
+	dmabuf = dma_buf_get(fd);
+	if (IS_ERR(dmabuf))
+		return ERR_CAST(dmabuf);
+
+	if (dmabuf->ops != &ion_dma_buf_ops) {
+		pr_err("%s: can not import dmabuf from another exporter\n",
+		       __func__);
+		dma_buf_put(dmabuf);
+		return ERR_PTR(-EINVAL);
+	}
+	handle = ion_import(client, dmabuf->priv);
+	dma_buf_put(dmabuf);
+	return handle;
+}
+EXPORT_SYMBOL(ion_import_dma_buf);
+
 int ion_do_cache_op(struct ion_client *client, struct ion_handle *handle,
 			void *uaddr, unsigned long offset, unsigned long len,
 			unsigned int cmd)
@@ -926,13 +1287,11 @@ struct ion_handle *ion_import_fd(struct ion_client *client, int fd)
 		return ERR_PTR(-EINVAL);
 	}
 	if (file->f_op != &ion_share_fops) {
-		pr_err("%s: imported file %s is not a shared ion"
-			" file.", __func__, file->f_dentry->d_name.name);
-		handle = ERR_PTR(-EINVAL);
-		goto end;
+		fput(file);
+		/* not an ion share fd, maybe it is a dma-buf ion exported */
+		return ion_import_dma_buf(client, fd);
 	}
 	handle = ion_import(client, file->private_data);
-end:
 	fput(file);
 	return handle;
 }
@@ -1435,6 +1794,19 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			return -EFAULT;
 		break;
 	}
+	case ION_IOC_SHARE_DMA_BUF:
+	{
+		struct ion_fd_data data;
+
+		if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+			return -EFAULT;
+		data.fd = ion_share_dma_buf(client, data.handle);
+		if (data.fd < 0)
+			return data.fd;
+		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
+			return -EFAULT;
+		break;
+	}
 	case ION_IOC_IMPORT:
 	{
 		struct ion_fd_data data;
@@ -1524,6 +1896,24 @@ static size_t ion_debug_heap_total(struct ion_client *client,
 	return size;
 }
 
+static void ion_debug_heap_latency(struct seq_file *s, struct ion_heap *heap)
+{
+	char label[16];
+	int i;
+
+	seq_printf(s, "\n%16s %16s\n", "alloc latency", "count");
+	for (i = 0; i < ION_HEAP_LATENCY_BUCKETS; i++) {
+		if (i == ION_HEAP_LATENCY_BUCKETS - 1)
+			snprintf(label, sizeof(label), ">= %luus", 1UL << (i - 1));
+		else
+			snprintf(label, sizeof(label), "< %luus", 1UL << i);
+		seq_printf(s, "%16s %16lu\n", label, heap->alloc_latency[i]);
+	}
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		seq_printf(s, "deferred free pending: %zx\n",
+			   ion_heap_freelist_size(heap));
+}
+
 static int ion_debug_heap_show(struct seq_file *s, void *unused)
 {
 	struct ion_heap *heap = s->private;
@@ -1555,6 +1945,7 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 	}
 	if (heap->ops->print_debug)
 		heap->ops->print_debug(heap, s);
+	ion_debug_heap_latency(s, heap);
 	return 0;
 }
 
@@ -1572,84 +1963,92 @@ static const struct file_operations debug_heap_fops = {
 
 void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 {
-	struct rb_node **p = &dev->heaps.rb_node;
-	struct rb_node *parent = NULL;
 	struct ion_heap *entry;
 
 	heap->dev = dev;
-	mutex_lock(&dev->lock);
-	while (*p) {
-		parent = *p;
-		entry = rb_entry(parent, struct ion_heap, node);
-
-		if (heap->id < entry->id) {
-			p = &(*p)->rb_left;
-		} else if (heap->id > entry->id ) {
-			p = &(*p)->rb_right;
-		} else {
+	mutex_init(&heap->lock);
+	INIT_LIST_HEAD(&heap->free_list);
+	heap->free_list_size = 0;
+	spin_lock_init(&heap->free_lock);
+	init_waitqueue_head(&heap->waitqueue);
+
+	mutex_lock(&dev->heap_lock);
+	list_for_each_entry(entry, &dev->heaps, list) {
+		if (heap->id == entry->id) {
 			pr_err("%s: can not insert multiple heaps with "
 				"id %d\n", __func__, heap->id);
 			goto end;
 		}
+		if (heap->id < entry->id)
+			break;
+	}
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE) {
+		heap->task = kthread_run(ion_heap_deferred_free, heap,
+					 "ion_%s", heap->name);
+		if (IS_ERR(heap->task)) {
+			pr_err("%s: could not start free thread for heap %s, "
+				"freeing synchronously\n", __func__, heap->name);
+			heap->task = NULL;
+			heap->flags &= ~ION_HEAP_FLAG_DEFER_FREE;
+		}
 	}
 
-	rb_link_node(&heap->node, parent, p);
-	rb_insert_color(&heap->node, &dev->heaps);
+	/* insert before the first heap with a higher id, or at the end */
+	list_add_tail_rcu(&heap->list, &entry->list);
 	debugfs_create_file(heap->name, 0664, dev->debug_root, heap,
 			    &debug_heap_fops);
 end:
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->heap_lock);
 }
 
 int ion_secure_heap(struct ion_device *dev, int heap_id)
 {
-	struct rb_node *n;
+	struct ion_heap *heap;
 	int ret_val = 0;
 
 	/*
 	 * traverse the list of heaps available in this system
 	 * and find the heap that is specified.
 	 */
-	mutex_lock(&dev->lock);
-	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
-		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
+	list_for_each_entry_rcu(heap, &dev->heaps, list) {
 		if (heap->type != ION_HEAP_TYPE_CP)
 			continue;
 		if (ION_HEAP(heap->id) != heap_id)
 			continue;
+		mutex_lock(&heap->lock);
 		if (heap->ops->secure_heap)
 			ret_val = heap->ops->secure_heap(heap);
 		else
 			ret_val = -EINVAL;
+		mutex_unlock(&heap->lock);
 		break;
 	}
-	mutex_unlock(&dev->lock);
 	return ret_val;
 }
 
 int ion_unsecure_heap(struct ion_device *dev, int heap_id)
 {
-	struct rb_node *n;
+	struct ion_heap *heap;
 	int ret_val = 0;
 
 	/*
 	 * traverse the list of heaps available in this system
 	 * and find the heap that is specified.
 	 */
-	mutex_lock(&dev->lock);
-	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
-		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
+	list_for_each_entry_rcu(heap, &dev->heaps, list) {
 		if (heap->type != ION_HEAP_TYPE_CP)
 			continue;
 		if (ION_HEAP(heap->id) != heap_id)
 			continue;
+		mutex_lock(&heap->lock);
 		if (heap->ops->secure_heap)
 			ret_val = heap->ops->unsecure_heap(heap);
 		else
 			ret_val = -EINVAL;
+		mutex_unlock(&heap->lock);
 		break;
 	}
-	mutex_unlock(&dev->lock);
 	return ret_val;
 }
 
@@ -1662,15 +2061,20 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 	/* mark all buffers as 1 */
 	seq_printf(s, "%16.s %16.s %16.s %16.s\n", "buffer", "heap", "size",
 		"ref cnt");
-	mutex_lock(&dev->lock);
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buf = rb_entry(n, struct ion_buffer,
 						     node);
 
 		buf->marked = 1;
 	}
+	mutex_unlock(&dev->buffer_lock);
 
-	/* now see which buffers we can access */
+	/*
+	 * now see which buffers we can access.  The buffer lock is not held
+	 * here as buffers are destroyed with client locks held.
+	 */
+	mutex_lock(&dev->lock);
 	for (n = rb_first(&dev->kernel_clients); n; n = rb_next(n)) {
 		struct ion_client *client = rb_entry(n, struct ion_client,
 						     node);
@@ -1702,7 +2106,10 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 		mutex_unlock(&client->lock);
 
 	}
+	mutex_unlock(&dev->lock);
+
 	/* And anyone still marked as a 1 means a leaked handle somewhere */
+	mutex_lock(&dev->buffer_lock);
 	for (n = rb_first(&dev->buffers); n; n = rb_next(n)) {
 		struct ion_buffer *buf = rb_entry(n, struct ion_buffer,
 						     node);
@@ -1712,7 +2119,7 @@ static int ion_debug_leak_show(struct seq_file *s, void *unused)
 				(int)buf, buf->heap->name, buf->size,
 				atomic_read(&buf->ref.refcount));
 	}
-	mutex_unlock(&dev->lock);
+	mutex_unlock(&dev->buffer_lock);
 	return 0;
 }
 
@@ -1758,8 +2165,10 @@ struct ion_device *ion_device_create(long (*custom_ioctl)
 
 	idev->custom_ioctl = custom_ioctl;
 	idev->buffers = RB_ROOT;
+	mutex_init(&idev->buffer_lock);
 	mutex_init(&idev->lock);
-	idev->heaps = RB_ROOT;
+	INIT_LIST_HEAD(&idev->heaps);
+	mutex_init(&idev->heap_lock);
 	idev->user_clients = RB_ROOT;
 	idev->kernel_clients = RB_ROOT;
 	debugfs_create_file("check_leaked_fds", 0664, idev->debug_root, idev,
@@ -0,0 +1,241 @@
+/*
+ * drivers/gpu/ion/ion_cma_heap.c
+ *
+ * Copyright (C) 2011 Google, Inc.
+ * Copyright (c) 2011-2012, Code Aurora Forum. All rights reserved.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+#include <linux/device.h>
+#include <linux/dma-contiguous.h>
+#include <linux/err.h>
+#include <linux/ion.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "ion_priv.h"
+
+#include <asm/cacheflush.h>
+
+/*
+ * A heap backed by the Contiguous Memory Allocator.  Unlike a carveout,
+ * the memory behind it is used by the page allocator for movable pages
+ * while no buffer is allocated, and handed to ion on demand.
+ */
+struct ion_cma_heap {
+	struct ion_heap heap;
+	struct device *dev;
+	unsigned long allocated_bytes;
+	unsigned int has_outer_cache;
+};
+
+#define to_cma_heap(h)	container_of(h, struct ion_cma_heap, heap)
+
+static int ion_cma_heap_phys(struct ion_heap *heap,
+			     struct ion_buffer *buffer,
+			     ion_phys_addr_t *addr, size_t *len)
+{
+	*addr = buffer->priv_phys;
+	*len = buffer->size;
+	return 0;
+}
+
+static int ion_cma_heap_allocate(struct ion_heap *heap,
+				 struct ion_buffer *buffer,
+				 unsigned long size, unsigned long align,
+				 unsigned long flags)
+{
+	struct ion_cma_heap *cma_heap = to_cma_heap(heap);
+	int count = PAGE_ALIGN(size) >> PAGE_SHIFT;
+	struct page *page;
+	void *ptr;
+
+	page = dma_alloc_from_contiguous(cma_heap->dev, count,
+					 get_order(max(align, PAGE_SIZE)));
+	if (!page)
+		return -ENOMEM;
+
+	/*
+	 * The pages may have been handed out to other users before;
+	 * clear them and push the zeroes out of the caches.
+	 */
+	ptr = page_address(page);
+	memset(ptr, 0, count << PAGE_SHIFT);
+	dmac_flush_range(ptr, ptr + (count << PAGE_SHIFT));
+	if (cma_heap->has_outer_cache)
+		outer_flush_range(page_to_phys(page),
+				  page_to_phys(page) + (count << PAGE_SHIFT));
+
+	buffer->priv_phys = page_to_phys(page);
+	cma_heap->allocated_bytes += count << PAGE_SHIFT;
+	return 0;
+}
+
+static void ion_cma_heap_free(struct ion_buffer *buffer)
+{
+	struct ion_cma_heap *cma_heap = to_cma_heap(buffer->heap);
+	int count = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+
+	dma_release_from_contiguous(cma_heap->dev,
+				    phys_to_page(buffer->priv_phys), count);
+	cma_heap->allocated_bytes -= count << PAGE_SHIFT;
+}
+
+static struct scatterlist *ion_cma_heap_map_dma(struct ion_heap *heap,
+						struct ion_buffer *buffer)
+{
+	struct scatterlist *sglist;
+
+	sglist = vmalloc(sizeof(struct scatterlist));
+	if (!sglist)
+		return ERR_PTR(-ENOMEM);
+
+	sg_init_table(sglist, 1);
+	sg_set_page(sglist, phys_to_page(buffer->priv_phys), buffer->size, 0);
+	sglist->dma_address = buffer->priv_phys;
+
+	return sglist;
+}
+
+static void ion_cma_heap_unmap_dma(struct ion_heap *heap,
+				   struct ion_buffer *buffer)
+{
+	if (buffer->sglist)
+		vfree(buffer->sglist);
+}
+
+static void *ion_cma_heap_map_kernel(struct ion_heap *heap,
+				     struct ion_buffer *buffer,
+				     unsigned long flags)
+{
+	int count = PAGE_ALIGN(buffer->size) >> PAGE_SHIFT;
+	struct page *page = phys_to_page(buffer->priv_phys);
+	struct page **pages;
+	void *vaddr;
+	int i;
+
+	/* CMA areas live in lowmem, which is mapped cached already. */
+	if (ION_IS_CACHED(flags))
+		return page_address(page);
+
+	pages = kmalloc(count * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return NULL;
+	for (i = 0; i < count; i++)
+		pages[i] = page + i;
+
+	vaddr = vmap(pages, count, VM_MAP, pgprot_writecombine(PAGE_KERNEL));
+	kfree(pages);
+	return vaddr;
+}
+
+static void ion_cma_heap_unmap_kernel(struct ion_heap *heap,
+				      struct ion_buffer *buffer)
+{
+	if (is_vmalloc_addr(buffer->vaddr))
+		vunmap(buffer->vaddr);
+	buffer->vaddr = NULL;
+}
+
+static int ion_cma_heap_map_user(struct ion_heap *heap,
+				 struct ion_buffer *buffer,
+				 struct vm_area_struct *vma,
+				 unsigned long flags)
+{
+	if (!ION_IS_CACHED(flags))
+		vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+
+	return remap_pfn_range(vma, vma->vm_start,
+			__phys_to_pfn(buffer->priv_phys) + vma->vm_pgoff,
+			vma->vm_end - vma->vm_start,
+			vma->vm_page_prot);
+}
+
+static int ion_cma_heap_cache_ops(struct ion_heap *heap,
+				  struct ion_buffer *buffer, void *vaddr,
+				  unsigned int offset, unsigned int length,
+				  unsigned int cmd)
+{
+	void (*outer_cache_op)(phys_addr_t, phys_addr_t);
+	struct ion_cma_heap *cma_heap = to_cma_heap(heap);
+
+	switch (cmd) {
+	case ION_IOC_CLEAN_CACHES:
+		dmac_clean_range(vaddr, vaddr + length);
+		outer_cache_op = outer_clean_range;
+		break;
+	case ION_IOC_INV_CACHES:
+		dmac_inv_range(vaddr, vaddr + length);
+		outer_cache_op = outer_inv_range;
+		break;
+	case ION_IOC_CLEAN_INV_CACHES:
+		dmac_flush_range(vaddr, vaddr + length);
+		outer_cache_op = outer_flush_range;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (cma_heap->has_outer_cache) {
+		unsigned long pstart = buffer->priv_phys + offset;
+		outer_cache_op(pstart, pstart + length);
+	}
+	return 0;
+}
+
+static int ion_cma_heap_print_debug(struct ion_heap *heap, struct seq_file *s)
+{
+	struct ion_cma_heap *cma_heap = to_cma_heap(heap);
+
+	seq_printf(s, "total bytes currently allocated: %lx\n",
+		   cma_heap->allocated_bytes);
+	seq_printf(s, "backing device: %s\n",
+		   cma_heap->dev ? dev_name(cma_heap->dev) : "default area");
+
+	return 0;
+}
+
+static struct ion_heap_ops cma_heap_ops = {
+	.allocate = ion_cma_heap_allocate,
+	.free = ion_cma_heap_free,
+	.phys = ion_cma_heap_phys,
+	.map_user = ion_cma_heap_map_user,
+	.map_kernel = ion_cma_heap_map_kernel,
+	.unmap_kernel = ion_cma_heap_unmap_kernel,
+	.map_dma = ion_cma_heap_map_dma,
+	.unmap_dma = ion_cma_heap_unmap_dma,
+	.cache_op = ion_cma_heap_cache_ops,
+	.print_debug = ion_cma_heap_print_debug,
+	.map_iommu = ion_carveout_heap_map_iommu,
+	.unmap_iommu = ion_carveout_heap_unmap_iommu,
+};
+
+struct ion_heap *ion_cma_heap_create(struct ion_platform_heap *heap_data)
+{
+	struct ion_cma_heap *cma_heap;
+
+	cma_heap = kzalloc(sizeof(struct ion_cma_heap), GFP_KERNEL);
+	if (!cma_heap)
+		return ERR_PTR(-ENOMEM);
+
+	cma_heap->heap.ops = &cma_heap_ops;
+	cma_heap->heap.type = ION_HEAP_TYPE_DMA;
+	cma_heap->dev = heap_data->priv;
+	cma_heap->has_outer_cache = heap_data->has_outer_cache;
+	return &cma_heap->heap;
+}
+
+void ion_cma_heap_destroy(struct ion_heap *heap)
+{
+	kfree(to_cma_heap(heap));
+}
@@ -19,9 +19,13 @@
 #define _ION_PRIV_H
 
 #include <linux/kref.h>
+#include <linux/list.h>
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 #include <linux/ion.h>
 #include <linux/iommu.h>
 
@@ -79,6 +83,8 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * struct ion_buffer - metadata for a particular buffer
  * @ref:		refernce count
  * @node:		node in the ion_device buffers tree
+ * @list:		element in the heap's list of buffers waiting to be
+ *			freed, only used on heaps with deferred freeing
  * @dev:		back pointer to the ion_device
  * @heap:		back pointer to the heap the buffer came from
  * @flags:		buffer specific flags
@@ -96,6 +102,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
 struct ion_buffer {
 	struct kref ref;
 	struct rb_node node;
+	struct list_head list;
 	struct ion_device *dev;
 	struct ion_heap *heap;
 	unsigned long flags;
@@ -160,9 +167,12 @@ struct ion_heap_ops {
 	int (*unsecure_heap)(struct ion_heap *heap);
 };
 
+/* allocation latency buckets: < 1us, < 2us, < 4us, ... >= 16ms */
+#define ION_HEAP_LATENCY_BUCKETS	16
+
 /**
  * struct ion_heap - represents a heap in the system
- * @node:		rb node to put the heap on the device's tree of heaps
+ * @list:		element in the device's rcu list of heaps, sorted by id
  * @dev:		back pointer to the ion_device
  * @type:		type of heap
  * @ops:		ops struct as above
@@ -170,19 +180,38 @@ struct ion_heap_ops {
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @flags:		ION_HEAP_FLAG_* from the platform data
+ * @lock:		serializes the allocate, free and (un)secure ops
+ * @free_list:		buffers waiting to be freed by @task
+ * @free_list_size:	bytes on @free_list
+ * @free_lock:		protects @free_list and @free_list_size
+ * @waitqueue:		@task sleeps here until @free_list is not empty
+ * @task:		deferred free thread, if ION_HEAP_FLAG_DEFER_FREE
+ * @alloc_latency:	histogram of allocation latencies, protected by @lock
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
  * On others, some blocks might require large physically contiguous buffers
  * that are allocated from a specially reserved heap.
+ *
+ * Heaps are never removed once added to a device, which is what allows
+ * ion_alloc() to walk the heap list without a device wide lock.
  */
 struct ion_heap {
-	struct rb_node node;
+	struct list_head list;
 	struct ion_device *dev;
 	enum ion_heap_type type;
 	struct ion_heap_ops *ops;
 	int id;
 	const char *name;
+	unsigned long flags;
+	struct mutex lock;
+	struct list_head free_list;
+	size_t free_list_size;
+	spinlock_t free_lock;
+	wait_queue_head_t waitqueue;
+	struct task_struct *task;
+	unsigned long alloc_latency[ION_HEAP_LATENCY_BUCKETS];
 };
 
 
@@ -241,6 +270,11 @@ void ion_cp_heap_destroy(struct ion_heap *);
 struct ion_heap *ion_reusable_heap_create(struct ion_platform_heap *);
 void ion_reusable_heap_destroy(struct ion_heap *);
 
+#ifdef CONFIG_CMA
+struct ion_heap *ion_cma_heap_create(struct ion_platform_heap *);
+void ion_cma_heap_destroy(struct ion_heap *);
+#endif
+
 /**
  * kernel api to allocate/free from carveout -- used when carveout is
  * used to back an architecture specific custom heap
@@ -250,6 +284,19 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap, unsigned long size,
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
 
+/**
+ * iommu mapping of a single physically contiguous buffer, shared with
+ * the other contiguous heaps
+ */
+int ion_carveout_heap_map_iommu(struct ion_buffer *buffer,
+				struct ion_iommu_map *data,
+				unsigned int domain_num,
+				unsigned int partition_num,
+				unsigned long align,
+				unsigned long iova_length,
+				unsigned long flags);
+void ion_carveout_heap_unmap_iommu(struct ion_iommu_map *data);
+
 
 struct ion_heap *msm_get_contiguous_heap(void);
 /**
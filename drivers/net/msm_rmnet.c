@@ -93,6 +93,10 @@ struct rmnet_private
 #endif
 	struct sk_buff *skb;
 	spinlock_t lock;
+	/* byte queue limits accounting of the SMD tx FIFO, under lock */
+	int tx_inflight;
+	int tx_avail;
+	int tx_avail_max;
 	struct tasklet_struct tsklt;
 	u32 operation_mode;    /* IOCTL specified mode (protocol, QoS header) */
 	struct platform_driver pdrv;
@@ -332,6 +336,52 @@ static void smd_net_data_handler(unsigned long arg)
 	}
 }
 
+/*
+ * The SMD FIFO is our transmit ring.  Whatever write space appeared since
+ * the last look has been consumed by the modem; report it to byte queue
+ * limits, but never more than is in flight since the FIFO also carries
+ * SMD packet headers.  Space consumed between a write and the following
+ * smd_write_avail() is missed, so everything in flight is completed
+ * whenever the FIFO is seen empty.
+ *
+ * Called with p->lock held.
+ */
+static void _rmnet_tx_reap(struct net_device *dev)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+	int avail;
+	int done;
+
+	if (!p->ch || !p->tx_inflight)
+		return;
+
+	avail = smd_write_avail(p->ch);
+	if (avail > p->tx_avail_max)
+		p->tx_avail_max = avail;
+
+	if (avail == p->tx_avail_max)
+		done = p->tx_inflight;
+	else
+		done = clamp(avail - p->tx_avail, 0, p->tx_inflight);
+	p->tx_avail = avail;
+
+	if (done) {
+		p->tx_inflight -= done;
+		netdev_completed_queue(dev, 0, done);
+	}
+}
+
+/* Called with p->lock held */
+static void _rmnet_tx_reset(struct net_device *dev)
+{
+	struct rmnet_private *p = netdev_priv(dev);
+
+	p->tx_inflight = 0;
+	p->tx_avail = 0;
+	p->tx_avail_max = 0;
+	netdev_reset_queue(dev);
+}
+
 static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct rmnet_private *p = netdev_priv(dev);
@@ -363,6 +413,15 @@ static int _rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 		goto xmit_out;
 	}
 
+	spin_lock_irqsave(&p->lock, flags);
+	p->tx_inflight += skb->len;
+	p->tx_avail = smd_write_avail(ch);
+	netdev_sent_queue(dev, skb->len);
+	/* need the modem's read notification to restart the queue */
+	if (netif_xmit_stopped(netdev_get_tx_queue(dev, 0)))
+		smd_enable_read_intr(ch);
+	spin_unlock_irqrestore(&p->lock, flags);
+
 	if (RMNET_IS_MODE_IP(opmode) ||
 	    count_this_packet(skb->data, skb->len)) {
 		p->stats.tx_packets++;
@@ -440,6 +499,7 @@ static void smd_net_notify(void *_dev, unsigned event)
 	switch (event) {
 	case SMD_EVENT_DATA:
 		spin_lock(&p->lock);
+		_rmnet_tx_reap(_dev);
 		if (p->skb && (smd_write_avail(p->ch) >= p->skb->len)) {
 			smd_disable_read_intr(p->ch);
 			tasklet_hi_schedule(&p->tsklt);
@@ -456,6 +516,10 @@ static void smd_net_notify(void *_dev, unsigned event)
 
 	case SMD_EVENT_OPEN:
 		DBG0("%s: opening SMD port\n", __func__);
+		/* whatever was in flight went away with the old FIFO */
+		spin_lock(&p->lock);
+		_rmnet_tx_reset(_dev);
+		spin_unlock(&p->lock);
 		netif_carrier_on(_dev);
 		if (netif_queue_stopped(_dev)) {
 			DBG0("%s: re-starting if queue\n", __func__);
@@ -516,13 +580,19 @@ static int __rmnet_close(struct net_device *dev)
 
 static int rmnet_open(struct net_device *dev)
 {
+	struct rmnet_private *p = netdev_priv(dev);
+	unsigned long flags;
 	int rc = 0;
 
 	DBG0("[%s] rmnet_open()\n", dev->name);
 
 	rc = __rmnet_open(dev);
-	if (rc == 0)
+	if (rc == 0) {
+		spin_lock_irqsave(&p->lock, flags);
+		_rmnet_tx_reset(dev);
+		spin_unlock_irqrestore(&p->lock, flags);
 		netif_start_queue(dev);
+	}
 
 	return rc;
 }
@@ -573,6 +643,7 @@ static int rmnet_xmit(struct sk_buff *skb, struct net_device *dev)
 	}
 
 	spin_lock_irqsave(&p->lock, flags);
+	_rmnet_tx_reap(dev);
 	smd_enable_read_intr(ch);
 	if (smd_write_avail(ch) < skb->len) {
 		netif_stop_queue(dev);
@@ -244,7 +244,7 @@ static int count_this_packet(void *_hdr, int len)
 	return 1;
 }
 
-/* Rx Callback, Called in Work Queue context */
+/* Rx Callback, Called in NAPI (softirq) context */
 static void bam_recv_notify(void *dev, struct sk_buff *skb)
 {
 	struct rmnet_private *p = netdev_priv(dev);
@@ -278,7 +278,7 @@ static void bam_recv_notify(void *dev, struct sk_buff *skb)
 			p->stats.rx_packets, skb->len);
 
 		/* Deliver to network stack */
-		netif_rx(skb);
+		netif_receive_skb(skb);
 	} else
 		pr_err("[%s] %s: No skb received",
 			((struct net_device *)dev)->name, __func__);
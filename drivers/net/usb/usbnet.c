@@ -752,6 +752,7 @@ int usbnet_open (struct net_device *net)
 	}
 
 	set_bit(EVENT_DEV_OPEN, &dev->flags);
+	netdev_reset_queue(net);
 	netif_start_queue (net);
 	netif_info(dev, ifup, dev->net,
 		   "open: enable queueing (rx %d, tx %d) mtu %d %s framing\n",
@@ -1150,6 +1151,7 @@ netdev_tx_t usbnet_start_xmit (struct sk_buff *skb,
 	case 0:
 		net->trans_start = jiffies;
 		__skb_queue_tail (&dev->txq, skb);
+		netdev_sent_queue(net, length);
 		if (dev->txq.qlen >= TX_QLEN (dev))
 			netif_stop_queue (net);
 	}
@@ -1191,6 +1193,9 @@ static void usbnet_bh (unsigned long param)
 			rx_process (dev, skb);
 			continue;
 		case tx_done:
+			/* byte queue limits, completions serialized here */
+			netdev_completed_queue(dev->net, 1, entry->length);
+			/* FALLTHROUGH */
 		case rx_cleanup:
 			usb_free_urb (entry->urb);
 			dev_kfree_skb (skb);
@@ -1532,6 +1537,8 @@ int usbnet_resume (struct usb_interface *intf)
 			} else {
 				dev->net->trans_start = jiffies;
 				__skb_queue_tail(&dev->txq, skb);
+				netdev_sent_queue(dev->net,
+					((struct skb_data *)skb->cb)->length);
 			}
 		}
 
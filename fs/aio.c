@@ -49,12 +49,14 @@
 static DEFINE_SPINLOCK(aio_nr_lock);
 unsigned long aio_nr;		/* current system wide number of aio requests */
 unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio requests */
+unsigned long aio_max_offload = 16; /* per context blocking requests in flight */
 /*----end sysctl variables---*/
 
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_offload_wq;
 
 /* Used for rare fput completion. */
 static void aio_fput_routine(struct work_struct *);
@@ -78,6 +80,10 @@ static int __init aio_setup(void)
 	aio_wq = alloc_workqueue("aio", 0, 1);	/* used to limit concurrency */
 	BUG_ON(!aio_wq);
 
+	/* unbound, so that blocked requests don't hold up one another */
+	aio_offload_wq = alloc_workqueue("aio_offload", WQ_UNBOUND, 0);
+	BUG_ON(!aio_offload_wq);
+
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
 	return 0;
@@ -275,6 +281,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
+	INIT_LIST_HEAD(&ctx->offload_list);
 
 	if (aio_setup_ring(ctx) < 0)
 		goto out_freectx;
@@ -845,6 +852,95 @@ static void aio_kick_handler(struct work_struct *work)
 }
 
 
+/*
+ * aio_should_offload:
+ *	Buffered reads and writes of files and block devices, and fsync
+ *	on files without an aio_fsync method, would block the submitter
+ *	for as long as they take.  Those are run by the offload workers.
+ */
+static int aio_should_offload(struct kiocb *iocb)
+{
+	struct file *file = iocb->ki_filp;
+	struct inode *inode = file->f_mapping->host;
+
+	if (!aio_max_offload)
+		return 0;
+
+	switch (iocb->ki_opcode) {
+	case IOCB_CMD_PREAD:
+	case IOCB_CMD_PWRITE:
+	case IOCB_CMD_PREADV:
+	case IOCB_CMD_PWRITEV:
+		if (file->f_flags & O_DIRECT)
+			return 0;
+		return S_ISREG(inode->i_mode) || S_ISBLK(inode->i_mode);
+	case IOCB_CMD_FDSYNC:
+	case IOCB_CMD_FSYNC:
+		return !file->f_op->aio_fsync;
+	}
+	return 0;
+}
+
+/*
+ * aio_offload_handler:
+ *	Runs an offloaded iocb in the aio issuer's mm context, then
+ *	whatever else the context has waiting for a worker.  Each running
+ *	handler holds a reference to the context.
+ */
+static void aio_offload_handler(struct work_struct *work)
+{
+	struct kiocb *iocb = container_of(work, struct kiocb, ki_work);
+	struct kioctx *ctx = iocb->ki_ctx;
+	struct mm_struct *mm = ctx->mm;
+	mm_segment_t oldfs = get_fs();
+
+	set_fs(USER_DS);
+	use_mm(mm);
+	spin_lock_irq(&ctx->ctx_lock);
+	for (;;) {
+		aio_run_iocb(iocb);
+		__aio_put_req(ctx, iocb);	/* drop the offload ref */
+
+		if (list_empty(&ctx->offload_list))
+			break;
+		iocb = list_first_entry(&ctx->offload_list, struct kiocb,
+					ki_offload_list);
+		list_del(&iocb->ki_offload_list);
+
+		spin_unlock_irq(&ctx->ctx_lock);
+		cond_resched();
+		spin_lock_irq(&ctx->ctx_lock);
+	}
+	ctx->offload_active--;
+	spin_unlock_irq(&ctx->ctx_lock);
+	unuse_mm(mm);
+	set_fs(oldfs);
+
+	put_ioctx(ctx);
+}
+
+/*
+ * aio_offload_iocb:
+ *	Hands an iocb that would block to the offload workers, starting a
+ *	new one unless the context already has aio_max_offload running.
+ *	Called with ctx_lock held in place of aio_run_iocb().
+ */
+static void aio_offload_iocb(struct kioctx *ctx, struct kiocb *iocb)
+{
+	assert_spin_locked(&ctx->ctx_lock);
+
+	iocb->ki_users++;		/* grab the offload ref */
+	if (ctx->offload_active >= aio_max_offload) {
+		list_add_tail(&iocb->ki_offload_list, &ctx->offload_list);
+		return;
+	}
+
+	ctx->offload_active++;
+	atomic_inc(&ctx->users);
+	INIT_WORK(&iocb->ki_work, aio_offload_handler);
+	queue_work(aio_offload_wq, &iocb->ki_work);
+}
+
 /*
  * Called by kick_iocb to queue the kiocb for retry
  * and if required activate the aio work queue to process
@@ -1363,6 +1459,8 @@ static ssize_t aio_fdsync(struct kiocb *iocb)
 
 	if (file->f_op->aio_fsync)
 		ret = file->f_op->aio_fsync(iocb, 1);
+	else if (file->f_op->fsync)
+		ret = vfs_fsync(file, 1);
 	return ret;
 }
 
@@ -1373,6 +1471,8 @@ static ssize_t aio_fsync(struct kiocb *iocb)
 
 	if (file->f_op->aio_fsync)
 		ret = file->f_op->aio_fsync(iocb, 0);
+	else if (file->f_op->fsync)
+		ret = vfs_fsync(file, 0);
 	return ret;
 }
 
@@ -1493,12 +1593,12 @@ static ssize_t aio_setup_iocb(struct kiocb *kiocb, bool compat)
 		break;
 	case IOCB_CMD_FDSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fdsync;
 		break;
 	case IOCB_CMD_FSYNC:
 		ret = -EINVAL;
-		if (file->f_op->aio_fsync)
+		if (file->f_op->aio_fsync || file->f_op->fsync)
 			kiocb->ki_retry = aio_fsync;
 		break;
 	default:
@@ -1597,7 +1697,10 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		ret = -EINVAL;
 		goto out_put_req;
 	}
-	aio_run_iocb(req);
+	if (aio_should_offload(req))
+		aio_offload_iocb(ctx, req);
+	else
+		aio_run_iocb(req);
 	if (!list_empty(&ctx->run_list)) {
 		/* drain the run list */
 		while (__aio_run_iocbs(ctx))
@@ -917,6 +917,9 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DISCARD		0x40000000 /* Issue DISCARD requests */
 #define EXT4_MOUNT_INIT_INODE_TABLE	0x80000000 /* Initialize uninitialized itables */
 
+#define EXT4_MOUNT2_ASYNC_DISCARD	0x00000001 /* Batch DISCARDs in a
+						      background thread */
+
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
 						~EXT4_MOUNT_##opt
 #define set_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt |= \
@@ -1192,6 +1195,24 @@ struct ext4_sb_info {
 	atomic_t s_mb_discarded;
 	atomic_t s_lock_busy;
 
+	/* background discard (discard=async) */
+	struct task_struct *s_discard_task;
+	wait_queue_head_t s_discard_wait;
+	atomic_t s_discard_pending;	/* blocks waiting for discard */
+	unsigned long s_discard_last_ios;
+	unsigned int s_discard_interval;	/* ms between passes */
+	unsigned int s_discard_max_pending;	/* blocks, then ignore idle */
+	atomic_t s_discard_queued;	/* extents handed to the thread */
+	atomic_t s_discard_merged;	/* extents coalesced on queueing */
+	atomic_t s_discard_issued;	/* discard requests sent */
+	atomic_t s_discard_blocks;	/* blocks discarded */
+	atomic_t s_discard_skipped;	/* blocks reused before discard */
+
+	/* time spent releasing blocks at transaction commit */
+	atomic_t s_commit_cb_count;
+	atomic_t s_commit_cb_max_us;
+	atomic64_t s_commit_cb_total_us;
+
 	/* locality groups */
 	struct ext4_locality_group __percpu *s_locality_groups;
 
@@ -1789,6 +1810,8 @@ extern int ext4_mb_reserve_blocks(struct super_block *, int);
 extern void ext4_discard_preallocations(struct inode *);
 extern int __init ext4_init_mballoc(void);
 extern void ext4_exit_mballoc(void);
+extern int ext4_mb_start_discard_thread(struct super_block *);
+extern void ext4_mb_stop_discard_thread(struct super_block *);
 extern void ext4_free_blocks(handle_t *handle, struct inode *inode,
 			     struct buffer_head *bh, ext4_fsblk_t block,
 			     unsigned long count, int flags);
@@ -2053,6 +2076,7 @@ static inline void ext4_update_i_disksize(struct inode *inode, loff_t newsize)
 struct ext4_group_info {
 	unsigned long   bb_state;
 	struct rb_root  bb_free_root;
+	struct rb_root  bb_discard_root;	/* extents waiting for discard */
 	ext4_grpblk_t	bb_first_free;	/* first free block */
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
@@ -24,6 +24,10 @@
 #include "mballoc.h"
 #include <linux/debugfs.h>
 #include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/ioprio.h>
+#include <linux/genhd.h>
 #include <trace/events/ext4.h>
 
 /*
@@ -2259,6 +2263,7 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
+	meta_group_info[i]->bb_discard_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
 
 #ifdef DOUBLE_CHECK
@@ -2472,6 +2477,9 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_group_prealloc = MB_DEFAULT_GROUP_PREALLOC;
+	sbi->s_discard_interval = MB_DEFAULT_DISCARD_INTERVAL;
+	sbi->s_discard_max_pending = MB_DEFAULT_DISCARD_MAX_PENDING;
+	init_waitqueue_head(&sbi->s_discard_wait);
 
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
@@ -2493,6 +2501,9 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 
 	if (sbi->s_journal)
 		sbi->s_journal->j_commit_callback = release_blocks_on_commit;
+
+	if (test_opt2(sb, ASYNC_DISCARD))
+		ext4_mb_start_discard_thread(sb);
 out:
 	if (ret) {
 		kfree(sbi->s_mb_offsets);
@@ -2519,6 +2530,19 @@ static void ext4_mb_cleanup_pa(struct ext4_group_info *grp)
 
 }
 
+/* need to called with the ext4 group lock held */
+static void ext4_mb_cleanup_discard(struct ext4_group_info *grp)
+{
+	struct ext4_free_data *entry;
+	struct rb_node *n;
+
+	while ((n = rb_first(&grp->bb_discard_root)) != NULL) {
+		entry = rb_entry(n, struct ext4_free_data, node);
+		rb_erase(n, &grp->bb_discard_root);
+		kmem_cache_free(ext4_free_ext_cachep, entry);
+	}
+}
+
 int ext4_mb_release(struct super_block *sb)
 {
 	ext4_group_t ngroups = ext4_get_groups_count(sb);
@@ -2528,6 +2552,9 @@ int ext4_mb_release(struct super_block *sb)
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct kmem_cache *cachep = get_groupinfo_cache(sb->s_blocksize_bits);
 
+	/* flushes whatever is still queued for discard */
+	ext4_mb_stop_discard_thread(sb);
+
 	if (sbi->s_group_info) {
 		for (i = 0; i < ngroups; i++) {
 			grinfo = ext4_get_group_info(sb, i);
@@ -2536,6 +2563,7 @@ int ext4_mb_release(struct super_block *sb)
 #endif
 			ext4_lock_group(sb, i);
 			ext4_mb_cleanup_pa(grinfo);
+			ext4_mb_cleanup_discard(grinfo);
 			ext4_unlock_group(sb, i);
 			kmem_cache_free(cachep, grinfo);
 		}
@@ -2592,6 +2620,66 @@ static inline int ext4_issue_discard(struct super_block *sb,
 	return sb_issue_discard(sb, discard_block, count, GFP_NOFS, 0);
 }
 
+/*
+ * Hand a freed extent over to the background discard thread instead of
+ * discarding it inline.  The extent is merged with any queued extent of
+ * the group it overlaps or touches, so the thread sends as few and as
+ * large requests as possible.  Must be called with the group lock held.
+ */
+static void ext4_mb_queue_discard(struct super_block *sb,
+				  struct ext4_group_info *db,
+				  struct ext4_free_data *new_entry)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct rb_node **n = &db->bb_discard_root.rb_node, *node;
+	struct rb_node *parent = NULL;
+	struct ext4_free_data *entry;
+	ext4_grpblk_t end;
+
+	while (*n) {
+		parent = *n;
+		entry = rb_entry(parent, struct ext4_free_data, node);
+		if (new_entry->start_blk < entry->start_blk)
+			n = &(*n)->rb_left;
+		else
+			n = &(*n)->rb_right;
+	}
+	rb_link_node(&new_entry->node, parent, n);
+	rb_insert_color(&new_entry->node, &db->bb_discard_root);
+	atomic_inc(&sbi->s_discard_queued);
+
+	while ((node = rb_prev(&new_entry->node)) != NULL) {
+		entry = rb_entry(node, struct ext4_free_data, node);
+		end = entry->start_blk + entry->count;
+		if (end < new_entry->start_blk)
+			break;
+		end = max(end, new_entry->start_blk + new_entry->count);
+		new_entry->count = end - entry->start_blk;
+		new_entry->start_blk = entry->start_blk;
+		rb_erase(node, &db->bb_discard_root);
+		atomic_sub(entry->count, &sbi->s_discard_pending);
+		kmem_cache_free(ext4_free_ext_cachep, entry);
+		atomic_inc(&sbi->s_discard_merged);
+	}
+
+	while ((node = rb_next(&new_entry->node)) != NULL) {
+		entry = rb_entry(node, struct ext4_free_data, node);
+		end = new_entry->start_blk + new_entry->count;
+		if (entry->start_blk > end)
+			break;
+		end = max(end, entry->start_blk + entry->count);
+		new_entry->count = end - new_entry->start_blk;
+		rb_erase(node, &db->bb_discard_root);
+		atomic_sub(entry->count, &sbi->s_discard_pending);
+		kmem_cache_free(ext4_free_ext_cachep, entry);
+		atomic_inc(&sbi->s_discard_merged);
+	}
+
+	if (atomic_add_return(new_entry->count, &sbi->s_discard_pending) >
+	    sbi->s_discard_max_pending)
+		wake_up(&sbi->s_discard_wait);
+}
+
 /*
  * This function is called by the jbd2 layer once the commit has finished,
  * so we know we can free the blocks that were released with that commit.
@@ -2599,11 +2687,18 @@ static inline int ext4_issue_discard(struct super_block *sb,
 static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 {
 	struct super_block *sb = journal->j_private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct ext4_buddy e4b;
 	struct ext4_group_info *db;
 	int err, count = 0, count2 = 0;
+	int async_discard;
 	struct ext4_free_data *entry;
 	struct list_head *l, *ltmp;
+	ktime_t start = ktime_get();
+	unsigned int us, max;
+
+	async_discard = test_opt(sb, DISCARD) &&
+			test_opt2(sb, ASYNC_DISCARD) && sbi->s_discard_task;
 
 	list_for_each_safe(l, ltmp, &txn->t_private_list) {
 		entry = list_entry(l, struct ext4_free_data, list);
@@ -2611,7 +2706,7 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 		mb_debug(1, "gonna free %u blocks in group %u (0x%p):",
 			 entry->count, entry->group, entry);
 
-		if (test_opt(sb, DISCARD))
+		if (test_opt(sb, DISCARD) && !async_discard)
 			ext4_issue_discard(sb, entry->group,
 					   entry->start_blk, entry->count);
 
@@ -2635,11 +2730,27 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 			page_cache_release(e4b.bd_buddy_page);
 			page_cache_release(e4b.bd_bitmap_page);
 		}
+		if (async_discard)
+			ext4_mb_queue_discard(sb, db, entry);
+		else
+			kmem_cache_free(ext4_free_ext_cachep, entry);
 		ext4_unlock_group(sb, entry->group);
-		kmem_cache_free(ext4_free_ext_cachep, entry);
 		ext4_mb_unload_buddy(&e4b);
 	}
 
+	us = ktime_to_us(ktime_sub(ktime_get(), start));
+	atomic_inc(&sbi->s_commit_cb_count);
+	atomic64_add(us, &sbi->s_commit_cb_total_us);
+	max = atomic_read(&sbi->s_commit_cb_max_us);
+	while (us > max) {
+		unsigned int old;
+
+		old = atomic_cmpxchg(&sbi->s_commit_cb_max_us, max, us);
+		if (old == max)
+			break;
+		max = old;
+	}
+
 	mb_debug(1, "freed %u blocks in %u structures\n", count, count2);
 }
 
@@ -4799,6 +4910,182 @@ static void ext4_trim_extent(struct super_block *sb, int start, int count,
 	mb_free_blocks(NULL, e4b, start, ex.fe_len);
 }
 
+/*
+ * The device counts as idle for background discard when it has no
+ * request in flight and has not completed any since the last check.
+ */
+static int ext4_mb_discard_idle(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct hd_struct *part = &sb->s_bdev->bd_disk->part0;
+	unsigned long ios;
+	int idle;
+
+	ios = part_stat_read(part, ios[READ]) + part_stat_read(part, ios[WRITE]);
+	idle = !part_in_flight(part) && ios == sbi->s_discard_last_ios;
+	sbi->s_discard_last_ios = ios;
+	return idle;
+}
+
+/*
+ * Discard the extents queued for one group. Blocks which were allocated
+ * again since they were queued are skipped; the rest is marked used in
+ * the buddy while the discard is in flight, like FITRIM does.  Unless
+ * @force is set we back off as soon as somebody else has I/O in flight.
+ * Returns 1 if we backed off, 0 otherwise.
+ */
+static int ext4_mb_discard_group(struct super_block *sb, ext4_group_t group,
+				 int force)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp = ext4_get_group_info(sb, group);
+	struct hd_struct *part = &sb->s_bdev->bd_disk->part0;
+	struct ext4_free_data *entry;
+	struct ext4_buddy e4b;
+	struct rb_node *n;
+	ext4_grpblk_t start, next, end, done;
+	int busy = 0;
+
+	if (RB_EMPTY_ROOT(&grp->bb_discard_root))
+		return 0;
+
+	if (ext4_mb_load_buddy(sb, group, &e4b)) {
+		ext4_error(sb, "Error in loading buddy "
+				"information for %u", group);
+		return 0;
+	}
+
+	ext4_lock_group(sb, group);
+	while ((n = rb_first(&grp->bb_discard_root)) != NULL) {
+		entry = rb_entry(n, struct ext4_free_data, node);
+		rb_erase(n, &grp->bb_discard_root);
+		atomic_sub(entry->count, &sbi->s_discard_pending);
+
+		start = entry->start_blk;
+		end = start + entry->count;
+		done = 0;
+		while (start < end) {
+			start = mb_find_next_zero_bit(e4b.bd_bitmap, end, start);
+			if (start >= end)
+				break;
+			next = mb_find_next_bit(e4b.bd_bitmap, end, start);
+			ext4_trim_extent(sb, start, next - start, group, &e4b);
+			atomic_inc(&sbi->s_discard_issued);
+			done += next - start;
+			start = next;
+		}
+		atomic_add(done, &sbi->s_discard_blocks);
+		atomic_add(entry->count - done, &sbi->s_discard_skipped);
+		kmem_cache_free(ext4_free_ext_cachep, entry);
+
+		if (!force && part_in_flight(part)) {
+			busy = 1;
+			break;
+		}
+		if (need_resched()) {
+			ext4_unlock_group(sb, group);
+			cond_resched();
+			ext4_lock_group(sb, group);
+		}
+	}
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(&e4b);
+
+	return busy;
+}
+
+static void ext4_mb_discard_pending(struct super_block *sb, int force)
+{
+	ext4_group_t group, ngroups = ext4_get_groups_count(sb);
+
+	for (group = 0; group < ngroups; group++) {
+		if (!atomic_read(&EXT4_SB(sb)->s_discard_pending))
+			break;
+		if (ext4_mb_discard_group(sb, group, force))
+			break;
+	}
+	/* our own discards must not make the device look busy */
+	ext4_mb_discard_idle(sb);
+}
+
+/*
+ * Background discard thread for discard=async.  It wakes up every
+ * s_discard_interval ms and, if the device has been idle since the last
+ * wake up, issues the discards queued by release_blocks_on_commit().
+ * When more than s_discard_max_pending blocks are queued it stops waiting
+ * for the device to go idle.  Whatever is still queued when the thread is
+ * stopped at unmount is discarded before it exits.
+ */
+static int ext4_discard_thread(void *arg)
+{
+	struct super_block *sb = arg;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int force;
+
+	set_user_nice(current, 19);
+	set_task_ioprio(current, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable_timeout(sbi->s_discard_wait,
+			kthread_should_stop() ||
+			atomic_read(&sbi->s_discard_pending) >
+					sbi->s_discard_max_pending,
+			msecs_to_jiffies(sbi->s_discard_interval));
+
+		if (kthread_should_stop())
+			break;
+		if (!atomic_read(&sbi->s_discard_pending))
+			continue;
+
+		force = atomic_read(&sbi->s_discard_pending) >
+					sbi->s_discard_max_pending;
+		if (!ext4_mb_discard_idle(sb) && !force)
+			continue;
+		ext4_mb_discard_pending(sb, force);
+	}
+
+	ext4_mb_discard_pending(sb, 1);
+	return 0;
+}
+
+int ext4_mb_start_discard_thread(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct task_struct *t;
+
+	if (sbi->s_discard_task)
+		return 0;
+
+	t = kthread_run(ext4_discard_thread, sb, "ext4-discard/%s", sb->s_id);
+	if (IS_ERR(t)) {
+		ext4_msg(sb, KERN_ERR, "error %ld creating discard thread, "
+			 "discarding synchronously", PTR_ERR(t));
+		return PTR_ERR(t);
+	}
+	sbi->s_discard_task = t;
+	return 0;
+}
+
+/*
+ * Stop the background discard thread, at unmount or when remounting
+ * without discard=async.  The thread discards whatever is queued before
+ * it exits; extents queued by a commit that raced with us are discarded
+ * here.
+ */
+void ext4_mb_stop_discard_thread(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct task_struct *t = sbi->s_discard_task;
+
+	if (!t)
+		return;
+
+	sbi->s_discard_task = NULL;
+	kthread_stop(t);
+	ext4_mb_discard_pending(sb, 1);
+}
+
 /**
  * ext4_trim_all_free -- function to trim all free space in alloc. group
  * @sb:			super block for file system
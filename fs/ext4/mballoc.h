@@ -94,6 +94,15 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * with discard=async, freed extents are queued per group and the
+ * background discard thread wakes up every 1 second to look for an
+ * idle device; once more than 32768 blocks are pending they are
+ * issued even if the device is busy
+ */
+#define MB_DEFAULT_DISCARD_INTERVAL	1000	/* ms */
+#define MB_DEFAULT_DISCARD_MAX_PENDING	32768
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
@@ -1100,7 +1100,10 @@ static int ext4_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	if (test_opt(sb, NO_AUTO_DA_ALLOC))
 		seq_puts(seq, ",noauto_da_alloc");
 
-	if (test_opt(sb, DISCARD) && !(def_mount_opts & EXT4_DEFM_DISCARD))
+	if (test_opt2(sb, ASYNC_DISCARD))
+		seq_puts(seq, ",discard=async");
+	else if (test_opt(sb, DISCARD) &&
+		 !(def_mount_opts & EXT4_DEFM_DISCARD))
 		seq_puts(seq, ",discard");
 
 	if (test_opt(sb, NOLOAD))
@@ -1292,7 +1295,7 @@ enum {
 	Opt_nomblk_io_submit, Opt_block_validity, Opt_noblock_validity,
 	Opt_inode_readahead_blks, Opt_journal_ioprio,
 	Opt_dioread_nolock, Opt_dioread_lock,
-	Opt_discard, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
+	Opt_discard, Opt_discard_async, Opt_nodiscard, Opt_init_itable, Opt_noinit_itable,
 };
 
 static const match_table_t tokens = {
@@ -1364,6 +1367,7 @@ static const match_table_t tokens = {
 	{Opt_dioread_nolock, "dioread_nolock"},
 	{Opt_dioread_lock, "dioread_lock"},
 	{Opt_discard, "discard"},
+	{Opt_discard_async, "discard=async"},
 	{Opt_nodiscard, "nodiscard"},
 	{Opt_init_itable, "init_itable=%u"},
 	{Opt_init_itable, "init_itable"},
@@ -1834,9 +1838,15 @@ set_qf_format:
 			break;
 		case Opt_discard:
 			set_opt(sb, DISCARD);
+			clear_opt2(sb, ASYNC_DISCARD);
+			break;
+		case Opt_discard_async:
+			set_opt(sb, DISCARD);
+			set_opt2(sb, ASYNC_DISCARD);
 			break;
 		case Opt_nodiscard:
 			clear_opt(sb, DISCARD);
+			clear_opt2(sb, ASYNC_DISCARD);
 			break;
 		case Opt_dioread_nolock:
 			set_opt(sb, DIOREAD_NOLOCK);
@@ -2462,6 +2472,24 @@ static ssize_t extent_cache_misses_show(struct ext4_attr *a,
 	return snprintf(buf, PAGE_SIZE, "%lu\n", sbi->extent_cache_misses);
 }
 
+static ssize_t async_discard_pending_show(struct ext4_attr *a,
+					  struct ext4_sb_info *sbi, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%d\n",
+			atomic_read(&sbi->s_discard_pending));
+}
+
+static ssize_t commit_release_avg_us_show(struct ext4_attr *a,
+					  struct ext4_sb_info *sbi, char *buf)
+{
+	u64 avg = atomic64_read(&sbi->s_commit_cb_total_us);
+	unsigned int count = atomic_read(&sbi->s_commit_cb_count);
+
+	if (count)
+		do_div(avg, count);
+	return snprintf(buf, PAGE_SIZE, "%llu\n", (unsigned long long) avg);
+}
+
 static ssize_t inode_readahead_blks_store(struct ext4_attr *a,
 					  struct ext4_sb_info *sbi,
 					  const char *buf, size_t count)
@@ -2486,6 +2514,14 @@ static ssize_t sbi_ui_show(struct ext4_attr *a,
 	return snprintf(buf, PAGE_SIZE, "%u\n", *ui);
 }
 
+static ssize_t sbi_atomic_show(struct ext4_attr *a,
+			       struct ext4_sb_info *sbi, char *buf)
+{
+	atomic_t *v = (atomic_t *) (((char *) sbi) + a->offset);
+
+	return snprintf(buf, PAGE_SIZE, "%u\n", atomic_read(v));
+}
+
 static ssize_t sbi_ui_store(struct ext4_attr *a,
 			    struct ext4_sb_info *sbi,
 			    const char *buf, size_t count)
@@ -2514,6 +2550,8 @@ static struct ext4_attr ext4_attr_##name = __ATTR(name, mode, show, store)
 #define EXT4_RW_ATTR(name) EXT4_ATTR(name, 0644, name##_show, name##_store)
 #define EXT4_RW_ATTR_SBI_UI(name, elname)	\
 	EXT4_ATTR_OFFSET(name, 0644, sbi_ui_show, sbi_ui_store, elname)
+#define EXT4_RO_ATTR_SBI_ATOMIC(name, elname)	\
+	EXT4_ATTR_OFFSET(name, 0444, sbi_atomic_show, NULL, elname)
 #define ATTR_LIST(name) &ext4_attr_##name.attr
 
 EXT4_RO_ATTR(delayed_allocation_blocks);
@@ -2531,6 +2569,16 @@ EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
+EXT4_RW_ATTR_SBI_UI(async_discard_interval_ms, s_discard_interval);
+EXT4_RW_ATTR_SBI_UI(async_discard_max_pending, s_discard_max_pending);
+EXT4_RO_ATTR(async_discard_pending);
+EXT4_RO_ATTR_SBI_ATOMIC(async_discard_queued, s_discard_queued);
+EXT4_RO_ATTR_SBI_ATOMIC(async_discard_merged, s_discard_merged);
+EXT4_RO_ATTR_SBI_ATOMIC(async_discard_issued, s_discard_issued);
+EXT4_RO_ATTR_SBI_ATOMIC(async_discard_blocks, s_discard_blocks);
+EXT4_RO_ATTR_SBI_ATOMIC(async_discard_skipped, s_discard_skipped);
+EXT4_RO_ATTR(commit_release_avg_us);
+EXT4_RO_ATTR_SBI_ATOMIC(commit_release_max_us, s_commit_cb_max_us);
 
 static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(delayed_allocation_blocks),
@@ -2547,6 +2595,16 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
 	ATTR_LIST(max_writeback_mb_bump),
+	ATTR_LIST(async_discard_interval_ms),
+	ATTR_LIST(async_discard_max_pending),
+	ATTR_LIST(async_discard_pending),
+	ATTR_LIST(async_discard_queued),
+	ATTR_LIST(async_discard_merged),
+	ATTR_LIST(async_discard_issued),
+	ATTR_LIST(async_discard_blocks),
+	ATTR_LIST(async_discard_skipped),
+	ATTR_LIST(commit_release_avg_us),
+	ATTR_LIST(commit_release_max_us),
 	NULL,
 };
 
@@ -4435,6 +4493,11 @@ static int ext4_remount(struct super_block *sb, int *flags, char *data)
 		ext4_register_li_request(sb, first_not_zeroed);
 	}
 
+	if (test_opt2(sb, ASYNC_DISCARD))
+		ext4_mb_start_discard_thread(sb);
+	else
+		ext4_mb_stop_discard_thread(sb);
+
 	ext4_setup_system_zone(sb);
 	if (sbi->s_journal == NULL)
 		ext4_commit_super(sb, 1);
@@ -11,6 +11,9 @@
 #include <linux/rmap.h>
 #include <linux/swap.h>
 #include <linux/swapops.h>
+#include <linux/ktime.h>
+
+#include <trace/events/vmscan.h>
 
 #include <asm/elf.h>
 #include <asm/uaccess.h>
@@ -601,6 +604,148 @@ const struct file_operations proc_clear_refs_operations = {
 	.llseek		= noop_llseek,
 };
 
+#ifdef CONFIG_PROCESS_RECLAIM
+struct reclaim_param {
+	struct vm_area_struct *vma;
+	unsigned long nr_scanned;
+	unsigned long nr_reclaimed;
+};
+
+static int reclaim_pte_range(pmd_t *pmd, unsigned long addr,
+				unsigned long end, struct mm_walk *walk)
+{
+	struct reclaim_param *rp = walk->private;
+	struct vm_area_struct *vma = rp->vma;
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	LIST_HEAD(page_list);
+	struct page *page;
+	int isolated;
+
+	split_huge_page_pmd(walk->mm, pmd);
+	if (pmd_trans_unstable(pmd))
+		return 0;
+cont:
+	isolated = 0;
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+		if (!pte_present(ptent))
+			continue;
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page)
+			continue;
+
+		/*
+		 * Leave pages shared with other processes alone, evicting
+		 * them would hurt tasks that are still running.
+		 */
+		if (page_mapcount(page) != 1)
+			continue;
+
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, &page_list);
+		isolated++;
+		if (isolated >= SWAP_CLUSTER_MAX) {
+			addr += PAGE_SIZE;
+			break;
+		}
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+
+	if (isolated)
+		rp->nr_reclaimed += reclaim_pages_from_list(&page_list,
+							    &rp->nr_scanned);
+	cond_resched();
+
+	if (addr != end)
+		goto cont;
+
+	return 0;
+}
+
+#define RECLAIM_FILE	(1 << 0)
+#define RECLAIM_ANON	(1 << 1)
+#define RECLAIM_ALL	(RECLAIM_FILE | RECLAIM_ANON)
+
+static ssize_t reclaim_write(struct file *file, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct task_struct *task;
+	char buffer[PROC_NUMBUF];
+	struct mm_struct *mm;
+	struct vm_area_struct *vma;
+	struct reclaim_param rp = { };
+	ktime_t start;
+	char *type_buf;
+	int type;
+
+	memset(buffer, 0, sizeof(buffer));
+	if (count > sizeof(buffer) - 1)
+		count = sizeof(buffer) - 1;
+	if (copy_from_user(buffer, buf, count))
+		return -EFAULT;
+
+	type_buf = strstrip(buffer);
+	if (!strcmp(type_buf, "file"))
+		type = RECLAIM_FILE;
+	else if (!strcmp(type_buf, "anon"))
+		type = RECLAIM_ANON;
+	else if (!strcmp(type_buf, "all"))
+		type = RECLAIM_ALL;
+	else
+		return -EINVAL;
+
+	task = get_proc_task(file->f_path.dentry->d_inode);
+	if (!task)
+		return -ESRCH;
+	mm = get_task_mm(task);
+	if (mm) {
+		struct mm_walk reclaim_walk = {
+			.pmd_entry = reclaim_pte_range,
+			.mm = mm,
+			.private = &rp,
+		};
+
+		start = ktime_get();
+		down_read(&mm->mmap_sem);
+		for (vma = mm->mmap; vma; vma = vma->vm_next) {
+			if (is_vm_hugetlb_page(vma))
+				continue;
+			if (vma->vm_flags & VM_LOCKED)
+				continue;
+			if (!(type & RECLAIM_ANON) && !vma->vm_file)
+				continue;
+			if (!(type & RECLAIM_FILE) && vma->vm_file)
+				continue;
+
+			rp.vma = vma;
+			walk_page_range(vma->vm_start, vma->vm_end,
+					&reclaim_walk);
+		}
+		flush_tlb_mm(mm);
+		up_read(&mm->mmap_sem);
+		mmput(mm);
+
+		trace_mm_vmscan_process_reclaim(task_pid_nr(task),
+				!!(type & RECLAIM_ANON), !!(type & RECLAIM_FILE),
+				rp.nr_scanned, rp.nr_reclaimed,
+				ktime_to_ns(ktime_sub(ktime_get(), start)));
+	}
+	put_task_struct(task);
+
+	return count;
+}
+
+const struct file_operations proc_reclaim_operations = {
+	.write		= reclaim_write,
+	.llseek		= noop_llseek,
+};
+#endif
+
 struct pagemapread {
 	int pos, len;
 	u64 *buffer;
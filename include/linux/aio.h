@@ -123,6 +123,10 @@ struct kiocb {
 	 * this is the underlying eventfd context to deliver events to.
 	 */
 	struct eventfd_ctx	*ki_eventfd;
+
+	/* blocking operations run from the aio offload workers */
+	struct work_struct	ki_work;
+	struct list_head	ki_offload_list;
 };
 
 #define is_sync_kiocb(iocb)	((iocb)->ki_key == KIOCB_SYNC_KEY)
@@ -199,6 +203,13 @@ struct kioctx {
 
 	struct delayed_work	wq;
 
+	/*
+	 * Offloaded iocbs waiting for one of the context's running
+	 * offload workers, protected by ctx_lock.
+	 */
+	struct list_head	offload_list;
+	unsigned long		offload_active;
+
 	struct rcu_head		rcu_head;
 };
 
@@ -234,5 +245,6 @@ static inline struct kiocb *list_kiocb(struct list_head *h)
 /* for sysctl: */
 extern unsigned long aio_nr;
 extern unsigned long aio_max_nr;
+extern unsigned long aio_max_offload;
 
 #endif /* __LINUX__AIO_H */
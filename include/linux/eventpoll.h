@@ -26,6 +26,13 @@
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
 
+/*
+ * Add the target file descriptor to its wait queues as an exclusive
+ * waiter, so that an event wakes only one of the epoll instances watching
+ * it.  Only valid with EPOLL_CTL_ADD.
+ */
+#define EPOLLEXCLUSIVE (1 << 28)
+
 /* Set the One Shot behaviour for the target file descriptor */
 #define EPOLLONESHOT (1 << 30)
 
@@ -13,7 +13,22 @@
 
 struct gen_pool;
 
+/**
+ * struct gen_pool_frag_info - free space of a pool, see gen_pool_get_frag_info()
+ * @avail:	free bytes
+ * @largest:	bytes in the largest free range
+ * @nr_free:	number of free ranges
+ * @cached:	free bytes held in per-cpu caches of a best-fit pool
+ */
+struct gen_pool_frag_info {
+	size_t avail;
+	size_t largest;
+	unsigned long nr_free;
+	size_t cached;
+};
+
 struct gen_pool *__must_check gen_pool_create(unsigned order, int nid);
+struct gen_pool *__must_check gen_pool_create_best_fit(unsigned order, int nid);
 
 void gen_pool_destroy(struct gen_pool *pool);
 
@@ -27,7 +42,8 @@ gen_pool_alloc_aligned(struct gen_pool *pool, size_t size,
  * @size:	Number of bytes to allocate from the pool.
  *
  * Allocate the requested number of bytes from the specified pool.
- * Uses a first-fit algorithm.
+ * Uses a first-fit algorithm, or best-fit for pools created by
+ * gen_pool_create_best_fit().
  */
 static inline unsigned long __must_check
 gen_pool_alloc(struct gen_pool *pool, size_t size)
@@ -37,6 +53,9 @@ gen_pool_alloc(struct gen_pool *pool, size_t size)
 
 void gen_pool_free(struct gen_pool *pool, unsigned long addr, size_t size);
 
+void gen_pool_get_frag_info(struct gen_pool *pool,
+			    struct gen_pool_frag_info *info);
+
 extern phys_addr_t gen_pool_virt_to_phys(struct gen_pool *pool, unsigned long);
 extern int gen_pool_add_virt(struct gen_pool *, unsigned long, phys_addr_t,
 			     size_t, int);
@@ -34,6 +34,9 @@ struct ion_handle;
  * @ION_HEAP_TYPE_CP:	 memory allocated from a prereserved
  *				carveout heap, allocations are physically
  *				contiguous. Used for content protection.
+ * @ION_HEAP_TYPE_DMA:	 memory allocated from the contiguous memory
+ *				allocator, physically contiguous and used
+ *				by the page allocator while free
  * @ION_HEAP_END:		helper for iterating over heaps
  */
 enum ion_heap_type {
@@ -42,6 +45,7 @@ enum ion_heap_type {
 	ION_HEAP_TYPE_CARVEOUT,
 	ION_HEAP_TYPE_IOMMU,
 	ION_HEAP_TYPE_CP,
+	ION_HEAP_TYPE_DMA,
 	ION_HEAP_TYPE_CUSTOM, /* must be last so device specific heaps always
 				 are at the end of this enum */
 	ION_NUM_HEAPS,
@@ -51,6 +55,7 @@ enum ion_heap_type {
 #define ION_HEAP_SYSTEM_CONTIG_MASK	(1 << ION_HEAP_TYPE_SYSTEM_CONTIG)
 #define ION_HEAP_CARVEOUT_MASK		(1 << ION_HEAP_TYPE_CARVEOUT)
 #define ION_HEAP_CP_MASK		(1 << ION_HEAP_TYPE_CP)
+#define ION_HEAP_DMA_MASK		(1 << ION_HEAP_TYPE_DMA)
 
 /**
  * heap flags - the lower 16 bits are used by core ion, the upper 16
@@ -147,6 +152,13 @@ struct ion_mapper;
 struct ion_client;
 struct ion_buffer;
 
+/*
+ * Heap flag to free buffers from a per heap kernel thread instead of from
+ * the context dropping the last reference.  Allocations that fail on such a
+ * heap first wait for the pending frees before giving up.
+ */
+#define ION_HEAP_FLAG_DEFER_FREE	(1 << 0)
+
 /* This should be removed some day when phys_addr_t's are fully
    plumbed in the kernel, and all instances of ion_phys_addr_t should
    be converted to phys_addr_t.  For the time being many kernel interfaces
@@ -165,6 +177,10 @@ struct ion_buffer;
  * @memory_type:Memory type used for the heap
  * @has_outer_cache:    set to 1 if outer cache is used, 0 otherwise.
  * @extra_data:	Extra data specific to each heap type
+ * @priv:	heap private data, the struct device whose contiguous
+ *		memory area backs an ION_HEAP_TYPE_DMA heap (NULL for the
+ *		default area)
+ * @flags:	ION_HEAP_FLAG_* flags for the heap
  */
 struct ion_platform_heap {
 	enum ion_heap_type type;
@@ -175,6 +191,8 @@ struct ion_platform_heap {
 	enum ion_memory_types memory_type;
 	unsigned int has_outer_cache;
 	void *extra_data;
+	void *priv;
+	unsigned long flags;
 };
 
 /**
@@ -415,10 +433,34 @@ struct ion_handle *ion_import(struct ion_client *client,
  * with them from userspace.  These buffers are represented by a file
  * descriptor obtained as the return from the ION_IOC_SHARE ioctl.
  * This function coverts that fd into the underlying buffer, and returns
- * the handle to use to refer to it further.
+ * the handle to use to refer to it further.  dma-buf fds exported by ion
+ * are accepted as well.
  */
 struct ion_handle *ion_import_fd(struct ion_client *client, int fd);
 
+/**
+ * ion_share_dma_buf() - export a buffer as a dma-buf file descriptor
+ * @client:	this blocks client
+ * @handle:	the handle of the buffer to export
+ *
+ * Returns a new fd referring to a dma-buf backed by the buffer, or a
+ * negative error.  The fd holds its own reference to the buffer, so the
+ * handle may be freed right away.  Any dma-buf importer (including other
+ * ion clients through ion_import_dma_buf()) can map it without a copy.
+ */
+int ion_share_dma_buf(struct ion_client *client, struct ion_handle *handle);
+
+/**
+ * ion_import_dma_buf() - get a handle for a dma-buf exported by ion
+ * @client:	this blocks client
+ * @fd:		the dma-buf fd
+ *
+ * Returns the handle of the client for the underlying buffer, taking a new
+ * reference if the client already has one.  Fails with -EINVAL if the
+ * dma-buf was not exported by ion.
+ */
+struct ion_handle *ion_import_dma_buf(struct ion_client *client, int fd);
+
 /**
  * ion_handle_get_flags - get the flags for a given handle
  *
@@ -618,6 +660,18 @@ static inline struct ion_handle *ion_import_fd(struct ion_client *client,
 	return ERR_PTR(-ENODEV);
 }
 
+static inline int ion_share_dma_buf(struct ion_client *client,
+	struct ion_handle *handle)
+{
+	return -ENODEV;
+}
+
+static inline struct ion_handle *ion_import_dma_buf(struct ion_client *client,
+	int fd)
+{
+	return ERR_PTR(-ENODEV);
+}
+
 static inline int ion_handle_get_flags(struct ion_client *client,
 	struct ion_handle *handle, unsigned long *flags)
 {
@@ -813,11 +867,21 @@ struct ion_flag_data {
  * DOC: ION_IOC_IMPORT - imports a shared file descriptor
  *
  * Takes an ion_fd_data struct with the fd field populated with a valid file
- * descriptor obtained from ION_IOC_SHARE and returns the struct with the handle
- * filed set to the corresponding opaque handle.
+ * descriptor obtained from ION_IOC_SHARE or ION_IOC_SHARE_DMA_BUF and returns
+ * the struct with the handle filed set to the corresponding opaque handle.
  */
 #define ION_IOC_IMPORT		_IOWR(ION_IOC_MAGIC, 5, struct ion_fd_data)
 
+/**
+ * DOC: ION_IOC_SHARE_DMA_BUF - export an allocation as a dma-buf
+ *
+ * Takes an ion_fd_data struct with the handle field populated with a valid
+ * opaque handle.  Returns the struct with the fd field set to a dma-buf file
+ * descriptor, which can be mmapped, imported by any driver that accepts
+ * dma-bufs, or turned back into a handle with ION_IOC_IMPORT.
+ */
+#define ION_IOC_SHARE_DMA_BUF	_IOWR(ION_IOC_MAGIC, 7, struct ion_fd_data)
+
 /**
  * DOC: ION_IOC_CUSTOM - call architecture specific ion ioctl
  *
@@ -97,6 +97,8 @@ int mm_match_cgroup(const struct mm_struct *mm, const struct mem_cgroup *cgroup)
 }
 
 extern struct cgroup_subsys_state *mem_cgroup_css(struct mem_cgroup *mem);
+extern struct mem_cgroup *mem_cgroup_from_cont(struct cgroup *cont);
+extern struct mem_cgroup *parent_mem_cgroup(struct mem_cgroup *mem);
 
 extern int
 mem_cgroup_prepare_migration(struct page *page,
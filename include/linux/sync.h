@@ -39,6 +39,8 @@ struct seq_file;
  *			  1 if b will signal before a
  *			  0 if a and b will signal at the same time
  *			 -1 if a will signabl before b
+ *			  must agree with @has_signaled: a pt never
+ *			  signals before a pt that compares earlier
  * @free_pt:		called before sync_pt is freed
  * @release_obj:	called before sync_timeline is freed
  * @print_obj:		deprecated
@@ -95,7 +97,8 @@ struct sync_timeline_ops {
  * @child_list_head:	list of children sync_pts for this sync_timeline
  * @child_list_lock:	lock protecting @child_list_head, destroyed, and
  *			  sync_pt.status
- * @active_list_head:	list of active (unsignaled/errored) sync_pts
+ * @active_list_head:	list of active (unsignaled/errored) sync_pts,
+ *			  sorted in signaling order
  * @sync_timeline_list:	membership in global sync_timeline_list
  */
 struct sync_timeline {
@@ -54,6 +54,12 @@ struct inet_peer {
 			u32				pmtu_orig;
 			u32				pmtu_learned;
 			struct inetpeer_addr_base	redirect_learned;
+			/* TCP Fast Open client cache, see tcp_fastopen.c */
+			unsigned long			tfo_last_syn_loss;
+			u16				tfo_mss;
+			u16				tfo_syn_loss;
+			s8				tfo_cookie_len;
+			u8				tfo_cookie[16];
 		};
 		struct rcu_head         rcu;
 	};
@@ -105,6 +105,19 @@ struct listen_sock {
 	struct request_sock	*syn_table[0];
 };
 
+/** struct fastopen_queue - TCP Fast Open state of a listener
+ *
+ * @qlen - number of children created from a data carrying SYN whose
+ *	   3WHS has not completed yet
+ * @max_qlen - limit set by the TCP_FASTOPEN socket option, 0 disables
+ *
+ * Both are protected by the syn_wait_lock of the owning queue.
+ */
+struct fastopen_queue {
+	int			qlen;
+	int			max_qlen;
+};
+
 /** struct request_sock_queue - queue of request_socks
  *
  * @rskq_accept_head - FIFO head of established children
@@ -128,6 +141,7 @@ struct request_sock_queue {
 	u8			rskq_defer_accept;
 	/* 3 bytes hole, try to pack */
 	struct listen_sock	*listen_opt;
+	struct fastopen_queue	fastopenq;
 };
 
 extern int reqsk_queue_alloc(struct request_sock_queue *queue,
@@ -312,6 +312,38 @@ TRACE_EVENT(mm_vmscan_lru_shrink_inactive,
 		show_reclaim_flags(__entry->reclaim_flags))
 );
 
+TRACE_EVENT(mm_vmscan_process_reclaim,
+
+	TP_PROTO(pid_t pid, int anon, int file,
+		unsigned long nr_scanned, unsigned long nr_reclaimed,
+		u64 elapsed_ns),
+
+	TP_ARGS(pid, anon, file, nr_scanned, nr_reclaimed, elapsed_ns),
+
+	TP_STRUCT__entry(
+		__field(pid_t, pid)
+		__field(int, anon)
+		__field(int, file)
+		__field(unsigned long, nr_scanned)
+		__field(unsigned long, nr_reclaimed)
+		__field(u64, elapsed_ns)
+	),
+
+	TP_fast_assign(
+		__entry->pid = pid;
+		__entry->anon = anon;
+		__entry->file = file;
+		__entry->nr_scanned = nr_scanned;
+		__entry->nr_reclaimed = nr_reclaimed;
+		__entry->elapsed_ns = elapsed_ns;
+	),
+
+	TP_printk("pid=%d anon=%d file=%d nr_scanned=%ld nr_reclaimed=%ld elapsed_ns=%llu",
+		__entry->pid, __entry->anon, __entry->file,
+		__entry->nr_scanned, __entry->nr_reclaimed,
+		(unsigned long long)__entry->elapsed_ns)
+);
+
 TRACE_EVENT(replace_swap_token,
 	TP_PROTO(struct mm_struct *old_mm,
 		 struct mm_struct *new_mm),
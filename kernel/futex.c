@@ -56,6 +56,8 @@
 #include <linux/syscalls.h>
 #include <linux/signal.h>
 #include <linux/module.h>
+#include <linux/bootmem.h>
+#include <linux/log2.h>
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
@@ -67,8 +69,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Futex flags used to encode options to functions and preserve them across
  * restarts.
@@ -146,19 +146,100 @@ static const struct futex_q futex_q_init = {
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The global hash table is sized at boot from the number of possible
+ * CPUs, so that the chance of two busy futexes sharing a bucket (and its
+ * lock) doesn't grow with the machine.
+ */
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * With CONFIG_FUTEX_PRIVATE_HASH, PROCESS_PRIVATE futexes are hashed into
+ * a small table of their own mm, allocated on the first private futex
+ * operation, so that the threads of one process never contend on bucket
+ * locks with another process.  If that allocation fails, the mm is marked
+ * with FUTEX_NO_PRIVATE_HASH and keeps using the global table; either way
+ * mm->futex_hash never changes again once it is set.
+ */
+#define FUTEX_PRIVATE_HASHBITS	6
+#define FUTEX_NO_PRIVATE_HASH	((struct futex_hash_bucket *)1UL)
+
+static void futex_private_hash_alloc(struct mm_struct *mm)
+{
+	struct futex_hash_bucket *queues;
+	int i;
+
+	if (likely(ACCESS_ONCE(mm->futex_hash)))
+		return;
+
+	queues = kmalloc(sizeof(*queues) << FUTEX_PRIVATE_HASHBITS,
+			 GFP_KERNEL);
+	if (queues) {
+		for (i = 0; i < 1 << FUTEX_PRIVATE_HASHBITS; i++) {
+			plist_head_init(&queues[i].chain);
+			spin_lock_init(&queues[i].lock);
+		}
+	} else
+		queues = FUTEX_NO_PRIVATE_HASH;
+
+	/* Another thread of this mm may have got there first. */
+	if (cmpxchg(&mm->futex_hash, NULL, queues) &&
+	    queues != FUTEX_NO_PRIVATE_HASH)
+		kfree(queues);
+}
+
+void futex_mm_free(struct mm_struct *mm)
+{
+	if (mm->futex_hash != FUTEX_NO_PRIVATE_HASH)
+		kfree(mm->futex_hash);
+}
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+static inline struct futex_hash_bucket *
+hash_futex_private(union futex_key *key, u32 hash)
+{
+	struct futex_hash_bucket *queues;
+
+	if ((key->both.offset & (FUT_OFF_INODE|FUT_OFF_MMSHARED)) ||
+	    !key->private.mm)
+		return NULL;
+
+	queues = ACCESS_ONCE(key->private.mm->futex_hash);
+	smp_read_barrier_depends();
+	if (!queues || queues == FUTEX_NO_PRIVATE_HASH)
+		return NULL;
+
+	return &queues[hash & ((1 << FUTEX_PRIVATE_HASHBITS) - 1)];
+}
+#else
+static inline void futex_private_hash_alloc(struct mm_struct *mm)
+{
+}
+
+static inline struct futex_hash_bucket *
+hash_futex_private(union futex_key *key, u32 hash)
+{
+	return NULL;
+}
+#endif
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_hash_bucket *hb;
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+
+	hb = hash_futex_private(key, hash);
+	if (hb)
+		return hb;
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -257,6 +338,9 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	if (!fshared) {
 		if (unlikely(!access_ok(VERIFY_WRITE, uaddr, sizeof(u32))))
 			return -EFAULT;
+		/* Must be settled before the key is first hashed. */
+		if (mm)
+			futex_private_hash_alloc(mm);
 		key->private.mm = mm;
 		key->private.address = address;
 		get_futex_key_refs(key);
@@ -2719,8 +2803,21 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
+	unsigned long i;
 	u32 curval;
-	int i;
+
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2735,7 +2832,7 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
+	for (i = 0; i < futex_hashsize; i++) {
 		plist_head_init(&futex_queues[i].chain);
 		spin_lock_init(&futex_queues[i].lock);
 	}
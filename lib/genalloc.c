@@ -13,14 +13,58 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/bitmap.h>
+#include <linux/rbtree.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
 #include <linux/genalloc.h>
 
 
+/*
+ * Free extent of a best-fit pool, in units of 1 << pool->order.  While not
+ * in the trees, extents are kept on the pool's list of spare extents.
+ */
+struct gen_pool_extent {
+	union {
+		struct rb_node size_node;	/* in free_by_size */
+		struct gen_pool_extent *next_spare;
+	};
+	struct rb_node addr_node;		/* in free_by_addr */
+	unsigned long start;
+	unsigned long size;
+};
+
+/*
+ * Best-fit pools cache freed blocks of 1, 2, 4 and 8 units per cpu, and
+ * hand them out again without going through the trees.
+ */
+#define GEN_POOL_PCP_SIZES	4
+#define GEN_POOL_PCP_DEPTH	8
+
+struct gen_pool_pcp {
+	spinlock_t lock;
+	unsigned int count[GEN_POOL_PCP_SIZES];
+	unsigned long start[GEN_POOL_PCP_SIZES][GEN_POOL_PCP_DEPTH];
+};
+
 /* General purpose special memory pool descriptor. */
 struct gen_pool {
 	rwlock_t lock;			/* protects chunks list */
 	struct list_head chunks;	/* list of chunks in this pool */
 	unsigned order;			/* minimum allocation order */
+
+	/* Best-fit pools only: */
+	struct gen_pool_pcp __percpu *pcp;	/* NULL for bitmap pools */
+	spinlock_t extent_lock;		/* protects all below */
+	struct rb_root free_by_size;	/* free extents by size, then start */
+	struct rb_root free_by_addr;	/* free extents by start */
+	/*
+	 * Freeing a block needs at most one new extent, so there are always
+	 * at least as many spare extents as blocks allocated from the trees:
+	 * gen_pool_free() then never has to allocate memory.
+	 */
+	struct gen_pool_extent *spare;
+	unsigned long nr_spare;
+	unsigned long nr_blocks;
 };
 
 /* General purpose special memory pool chunk descriptor. */
@@ -50,7 +94,7 @@ struct gen_pool *__must_check gen_pool_create(unsigned order, int nid)
 	if (WARN_ON(order >= BITS_PER_LONG))
 		return NULL;
 
-	pool = kmalloc_node(sizeof *pool, GFP_KERNEL, nid);
+	pool = kzalloc_node(sizeof *pool, GFP_KERNEL, nid);
 	if (pool) {
 		rwlock_init(&pool->lock);
 		INIT_LIST_HEAD(&pool->chunks);
@@ -60,6 +104,354 @@ struct gen_pool *__must_check gen_pool_create(unsigned order, int nid)
 }
 EXPORT_SYMBOL(gen_pool_create);
 
+/**
+ * gen_pool_create_best_fit() - create a new best-fit special memory pool
+ * @order:	Log base 2 of number of bytes each allocation unit
+ *		represents.
+ * @nid:	Node id of the node the pool structure should be allocated
+ *		on, or -1.  This will be also used for other allocations.
+ *
+ * Like gen_pool_create(), but instead of searching per-chunk bitmaps first
+ * fit, the pool keeps its free extents in a tree ordered by size and
+ * allocates from the smallest one that fits, in O(log n) however
+ * fragmented the pool is.  Small blocks are recycled through per-cpu
+ * caches.
+ */
+struct gen_pool *__must_check gen_pool_create_best_fit(unsigned order, int nid)
+{
+	struct gen_pool *pool;
+	int cpu;
+
+	pool = gen_pool_create(order, nid);
+	if (!pool)
+		return NULL;
+
+	pool->pcp = alloc_percpu(struct gen_pool_pcp);
+	if (!pool->pcp) {
+		kfree(pool);
+		return NULL;
+	}
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(pool->pcp, cpu)->lock);
+
+	spin_lock_init(&pool->extent_lock);
+	pool->free_by_size = RB_ROOT;
+	pool->free_by_addr = RB_ROOT;
+	return pool;
+}
+EXPORT_SYMBOL(gen_pool_create_best_fit);
+
+static void gen_pool_put_spare(struct gen_pool *pool,
+			       struct gen_pool_extent *ext)
+{
+	ext->next_spare = pool->spare;
+	pool->spare = ext;
+	pool->nr_spare++;
+}
+
+static struct gen_pool_extent *gen_pool_get_spare(struct gen_pool *pool)
+{
+	struct gen_pool_extent *ext = pool->spare;
+
+	BUG_ON(!ext);
+	pool->spare = ext->next_spare;
+	pool->nr_spare--;
+	return ext;
+}
+
+/* Give back the spare extents no longer needed for the blocks allocated */
+static void gen_pool_trim_spare(struct gen_pool *pool)
+{
+	while (pool->nr_spare > pool->nr_blocks)
+		kfree(gen_pool_get_spare(pool));
+}
+
+static void gen_pool_insert_size(struct gen_pool *pool,
+				 struct gen_pool_extent *ext)
+{
+	struct rb_node **p = &pool->free_by_size.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		struct gen_pool_extent *tmp;
+
+		parent = *p;
+		tmp = rb_entry(parent, struct gen_pool_extent, size_node);
+		if (ext->size < tmp->size ||
+		    (ext->size == tmp->size && ext->start < tmp->start))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&ext->size_node, parent, p);
+	rb_insert_color(&ext->size_node, &pool->free_by_size);
+}
+
+static void gen_pool_resize(struct gen_pool *pool,
+			    struct gen_pool_extent *ext,
+			    unsigned long start, unsigned long size)
+{
+	rb_erase(&ext->size_node, &pool->free_by_size);
+	ext->start = start;
+	ext->size = size;
+	gen_pool_insert_size(pool, ext);
+}
+
+/*
+ * Return [start, start + size) to the free extents of a best-fit pool,
+ * merging it with its neighbours.  Called with extent_lock held.
+ */
+static void gen_pool_free_extent(struct gen_pool *pool, unsigned long start,
+				 unsigned long size)
+{
+	struct rb_node **p = &pool->free_by_addr.rb_node;
+	struct rb_node *parent = NULL, *node;
+	struct gen_pool_extent *prev = NULL, *next = NULL, *ext;
+
+	while (*p) {
+		parent = *p;
+		ext = rb_entry(parent, struct gen_pool_extent, addr_node);
+		if (start < ext->start) {
+			next = ext;
+			p = &parent->rb_left;
+		} else {
+			prev = ext;
+			p = &parent->rb_right;
+		}
+	}
+
+	/* Freeing space that is free already */
+	BUG_ON(prev && prev->start + prev->size > start);
+	BUG_ON(next && start + size > next->start);
+
+	if (prev && prev->start + prev->size == start) {
+		if (next && start + size == next->start) {
+			size += next->size;
+			rb_erase(&next->size_node, &pool->free_by_size);
+			rb_erase(&next->addr_node, &pool->free_by_addr);
+			gen_pool_put_spare(pool, next);
+		}
+		gen_pool_resize(pool, prev, prev->start, prev->size + size);
+		return;
+	}
+	if (next && start + size == next->start) {
+		gen_pool_resize(pool, next, start, next->size + size);
+		return;
+	}
+
+	ext = gen_pool_get_spare(pool);
+	ext->start = start;
+	ext->size = size;
+	node = &ext->addr_node;
+	rb_link_node(node, parent, p);
+	rb_insert_color(node, &pool->free_by_addr);
+	gen_pool_insert_size(pool, ext);
+}
+
+/*
+ * Allocate size units aligned to align_mask + 1 from the smallest free
+ * extent of a best-fit pool they fit in.  Called with extent_lock held,
+ * and at least two spare extents.
+ */
+static unsigned long gen_pool_alloc_extent(struct gen_pool *pool,
+					   unsigned long size,
+					   unsigned long align_mask)
+{
+	struct rb_node *node = pool->free_by_size.rb_node, *best = NULL;
+	struct gen_pool_extent *ext, *tail;
+	unsigned long start, end;
+
+	while (node) {
+		ext = rb_entry(node, struct gen_pool_extent, size_node);
+		if (ext->size >= size) {
+			best = node;
+			node = node->rb_left;
+		} else
+			node = node->rb_right;
+	}
+
+	/* Alignment may leave the smallest extents too short: try bigger */
+	for (node = best; node; node = rb_next(node)) {
+		ext = rb_entry(node, struct gen_pool_extent, size_node);
+		start = (ext->start + align_mask) & ~align_mask;
+		end = ext->start + ext->size;
+		if (start + size <= end)
+			goto found;
+	}
+	return 0;
+
+found:
+	if (start == ext->start && start + size == end) {
+		rb_erase(&ext->size_node, &pool->free_by_size);
+		rb_erase(&ext->addr_node, &pool->free_by_addr);
+		gen_pool_put_spare(pool, ext);
+	} else if (start == ext->start) {
+		gen_pool_resize(pool, ext, start + size, end - start - size);
+	} else {
+		gen_pool_resize(pool, ext, ext->start, start - ext->start);
+		if (start + size < end) {
+			tail = gen_pool_get_spare(pool);
+			tail->start = start + size;
+			tail->size = end - tail->start;
+			/* Right after ext, which has no right neighbour then */
+			node = &ext->addr_node;
+			if (node->rb_right) {
+				node = node->rb_right;
+				while (node->rb_left)
+					node = node->rb_left;
+				rb_link_node(&tail->addr_node, node,
+					     &node->rb_left);
+			} else
+				rb_link_node(&tail->addr_node, node,
+					     &node->rb_right);
+			rb_insert_color(&tail->addr_node,
+					&pool->free_by_addr);
+			gen_pool_insert_size(pool, tail);
+		}
+	}
+	pool->nr_blocks++;
+	return start;
+}
+
+static inline int gen_pool_pcp_index(unsigned long size)
+{
+	if (size > (1UL << (GEN_POOL_PCP_SIZES - 1)) || !is_power_of_2(size))
+		return -1;
+	return ilog2(size);
+}
+
+static unsigned long gen_pool_pcp_alloc(struct gen_pool *pool,
+					unsigned long size,
+					unsigned long align_mask)
+{
+	struct gen_pool_pcp *pcp;
+	unsigned long flags, start = 0;
+	int idx = gen_pool_pcp_index(size);
+	unsigned int count;
+
+	if (idx < 0)
+		return 0;
+
+	local_irq_save(flags);
+	pcp = this_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	count = pcp->count[idx];
+	if (count && !(pcp->start[idx][count - 1] & align_mask)) {
+		start = pcp->start[idx][count - 1];
+		pcp->count[idx]--;
+	}
+	spin_unlock(&pcp->lock);
+	local_irq_restore(flags);
+	return start;
+}
+
+static bool gen_pool_pcp_free(struct gen_pool *pool, unsigned long start,
+			      unsigned long size)
+{
+	struct gen_pool_pcp *pcp;
+	unsigned long flags;
+	int idx = gen_pool_pcp_index(size);
+	bool cached = false;
+
+	if (idx < 0)
+		return false;
+
+	local_irq_save(flags);
+	pcp = this_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	if (pcp->count[idx] < GEN_POOL_PCP_DEPTH) {
+		pcp->start[idx][pcp->count[idx]++] = start;
+		cached = true;
+	}
+	spin_unlock(&pcp->lock);
+	local_irq_restore(flags);
+	return cached;
+}
+
+/*
+ * Return the blocks cached on all cpus to the free extents, so that they
+ * can be merged again.  Returns whether there were any.
+ */
+static bool gen_pool_pcp_drain(struct gen_pool *pool)
+{
+	unsigned long flags;
+	bool drained = false;
+	int cpu, idx;
+
+	for_each_possible_cpu(cpu) {
+		struct gen_pool_pcp *pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		spin_lock_irqsave(&pcp->lock, flags);
+		spin_lock(&pool->extent_lock);
+		for (idx = 0; idx < GEN_POOL_PCP_SIZES; idx++) {
+			while (pcp->count[idx]) {
+				gen_pool_free_extent(pool,
+					pcp->start[idx][--pcp->count[idx]],
+					1UL << idx);
+				pool->nr_blocks--;
+				drained = true;
+			}
+		}
+		gen_pool_trim_spare(pool);
+		spin_unlock(&pool->extent_lock);
+		spin_unlock_irqrestore(&pcp->lock, flags);
+	}
+	return drained;
+}
+
+static unsigned long gen_pool_alloc_best_fit(struct gen_pool *pool,
+					     unsigned long size,
+					     unsigned long align_mask)
+{
+	struct gen_pool_extent *ext[2];
+	unsigned long start, flags;
+	int i;
+
+	start = gen_pool_pcp_alloc(pool, size, align_mask);
+	if (start)
+		return start;
+
+	/*
+	 * Allocating may split an extent in three, and freeing the block
+	 * may need an extent again later: bring in the spare extents for
+	 * both now, while allocating memory is still an option.
+	 */
+	for (i = 0; i < 2; i++) {
+		ext[i] = kmalloc(sizeof(*ext[i]), GFP_ATOMIC);
+		if (!ext[i]) {
+			while (i--)
+				kfree(ext[i]);
+			return 0;
+		}
+	}
+
+	spin_lock_irqsave(&pool->extent_lock, flags);
+	gen_pool_put_spare(pool, ext[0]);
+	gen_pool_put_spare(pool, ext[1]);
+	start = gen_pool_alloc_extent(pool, size, align_mask);
+	gen_pool_trim_spare(pool);
+	spin_unlock_irqrestore(&pool->extent_lock, flags);
+
+	if (!start && gen_pool_pcp_drain(pool))
+		return gen_pool_alloc_best_fit(pool, size, align_mask);
+	return start;
+}
+
+static void gen_pool_free_best_fit(struct gen_pool *pool, unsigned long start,
+				   unsigned long size)
+{
+	unsigned long flags;
+
+	if (gen_pool_pcp_free(pool, start, size))
+		return;
+
+	spin_lock_irqsave(&pool->extent_lock, flags);
+	gen_pool_free_extent(pool, start, size);
+	pool->nr_blocks--;
+	gen_pool_trim_spare(pool);
+	spin_unlock_irqrestore(&pool->extent_lock, flags);
+}
+
 /**
  * gen_pool_add_virt - add a new chunk of special memory to the pool
  * @pool: pool to add new memory chunk to
@@ -87,7 +479,10 @@ int __must_check gen_pool_add_virt(struct gen_pool *pool, unsigned long virt, ph
 	if (WARN_ON(!size))
 		return -EINVAL;
 
-	nbytes = sizeof *chunk + BITS_TO_LONGS(size) * sizeof *chunk->bits;
+	/* Best-fit pools track free space in extents, not in the bitmap */
+	nbytes = sizeof *chunk;
+	if (!pool->pcp)
+		nbytes += BITS_TO_LONGS(size) * sizeof *chunk->bits;
 	chunk = kzalloc_node(nbytes, GFP_KERNEL, nid);
 	if (!chunk)
 		return -ENOMEM;
@@ -97,6 +492,22 @@ int __must_check gen_pool_add_virt(struct gen_pool *pool, unsigned long virt, ph
 	chunk->start = virt >> pool->order;
 	chunk->size  = size;
 
+	if (pool->pcp) {
+		struct gen_pool_extent *ext;
+		unsigned long flags;
+
+		ext = kmalloc_node(sizeof(*ext), GFP_KERNEL, nid);
+		if (!ext) {
+			kfree(chunk);
+			return -ENOMEM;
+		}
+		spin_lock_irqsave(&pool->extent_lock, flags);
+		gen_pool_put_spare(pool, ext);
+		gen_pool_free_extent(pool, chunk->start, size);
+		gen_pool_trim_spare(pool);
+		spin_unlock_irqrestore(&pool->extent_lock, flags);
+	}
+
 	write_lock(&pool->lock);
 	list_add(&chunk->next_chunk, &pool->chunks);
 	write_unlock(&pool->lock);
@@ -143,13 +554,31 @@ void gen_pool_destroy(struct gen_pool *pool)
 	struct gen_pool_chunk *chunk;
 	int bit;
 
+	if (pool->pcp) {
+		struct gen_pool_extent *ext;
+		struct rb_node *node;
+
+		gen_pool_pcp_drain(pool);
+		BUG_ON(pool->nr_blocks);
+		while ((node = rb_first(&pool->free_by_addr))) {
+			ext = rb_entry(node, struct gen_pool_extent, addr_node);
+			rb_erase(node, &pool->free_by_addr);
+			kfree(ext);
+		}
+		while (pool->nr_spare)
+			kfree(gen_pool_get_spare(pool));
+		free_percpu(pool->pcp);
+	}
+
 	while (!list_empty(&pool->chunks)) {
 		chunk = list_entry(pool->chunks.next, struct gen_pool_chunk,
 				   next_chunk);
 		list_del(&chunk->next_chunk);
 
-		bit = find_next_bit(chunk->bits, chunk->size, 0);
-		BUG_ON(bit < chunk->size);
+		if (!pool->pcp) {
+			bit = find_next_bit(chunk->bits, chunk->size, 0);
+			BUG_ON(bit < chunk->size);
+		}
 
 		kfree(chunk);
 	}
@@ -166,7 +595,8 @@ EXPORT_SYMBOL(gen_pool_destroy);
  *			must be aligned to 1MiB).
  *
  * Allocate the requested number of bytes from the specified pool.
- * Uses a first-fit algorithm.
+ * Uses a first-fit algorithm, or best-fit for pools created by
+ * gen_pool_create_best_fit().
  */
 unsigned long __must_check
 gen_pool_alloc_aligned(struct gen_pool *pool, size_t size,
@@ -183,6 +613,10 @@ gen_pool_alloc_aligned(struct gen_pool *pool, size_t size,
 
 	size = (size + (1UL << pool->order) - 1) >> pool->order;
 
+	if (pool->pcp)
+		return gen_pool_alloc_best_fit(pool, size, align_mask)
+			<< pool->order;
+
 	read_lock(&pool->lock);
 	list_for_each_entry(chunk, &pool->chunks, next_chunk) {
 		if (chunk->size < size)
@@ -235,6 +669,10 @@ void gen_pool_free(struct gen_pool *pool, unsigned long addr, size_t size)
 	list_for_each_entry(chunk, &pool->chunks, next_chunk)
 		if (addr >= chunk->start &&
 		    addr + size <= chunk->start + chunk->size) {
+			if (pool->pcp) {
+				gen_pool_free_best_fit(pool, addr, size);
+				goto done;
+			}
 			spin_lock_irqsave(&chunk->lock, flags);
 			bitmap_clear(chunk->bits, addr - chunk->start, size);
 			spin_unlock_irqrestore(&chunk->lock, flags);
@@ -245,3 +683,73 @@ done:
 	read_unlock(&pool->lock);
 }
 EXPORT_SYMBOL(gen_pool_free);
+
+/**
+ * gen_pool_get_frag_info() - report how fragmented the free space is
+ * @pool:	Pool to report on.
+ * @info:	Filled in with the free bytes, the largest free range in
+ *		bytes, the number of free ranges and, for best-fit pools,
+ *		the bytes held in per-cpu caches (included in avail).
+ */
+void gen_pool_get_frag_info(struct gen_pool *pool,
+			    struct gen_pool_frag_info *info)
+{
+	struct gen_pool_chunk *chunk;
+	unsigned long flags;
+
+	memset(info, 0, sizeof(*info));
+
+	if (pool->pcp) {
+		struct gen_pool_extent *ext;
+		struct rb_node *node;
+		int cpu, idx;
+
+		spin_lock_irqsave(&pool->extent_lock, flags);
+		for (node = rb_first(&pool->free_by_addr); node;
+		     node = rb_next(node)) {
+			ext = rb_entry(node, struct gen_pool_extent, addr_node);
+			info->avail += ext->size;
+			info->nr_free++;
+		}
+		node = rb_last(&pool->free_by_size);
+		if (node) {
+			ext = rb_entry(node, struct gen_pool_extent, size_node);
+			info->largest = ext->size;
+		}
+		spin_unlock_irqrestore(&pool->extent_lock, flags);
+
+		for_each_possible_cpu(cpu) {
+			struct gen_pool_pcp *pcp = per_cpu_ptr(pool->pcp, cpu);
+
+			for (idx = 0; idx < GEN_POOL_PCP_SIZES; idx++)
+				info->cached += pcp->count[idx] << idx;
+		}
+		info->avail += info->cached;
+	} else {
+		read_lock(&pool->lock);
+		list_for_each_entry(chunk, &pool->chunks, next_chunk) {
+			unsigned long start, end = 0;
+
+			spin_lock_irqsave(&chunk->lock, flags);
+			for (;;) {
+				start = find_next_zero_bit(chunk->bits,
+							   chunk->size, end);
+				if (start >= chunk->size)
+					break;
+				end = find_next_bit(chunk->bits, chunk->size,
+						    start);
+				info->avail += end - start;
+				info->largest = max(info->largest,
+						    (size_t)(end - start));
+				info->nr_free++;
+			}
+			spin_unlock_irqrestore(&chunk->lock, flags);
+		}
+		read_unlock(&pool->lock);
+	}
+
+	info->avail <<= pool->order;
+	info->largest <<= pool->order;
+	info->cached <<= pool->order;
+}
+EXPORT_SYMBOL(gen_pool_get_frag_info);
@@ -84,6 +84,42 @@ static int mempool_open(struct inode *inode, struct file *file)
 	return seq_open(file, &mempool_op);
 }
 
+static int frag_show(struct seq_file *m, void *p)
+{
+	struct gen_pool_frag_info info;
+	int i;
+
+	seq_printf(m, "pool size free largest extents cached frag%%\n");
+	for (i = 0; i < ARRAY_SIZE(mpools); i++) {
+		struct mem_pool *mpool = &mpools[i];
+
+		mutex_lock(&mpool->pool_mutex);
+		if (mpool->gpool) {
+			gen_pool_get_frag_info(mpool->gpool, &info);
+			seq_printf(m, "%u 0x%lx 0x%zx 0x%zx %lu 0x%zx %zu\n",
+				   mpool->id, mpool->size, info.avail,
+				   info.largest, info.nr_free, info.cached,
+				   info.avail ?
+				   100 - info.largest * 100 / info.avail : 0);
+		}
+		mutex_unlock(&mpool->pool_mutex);
+	}
+	return 0;
+}
+
+static int frag_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, frag_show, NULL);
+}
+
+static const struct file_operations frag_operations = {
+	.owner		= THIS_MODULE,
+	.open		= frag_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct alloc *find_alloc(void *addr)
 {
 	struct rb_root *root = &alloc_root;
@@ -154,7 +190,7 @@ static struct gen_pool *initialize_gpool(unsigned long start,
 {
 	struct gen_pool *gpool;
 
-	gpool = gen_pool_create(PAGE_SHIFT, -1);
+	gpool = gen_pool_create_best_fit(PAGE_SHIFT, -1);
 
 	if (!gpool)
 		return NULL;
@@ -416,8 +452,16 @@ static int __init debugfs_mempool_init(void)
 	entry = debugfs_create_file("map", S_IRUSR, dir,
 		NULL, &mempool_operations);
 
-	if (!entry)
+	if (!entry) {
 		pr_err("Cannot create /sys/kernel/debug/mempool/map");
+		return -EINVAL;
+	}
+
+	entry = debugfs_create_file("frag", S_IRUSR, dir,
+		NULL, &frag_operations);
+
+	if (!entry)
+		pr_err("Cannot create /sys/kernel/debug/mempool/frag");
 
 	return entry ? 0 : -EINVAL;
 }
@@ -23,7 +23,6 @@
 #include <linux/pagemap.h>
 #include <linux/rmap.h>
 #include <linux/spinlock.h>
-#include <linux/jhash.h>
 #include <linux/delay.h>
 #include <linux/kthread.h>
 #include <linux/wait.h>
@@ -36,6 +35,7 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -189,6 +189,34 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Checksum of an empty page */
+static unsigned int zero_checksum __read_mostly;
+
+/* Whether to merge empty pages with the zero page */
+static bool ksm_use_zero_pages __read_mostly = true;
+
+/* The number of pages merged with the zero page */
+static unsigned long ksm_zero_pages_merged;
+
+/* The number of times a page was skipped for having changed since last scan */
+static unsigned long ksm_volatile_skips;
+
+/* Whether ksmd should adapt pages_to_scan to the merge yield */
+static bool ksm_auto_tune;
+
+/* Share of the cpu auto-tuning may let ksmd use, in percent */
+static unsigned int ksm_max_cpu_percent = 20;
+
+#define KSM_AUTO_MIN_PAGES	32
+#define KSM_AUTO_MAX_PAGES	8192
+
+/* Pages merged and ksmd cpu time spent in the full scan under way */
+static unsigned long ksm_scan_merged;
+static u64 ksm_scan_cpu_ns;
+
+/* Pages merged per second of ksmd cpu time in the last full scan */
+static unsigned long ksm_merge_yield;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -669,13 +697,46 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only has to tell a changed page from an unchanged one and
+ * order the unstable tree: merging always compares the whole page.  So
+ * favour speed over strength, and feed the page into four independent
+ * lanes, a word at a time, so the multiplies overlap instead of forming
+ * one long dependency chain.
+ */
+#ifdef CONFIG_64BIT
+#define KSM_HASH_PRIME1		0x9E3779B185EBCA87ULL
+#define KSM_HASH_PRIME2		0xC2B2AE3D27D4EB4FULL
+
+static inline unsigned long ksm_hash_round(unsigned long acc, unsigned long w)
+{
+	return rol64(acc + w * KSM_HASH_PRIME2, 31) * KSM_HASH_PRIME1;
+}
+#else
+#define KSM_HASH_PRIME1		0x9E3779B1U
+#define KSM_HASH_PRIME2		0x85EBCA77U
+
+static inline unsigned long ksm_hash_round(unsigned long acc, unsigned long w)
+{
+	return rol32(acc + w * KSM_HASH_PRIME2, 13) * KSM_HASH_PRIME1;
+}
+#endif
+
 static u32 calc_checksum(struct page *page)
 {
-	u32 checksum;
-	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	unsigned long h0 = 17, h1 = 0, h2 = 0, h3 = 0;
+	unsigned long *addr = kmap_atomic(page, KM_USER0);
+	int i;
+
+	for (i = 0; i < PAGE_SIZE / sizeof(long); i += 4) {
+		h0 = ksm_hash_round(h0, addr[i]);
+		h1 = ksm_hash_round(h1, addr[i + 1]);
+		h2 = ksm_hash_round(h2, addr[i + 2]);
+		h3 = ksm_hash_round(h3, addr[i + 3]);
+	}
 	kunmap_atomic(addr, KM_USER0);
-	return checksum;
+
+	return hash_long(h0 ^ ksm_hash_round(h1, h2 ^ h3), 32);
 }
 
 static int memcmp_pages(struct page *page1, struct page *page2)
@@ -756,7 +817,7 @@ out:
  * replace_page - replace page in vma by new ksm page
  * @vma:      vma that holds the pte pointing to page
  * @page:     the page we are replacing by kpage
- * @kpage:    the ksm page we replace page by
+ * @kpage:    the ksm page we replace page by, or the zero page
  * @orig_pte: the original value of the pte
  *
  * Returns 0 on success, -EFAULT on failure.
@@ -769,6 +830,7 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 	pud_t *pud;
 	pmd_t *pmd;
 	pte_t *ptep;
+	pte_t newpte;
 	spinlock_t *ptl;
 	unsigned long addr;
 	int err = -EFAULT;
@@ -796,12 +858,23 @@ static int replace_page(struct vm_area_struct *vma, struct page *page,
 		goto out;
 	}
 
-	get_page(kpage);
-	page_add_anon_rmap(kpage, vma, addr);
+	if (kpage != ZERO_PAGE(addr)) {
+		get_page(kpage);
+		page_add_anon_rmap(kpage, vma, addr);
+		newpte = mk_pte(kpage, vma->vm_page_prot);
+	} else {
+		/*
+		 * The zero page is mapped like do_anonymous_page() maps it,
+		 * and no longer counts as an anonymous page of this mm.
+		 */
+		newpte = pte_mkspecial(pfn_pte(page_to_pfn(kpage),
+					       vma->vm_page_prot));
+		dec_mm_counter(mm, MM_ANONPAGES);
+	}
 
 	flush_cache_page(vma, addr, pte_pfn(*ptep));
 	ptep_clear_flush(vma, addr, ptep);
-	set_pte_at_notify(mm, addr, ptep, mk_pte(kpage, vma->vm_page_prot));
+	set_pte_at_notify(mm, addr, ptep, newpte);
 
 	page_remove_rmap(page);
 	if (!page_mapped(page))
@@ -943,6 +1016,35 @@ out:
 	return err;
 }
 
+/*
+ * try_to_merge_with_zero_page - map the zero page in place of an empty page
+ *
+ * This function returns 0 if the page was merged, -EFAULT otherwise.
+ */
+static int try_to_merge_with_zero_page(struct rmap_item *rmap_item,
+				       struct page *page)
+{
+	struct mm_struct *mm = rmap_item->mm;
+	struct vm_area_struct *vma;
+	int err = -EFAULT;
+
+	down_read(&mm->mmap_sem);
+	if (ksm_test_exit(mm))
+		goto out;
+	vma = find_vma(mm, rmap_item->address);
+	if (!vma || vma->vm_start > rmap_item->address)
+		goto out;
+	/* The zero page is not to be mlocked */
+	if (vma->vm_flags & VM_LOCKED)
+		goto out;
+
+	err = try_to_merge_one_page(vma, page,
+				    ZERO_PAGE(rmap_item->address));
+out:
+	up_read(&mm->mmap_sem);
+	return err;
+}
+
 /*
  * try_to_merge_two_pages - take two identical pages and prepare them
  * to be merged into one page.
@@ -1105,6 +1207,22 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+
+		/*
+		 * The tree is ordered by checksum first, and by content only
+		 * among equal checksums: most steps of the walk then need
+		 * neither the tree page nor a memcmp.
+		 */
+		parent = *new;
+		if (rmap_item->oldchecksum < tree_rmap_item->oldchecksum) {
+			new = &parent->rb_left;
+			continue;
+		} else if (rmap_item->oldchecksum >
+			   tree_rmap_item->oldchecksum) {
+			new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (IS_ERR_OR_NULL(tree_page))
 			return NULL;
@@ -1119,7 +1237,6 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		ret = memcmp_pages(page, tree_page);
 
-		parent = *new;
 		if (ret < 0) {
 			put_page(tree_page);
 			new = &parent->rb_left;
@@ -1191,6 +1308,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			lock_page(kpage);
 			stable_tree_append(rmap_item, page_stable_node(kpage));
 			unlock_page(kpage);
+			ksm_scan_merged++;
 		}
 		put_page(kpage);
 		return;
@@ -1205,6 +1323,20 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
+		ksm_volatile_skips++;
+		return;
+	}
+
+	/*
+	 * A page with the checksum of an empty page most likely is empty:
+	 * map the zero page instead, rather than have it take up a node
+	 * of the unstable tree and then a ksm page of its own.  If it was
+	 * not empty after all, go on as with any other page.
+	 */
+	if (ksm_use_zero_pages && checksum == zero_checksum &&
+	    !try_to_merge_with_zero_page(rmap_item, page)) {
+		ksm_zero_pages_merged++;
+		ksm_scan_merged++;
 		return;
 	}
 
@@ -1227,6 +1359,7 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			if (stable_node) {
 				stable_tree_append(tree_rmap_item, stable_node);
 				stable_tree_append(rmap_item, stable_node);
+				ksm_scan_merged++;
 			}
 			unlock_page(kpage);
 
@@ -1423,6 +1556,65 @@ static void ksm_do_scan(unsigned int scan_npages)
 	}
 }
 
+/*
+ * ksm_update_yield - account the merge yield of the full scan just done
+ *
+ * Returns -1 if nothing was merged in it, 1 if merging paid off at least
+ * as well as in the previous full scan, 0 otherwise.
+ */
+static int ksm_update_yield(void)
+{
+	unsigned long yield = 0;
+	int trend;
+
+	if (ksm_scan_cpu_ns)
+		yield = div64_u64((u64)ksm_scan_merged * NSEC_PER_SEC,
+				  ksm_scan_cpu_ns);
+	if (!ksm_scan_merged)
+		trend = -1;
+	else
+		trend = yield >= ksm_merge_yield;
+
+	ksm_merge_yield = yield;
+	ksm_scan_merged = 0;
+	ksm_scan_cpu_ns = 0;
+	return trend;
+}
+
+/*
+ * ksm_tune_scan - adapt pages_to_scan after a batch, when auto_tune is set.
+ * @batch_ns - ksmd cpu time spent on the batch
+ * @trend - what ksm_update_yield() made of the full scan, if one completed
+ *
+ * pages_to_scan is doubled after a full scan in which merging paid off at
+ * least as well as in the one before, and halved after one which merged
+ * nothing at all.  In any case, ksmd is kept from spending more than
+ * max_cpu_percent of its time scanning rather than sleeping.
+ */
+static void ksm_tune_scan(u64 batch_ns, int trend)
+{
+	u64 nr_pages = ksm_thread_pages_to_scan;
+	u64 sleep_ns, budget_ns;
+
+	if (trend < 0)
+		nr_pages /= 2;
+	else if (trend > 0)
+		nr_pages *= 2;
+
+	if (batch_ns && ksm_max_cpu_percent < 100) {
+		sleep_ns = (u64)ksm_thread_sleep_millisecs * NSEC_PER_MSEC;
+		budget_ns = div_u64(sleep_ns * ksm_max_cpu_percent,
+				    100 - ksm_max_cpu_percent);
+		nr_pages = min(nr_pages,
+			       div64_u64(ksm_thread_pages_to_scan * budget_ns,
+					 batch_ns));
+	}
+
+	ksm_thread_pages_to_scan = clamp_t(u64, nr_pages,
+					   KSM_AUTO_MIN_PAGES,
+					   KSM_AUTO_MAX_PAGES);
+}
+
 static int ksmd_should_run(void)
 {
 	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
@@ -1435,8 +1627,20 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
+		if (ksmd_should_run()) {
+			unsigned long seqnr = ksm_scan.seqnr;
+			u64 start = task_sched_runtime(current);
+			u64 batch_ns;
+			int trend = 0;
+
 			ksm_do_scan(ksm_thread_pages_to_scan);
+			batch_ns = task_sched_runtime(current) - start;
+			ksm_scan_cpu_ns += batch_ns;
+			if (seqnr != ksm_scan.seqnr)
+				trend = ksm_update_yield();
+			if (ksm_auto_tune)
+				ksm_tune_scan(batch_ns, trend);
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1966,6 +2170,96 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t use_zero_pages_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_use_zero_pages);
+}
+
+static ssize_t use_zero_pages_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = strict_strtoul(buf, 10, &value);
+	if (err || value > 1)
+		return -EINVAL;
+
+	ksm_use_zero_pages = value;
+
+	return count;
+}
+KSM_ATTR(use_zero_pages);
+
+static ssize_t zero_pages_merged_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_zero_pages_merged);
+}
+KSM_ATTR_RO(zero_pages_merged);
+
+static ssize_t volatile_skips_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_volatile_skips);
+}
+KSM_ATTR_RO(volatile_skips);
+
+static ssize_t auto_tune_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_auto_tune);
+}
+
+static ssize_t auto_tune_store(struct kobject *kobj,
+			       struct kobj_attribute *attr,
+			       const char *buf, size_t count)
+{
+	int err;
+	unsigned long value;
+
+	err = strict_strtoul(buf, 10, &value);
+	if (err || value > 1)
+		return -EINVAL;
+
+	ksm_auto_tune = value;
+
+	return count;
+}
+KSM_ATTR(auto_tune);
+
+static ssize_t max_cpu_percent_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_cpu_percent);
+}
+
+static ssize_t max_cpu_percent_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t count)
+{
+	int err;
+	unsigned long percent;
+
+	err = strict_strtoul(buf, 10, &percent);
+	if (err || !percent || percent > 100)
+		return -EINVAL;
+
+	ksm_max_cpu_percent = percent;
+
+	return count;
+}
+KSM_ATTR(max_cpu_percent);
+
+static ssize_t merge_yield_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_merge_yield);
+}
+KSM_ATTR_RO(merge_yield);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1975,6 +2269,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&use_zero_pages_attr.attr,
+	&zero_pages_merged_attr.attr,
+	&volatile_skips_attr.attr,
+	&auto_tune_attr.attr,
+	&max_cpu_percent_attr.attr,
+	&merge_yield_attr.attr,
 	NULL,
 };
 
@@ -1989,6 +2289,8 @@ static int __init ksm_init(void)
 	struct task_struct *ksm_thread;
 	int err;
 
+	zero_checksum = calc_checksum(ZERO_PAGE(0));
+
 	err = ksm_slab_init();
 	if (err)
 		goto out;
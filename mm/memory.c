@@ -2897,11 +2897,15 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		goto out;
 	}
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
-	page = lookup_swap_cache(entry);
+	page = lookup_swap_cache(entry, vma, address);
 	if (!page) {
 		grab_swap_token(mm); /* Contend for token _before_ read-in */
-		page = swapin_readahead(entry,
-					GFP_HIGHUSER_MOVABLE, vma, address);
+		if (swap_use_vma_readahead())
+			page = swap_vma_readahead(entry, GFP_HIGHUSER_MOVABLE,
+						  vma, address, pmd);
+		else
+			page = swapin_readahead(entry, GFP_HIGHUSER_MOVABLE,
+						vma, address);
 		if (!page) {
 			/*
 			 * Back out if somebody else faulted in this pte
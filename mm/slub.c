@@ -104,6 +104,15 @@
  * 			free objects in addition to the regular freelist
  * 			that requires the slab lock.
  *
+ * 			Frozen slabs are also kept on a short per cpu list
+ * 			of partial slabs (kmem_cache_cpu->partial, chained
+ * 			through page->next). Frees that make a full slab
+ * 			partial put it there and the allocation slow path
+ * 			takes from it before going to the node partial
+ * 			lists, so neither needs the node list_lock. Once
+ * 			more than s->cpu_partial objects are queued the list
+ * 			is moved to the node lists in one go.
+ *
  * PageError		Slab requires special handling due to debug
  * 			options set. This moves	slab handling out of
  * 			the fast path and disables lockless freelists.
@@ -1441,15 +1450,21 @@ static __always_inline int slab_trylock(struct page *page)
 /*
  * Management of partially allocated slabs
  */
-static void add_partial(struct kmem_cache_node *n,
+static inline void __add_partial(struct kmem_cache_node *n,
 				struct page *page, int tail)
 {
-	spin_lock(&n->list_lock);
 	n->nr_partial++;
 	if (tail)
 		list_add_tail(&page->lru, &n->partial);
 	else
 		list_add(&page->lru, &n->partial);
+}
+
+static void add_partial(struct kmem_cache_node *n,
+				struct page *page, int tail)
+{
+	spin_lock(&n->list_lock);
+	__add_partial(n, page, tail);
 	spin_unlock(&n->list_lock);
 }
 
@@ -1485,12 +1500,21 @@ static inline int lock_and_freeze_slab(struct kmem_cache_node *n,
 	return 0;
 }
 
+static void put_cpu_partial(struct kmem_cache *s, struct page *page,
+							int drain);
+
 /*
  * Try to allocate a partial slab from a specific node.
+ *
+ * The first slab found is returned locked and frozen. While we hold the
+ * list_lock anyway further slabs are frozen and moved to the per cpu
+ * partial list until about half of s->cpu_partial objects are available.
  */
-static struct page *get_partial_node(struct kmem_cache_node *n)
+static struct page *get_partial_node(struct kmem_cache *s,
+					struct kmem_cache_node *n)
 {
-	struct page *page;
+	struct page *page, *page2, *first = NULL;
+	int available = 0;
 
 	/*
 	 * Racy check. If we mistakenly see no partial slabs then we
@@ -1502,13 +1526,23 @@ static struct page *get_partial_node(struct kmem_cache_node *n)
 		return NULL;
 
 	spin_lock(&n->list_lock);
-	list_for_each_entry(page, &n->partial, lru)
-		if (lock_and_freeze_slab(n, page))
-			goto out;
-	page = NULL;
-out:
+	list_for_each_entry_safe(page, page2, &n->partial, lru) {
+		if (!lock_and_freeze_slab(n, page))
+			continue;
+
+		available += page->objects - page->inuse;
+		if (!first) {
+			first = page;
+		} else {
+			slab_unlock(page);
+			put_cpu_partial(s, page, 0);
+			stat(s, CPU_PARTIAL_NODE);
+		}
+		if (kmem_cache_debug(s) || available > s->cpu_partial / 2)
+			break;
+	}
 	spin_unlock(&n->list_lock);
-	return page;
+	return first;
 }
 
 /*
@@ -1554,7 +1588,7 @@ static struct page *get_any_partial(struct kmem_cache *s, gfp_t flags)
 
 		if (n && cpuset_zone_allowed_hardwall(zone, flags) &&
 				n->nr_partial > s->min_partial) {
-			page = get_partial_node(n);
+			page = get_partial_node(s, n);
 			if (page) {
 				put_mems_allowed();
 				return page;
@@ -1574,7 +1608,7 @@ static struct page *get_partial(struct kmem_cache *s, gfp_t flags, int node)
 	struct page *page;
 	int searchnode = (node == NUMA_NO_NODE) ? numa_node_id() : node;
 
-	page = get_partial_node(get_node(s, searchnode));
+	page = get_partial_node(s, get_node(s, searchnode));
 	if (page || node != NUMA_NO_NODE)
 		return page;
 
@@ -1628,6 +1662,97 @@ static void unfreeze_slab(struct kmem_cache *s, struct page *page, int tail)
 	}
 }
 
+/*
+ * Move the slabs on the per cpu partial list of @c back to the node
+ * partial lists, taking each node's list_lock once for consecutive slabs
+ * of the same node. Empty slabs are freed if the node has enough partial
+ * slabs already.
+ *
+ * Interrupts must be disabled and @c must belong to this cpu, or to a
+ * cpu that is offline.
+ *
+ * The slabs are frozen, so nobody holding their slab lock waits for a
+ * list_lock; taking the slab lock under the list_lock is safe here.
+ */
+static void unfreeze_partials(struct kmem_cache *s, struct kmem_cache_cpu *c)
+{
+	struct kmem_cache_node *n = NULL;
+	struct page *page, *discard_page = NULL;
+
+	while ((page = c->partial)) {
+		struct kmem_cache_node *n2 = get_node(s, page_to_nid(page));
+
+		c->partial = page->next;
+
+		if (n != n2) {
+			if (n)
+				spin_unlock(&n->list_lock);
+			n = n2;
+			spin_lock(&n->list_lock);
+		}
+
+		slab_lock(page);
+		__ClearPageSlubFrozen(page);
+		if (!page->inuse && n->nr_partial >= s->min_partial) {
+			page->next = discard_page;
+			discard_page = page;
+		} else if (page->freelist) {
+			__add_partial(n, page, 1);
+			stat(s, DEACTIVATE_TO_TAIL);
+		} else
+			stat(s, DEACTIVATE_FULL);
+		slab_unlock(page);
+	}
+
+	if (n)
+		spin_unlock(&n->list_lock);
+
+	while (discard_page) {
+		page = discard_page;
+		discard_page = page->next;
+
+		stat(s, DEACTIVATE_EMPTY);
+		stat(s, FREE_SLAB);
+		discard_slab(s, page);
+	}
+}
+
+/*
+ * Put a frozen slab onto this cpu's partial list. If @drain is set and the
+ * list already holds more than s->cpu_partial objects, it is moved to the
+ * node partial lists first.
+ *
+ * Interrupts must be disabled. The slab lock of @page must not be held.
+ */
+static void put_cpu_partial(struct kmem_cache *s, struct page *page,
+							int drain)
+{
+	struct kmem_cache_cpu *c = this_cpu_ptr(s->cpu_slab);
+	struct page *oldpage = c->partial;
+	int pages = 0;
+	int pobjects = 0;
+
+	if (oldpage) {
+		pobjects = oldpage->pobjects;
+		pages = oldpage->pages;
+		if (drain && pobjects > s->cpu_partial) {
+			unfreeze_partials(s, c);
+			stat(s, CPU_PARTIAL_DRAIN);
+			oldpage = NULL;
+			pobjects = 0;
+			pages = 0;
+		}
+	}
+
+	pages++;
+	pobjects += page->objects - page->inuse;
+
+	page->pages = pages;
+	page->pobjects = pobjects;
+	page->next = oldpage;
+	c->partial = page;
+}
+
 #ifdef CONFIG_PREEMPT
 /*
  * Calculate the next globally unique transaction for disambiguiation
@@ -1745,8 +1870,12 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	if (likely(c && c->page))
-		flush_slab(s, c);
+	if (likely(c)) {
+		if (c->page)
+			flush_slab(s, c);
+
+		unfreeze_partials(s, c);
+	}
 }
 
 static void flush_cpu_slab(void *d)
@@ -1912,6 +2041,16 @@ another_slab:
 	deactivate_slab(s, c);
 
 new_slab:
+	page = c->partial;
+	if (page && (node == NUMA_NO_NODE || page_to_nid(page) == node)) {
+		c->partial = page->next;
+		stat(s, CPU_PARTIAL_ALLOC);
+		slab_lock(page);
+		c->node = page_to_nid(page);
+		c->page = page;
+		goto load_freelist;
+	}
+
 	page = get_partial(s, gfpflags, node);
 	if (page) {
 		stat(s, ALLOC_FROM_PARTIAL);
@@ -2126,9 +2265,18 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 	/*
 	 * Objects left in the slab. If it was not on the partial list before
-	 * then add it.
+	 * then freeze it onto this cpu's partial list, or add it to the
+	 * node partial list if the cache does not keep per cpu partials.
 	 */
 	if (unlikely(!prior)) {
+		if (s->cpu_partial && !kmem_cache_debug(s)) {
+			__SetPageSlubFrozen(page);
+			slab_unlock(page);
+			put_cpu_partial(s, page, 1);
+			stat(s, CPU_PARTIAL_FREE);
+			local_irq_restore(flags);
+			return;
+		}
 		add_partial(get_node(s, page_to_nid(page)), page, 1);
 		stat(s, FREE_ADD_PARTIAL);
 	}
@@ -2665,6 +2813,35 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * list to avoid pounding the page allocator excessively.
 	 */
 	set_min_partial(s, ilog2(s->size));
+
+	/*
+	 * cpu_partial determines the maximum number of objects kept in the
+	 * per cpu partial lists of a processor.
+	 *
+	 * Per cpu partial lists mainly contain slabs that just have one
+	 * object freed. If they are used for allocation then they can be
+	 * filled up again with minimal effort. The slab will never hit the
+	 * per node partial lists and therefore no locking will be required.
+	 *
+	 * This setting also determines
+	 *
+	 * A) The number of objects from per cpu partial slabs dumped to the
+	 *    per node list when we reach the limit.
+	 * B) The number of objects in cpu partial slabs to extract from the
+	 *    per node list when we run out of per cpu objects. We only fetch
+	 *    50% to keep some capacity around for frees.
+	 */
+	if (kmem_cache_debug(s))
+		s->cpu_partial = 0;
+	else if (s->size >= PAGE_SIZE)
+		s->cpu_partial = 2;
+	else if (s->size >= 1024)
+		s->cpu_partial = 6;
+	else if (s->size >= 256)
+		s->cpu_partial = 13;
+	else
+		s->cpu_partial = 30;
+
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
 	s->remote_node_defrag_ratio = 1000;
@@ -4035,6 +4212,7 @@ static ssize_t show_slab_objects(struct kmem_cache *s,
 	int x;
 	unsigned long *nodes;
 	unsigned long *per_cpu;
+	struct page *page;
 
 	nodes = kzalloc(2 * sizeof(unsigned long) * nr_node_ids, GFP_KERNEL);
 	if (!nodes)
@@ -4061,6 +4239,14 @@ static ssize_t show_slab_objects(struct kmem_cache *s,
 				total += x;
 				nodes[c->node] += x;
 			}
+			page = c->partial;
+
+			/* Only slab counts are exact for per cpu partials */
+			if (page && !(flags & (SO_TOTAL | SO_OBJECTS))) {
+				x = page->pages;
+				total += x;
+				nodes[c->node] += x;
+			}
 			per_cpu[c->node]++;
 		}
 	}
@@ -4212,6 +4398,29 @@ static ssize_t min_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(min_partial);
 
+static ssize_t cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", s->cpu_partial);
+}
+
+static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
+				 size_t length)
+{
+	unsigned long objects;
+	int err;
+
+	err = strict_strtoul(buf, 10, &objects);
+	if (err)
+		return err;
+	if (objects && kmem_cache_debug(s))
+		return -EINVAL;
+
+	s->cpu_partial = objects;
+	flush_all(s);
+	return length;
+}
+SLAB_ATTR(cpu_partial);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -4238,6 +4447,37 @@ static ssize_t cpu_slabs_show(struct kmem_cache *s, char *buf)
 }
 SLAB_ATTR_RO(cpu_slabs);
 
+static ssize_t slabs_cpu_partial_show(struct kmem_cache *s, char *buf)
+{
+	int objects = 0;
+	int pages = 0;
+	int cpu;
+	int len;
+
+	for_each_online_cpu(cpu) {
+		struct page *page = per_cpu_ptr(s->cpu_slab, cpu)->partial;
+
+		if (page) {
+			pages += page->pages;
+			objects += page->pobjects;
+		}
+	}
+
+	len = sprintf(buf, "%d(%d)", objects, pages);
+
+#ifdef CONFIG_SMP
+	for_each_online_cpu(cpu) {
+		struct page *page = per_cpu_ptr(s->cpu_slab, cpu)->partial;
+
+		if (page && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " C%d=%d(%d)", cpu,
+				page->pobjects, page->pages);
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(slabs_cpu_partial);
+
 static ssize_t objects_show(struct kmem_cache *s, char *buf)
 {
 	return show_slab_objects(s, buf, SO_ALL|SO_OBJECTS);
@@ -4558,6 +4798,10 @@ STAT_ATTR(DEACTIVATE_TO_HEAD, deactivate_to_head);
 STAT_ATTR(DEACTIVATE_TO_TAIL, deactivate_to_tail);
 STAT_ATTR(DEACTIVATE_REMOTE_FREES, deactivate_remote_frees);
 STAT_ATTR(ORDER_FALLBACK, order_fallback);
+STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
+STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
+STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
+STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
 #endif
 
 static struct attribute *slab_attrs[] = {
@@ -4566,10 +4810,12 @@ static struct attribute *slab_attrs[] = {
 	&objs_per_slab_attr.attr,
 	&order_attr.attr,
 	&min_partial_attr.attr,
+	&cpu_partial_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
 	&cpu_slabs_attr.attr,
+	&slabs_cpu_partial_attr.attr,
 	&ctor_attr.attr,
 	&aliases_attr.attr,
 	&align_attr.attr,
@@ -4615,6 +4861,10 @@ static struct attribute *slab_attrs[] = {
 	&deactivate_to_tail_attr.attr,
 	&deactivate_remote_frees_attr.attr,
 	&order_fallback_attr.attr,
+	&cpu_partial_alloc_attr.attr,
+	&cpu_partial_free_attr.attr,
+	&cpu_partial_node_attr.attr,
+	&cpu_partial_drain_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
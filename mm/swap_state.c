@@ -133,6 +133,9 @@ void __delete_from_swap_cache(struct page *page)
 	total_swapcache_pages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
 	INC_CACHE_INFO(del_total);
+	/* Read ahead, but dropped again before anybody faulted it in */
+	if (TestClearPageReadahead(page))
+		__count_vm_event(SWAP_RA_WASTED);
 }
 
 /**
@@ -254,33 +257,91 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * VMA based swap readahead keeps its state in vma->swap_readahead_info:
+ * the page aligned address of the last swap fault, the readahead window
+ * used for it, and the number of readahead hits seen since, packed into
+ * the low bits below the address.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* Start a fresh vma with a few hits, so that the first window is small */
+#define GET_SWAP_RA_VAL(vma)					\
+	(atomic_long_read(&(vma)->swap_readahead_info) ? : 4)
+
+/* The PTEs of the window are copied to the stack, so keep it bounded */
+#ifdef CONFIG_64BIT
+#define SWAP_RA_ORDER_CEILING	5
+#else
+#define SWAP_RA_ORDER_CEILING	3
+#endif
+#define SWAP_RA_PTE_MAX		(1 << SWAP_RA_ORDER_CEILING)
+
+int swap_vma_readahead_enabled __read_mostly = 1;
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * If @vma is given, a hit on a page brought in by readahead is credited
+ * to the readahead window of @vma, and @addr is remembered as the last
+ * fault address.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
+		int readahead;
+
 		INC_CACHE_INFO(find_success);
+		/* PG_readahead is PG_reclaim, leave pages under writeback be */
+		readahead = !PageWriteback(page) && TestClearPageReadahead(page);
+		if (vma) {
+			unsigned long ra_val = GET_SWAP_RA_VAL(vma);
+			unsigned long win = SWAP_RA_WIN(ra_val);
+			unsigned long hits = SWAP_RA_HITS(ra_val);
+
+			if (readahead)
+				hits = min_t(unsigned long, hits + 1,
+					     SWAP_RA_HITS_MAX);
+			atomic_long_set(&vma->swap_readahead_info,
+					SWAP_RA_VAL(addr, win, hits));
+		}
+		if (readahead)
+			count_vm_event(SWAP_RA_HIT);
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-/* 
+/*
  * Locate a page of swap in physical memory, reserving swap cache space
- * and reading the disk if it is not already cached.
- * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+ * and reading the disk if it is not already cached.  A page newly read
+ * on behalf of @readahead is marked PG_readahead, so that a later fault
+ * or its removal from the swap cache tells whether the read was useful.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			int readahead)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -334,6 +395,10 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 * Initiate read into locked page and return.
 			 */
 			lru_cache_add_anon(new_page);
+			if (readahead) {
+				SetPageReadahead(new_page);
+				count_vm_event(SWAP_RA);
+			}
 			swap_readpage(new_page);
 			return new_page;
 		}
@@ -352,6 +417,18 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+/* 
+ * Locate a page of swap in physical memory, reserving swap cache space
+ * and reading the disk if it is not already cached.
+ * A failure return means that either the page allocation failed or that
+ * the swap entry is no longer in use.
+ */
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, 0);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -389,8 +466,9 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(swp_entry(swp_type(entry), offset),
+					gfp_mask, vma, addr,
+					offset != swp_offset(entry));
 		if (!page)
 			break;
 		page_cache_release(page);
@@ -398,3 +476,133 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the next readahead window from the hits the previous one got.
+ * Without any hits, only read around when the fault is next to the
+ * previous one; never shrink by more than half at a time.
+ */
+static unsigned int __swapin_nr_pages(unsigned long prev_pfn,
+				      unsigned long pfn, unsigned int hits,
+				      unsigned int max_pages,
+				      unsigned int prev_win)
+{
+	unsigned int pages, last_ra;
+
+	pages = hits + 2;
+	if (pages == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			pages = 1;
+	} else {
+		unsigned int roundup = 4;
+
+		while (roundup < pages)
+			roundup <<= 1;
+		pages = roundup;
+	}
+
+	if (pages > max_pages)
+		pages = max_pages;
+
+	last_ra = prev_win / 2;
+	if (pages < last_ra)
+		pages = last_ra;
+
+	return pages;
+}
+
+/* Keep the window inside the vma and the page table of the fault */
+static void swap_ra_clamp_pfn(struct vm_area_struct *vma, unsigned long faddr,
+			      unsigned long lpfn, unsigned long rpfn,
+			      unsigned long *start, unsigned long *end)
+{
+	*start = max3(lpfn, PFN_DOWN(vma->vm_start),
+		      PFN_DOWN(faddr & PMD_MASK));
+	*end = min3(rpfn, PFN_DOWN(vma->vm_end),
+		    PFN_DOWN((faddr & PMD_MASK) + PMD_SIZE));
+}
+
+/**
+ * swap_vma_readahead - swap in pages of the vma around the fault
+ * @fentry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the fault address belongs to
+ * @addr: the fault address
+ * @pmd: pmd mapping the page table of @addr
+ *
+ * Returns the struct page for @fentry and @addr, after queueing swapin.
+ *
+ * Unlike swapin_readahead(), which reads the swap slots next to @fentry
+ * whoever they belong to, this reads the swap entries of the ptes next
+ * to @addr in @vma.  The window follows the direction of the faults and
+ * grows or shrinks with the readahead hits recorded by
+ * lookup_swap_cache(), up to 1 << page_cluster pages.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd)
+{
+	pte_t ptes[SWAP_RA_PTE_MAX], *pte;
+	unsigned long ra_val, fpfn, pfn, start, end, left;
+	unsigned int max_win, hits, prev_win, win;
+	struct page *page;
+	swp_entry_t entry;
+	int i, nr_pte;
+
+	max_win = 1 << min_t(unsigned int, page_cluster, SWAP_RA_ORDER_CEILING);
+	fpfn = PFN_DOWN(addr);
+	ra_val = GET_SWAP_RA_VAL(vma);
+	pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	prev_win = SWAP_RA_WIN(ra_val);
+	hits = SWAP_RA_HITS(ra_val);
+	win = max_win == 1 ? 1 :
+		__swapin_nr_pages(pfn, fpfn, hits, max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+
+	if (win == 1)
+		goto skip;
+
+	if (fpfn == pfn + 1) {
+		/* Walking forward */
+		swap_ra_clamp_pfn(vma, addr, fpfn, fpfn + win, &start, &end);
+	} else if (pfn == fpfn + 1) {
+		/* Walking backward */
+		swap_ra_clamp_pfn(vma, addr, fpfn >= win ? fpfn - win + 1 : 0,
+				  fpfn + 1, &start, &end);
+	} else {
+		left = (win - 1) / 2;
+		swap_ra_clamp_pfn(vma, addr, fpfn >= left ? fpfn - left : 0,
+				  fpfn + win - left, &start, &end);
+	}
+
+	/*
+	 * Reading swap may sleep, so take a copy of the ptes rather than
+	 * keeping the page table mapped; entries that change under us are
+	 * caught by swapcache_prepare() as usual.
+	 */
+	nr_pte = end - start;
+	pte = pte_offset_map(pmd, start << PAGE_SHIFT);
+	for (i = 0; i < nr_pte; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < nr_pte; i++) {
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		page = __read_swap_cache_async(entry, gfp_mask, vma,
+					       (start + i) << PAGE_SHIFT,
+					       start + i != fpfn);
+		if (!page)
+			continue;
+		page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, addr);
+}
@@ -613,6 +613,9 @@ static char * const migratetype_names[MIGRATE_TYPES] = {
 	"Reclaimable",
 	"Movable",
 	"Reserve",
+#ifdef CONFIG_CMA
+	"CMA",
+#endif
 	"Isolate",
 };
 
@@ -736,6 +739,12 @@ const char * const vmstat_text[] = {
 	"pgfault",
 	"pgmajfault",
 
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+	"swap_ra_wasted",
+#endif
+
 	TEXTS_FOR_ZONES("pgrefill")
 	TEXTS_FOR_ZONES("pgsteal")
 	TEXTS_FOR_ZONES("pgscan_kswapd")
@@ -765,6 +774,11 @@ const char * const vmstat_text[] = {
 	"compact_success",
 #endif
 
+#ifdef CONFIG_CMA
+	"cma_migrate_success",
+	"cma_migrate_fail",
+#endif
+
 #ifdef CONFIG_HUGETLB_PAGE
 	"htlb_buddy_alloc_success",
 	"htlb_buddy_alloc_fail",
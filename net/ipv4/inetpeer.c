@@ -526,6 +526,10 @@ found:		/* The existing node has been found.
 		p->pmtu_expires = 0;
 		p->pmtu_orig = 0;
 		memset(&p->redirect_learned, 0, sizeof(p->redirect_learned));
+		p->tfo_mss = 0;
+		p->tfo_syn_loss = 0;
+		p->tfo_last_syn_loss = 0;
+		p->tfo_cookie_len = 0;
 		INIT_LIST_HEAD(&p->unused);
 
 
@@ -0,0 +1,187 @@
+/*
+ * TCP Fast Open (draft-ietf-tcpm-fastopen)
+ *
+ * Server side: the cookie handed to a client is the AES encryption of
+ * its IPv4 address under a kernel key, so that it can be validated on
+ * a later SYN without keeping any per-client state.
+ *
+ * Client side: the cookie (and the MSS) received from a server is kept
+ * in the inet_peer entry of the destination, together with a record of
+ * lost data-carrying SYNs so that we stop trying against middleboxes
+ * which drop them.
+ */
+
+#include <linux/crypto.h>
+#include <linux/cache.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/random.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+struct tcp_fastopen_context __rcu *tcp_fastopen_ctx;
+static DEFINE_SPINLOCK(tcp_fastopen_ctx_lock);
+
+/* Protects the tfo_* fields of all inet_peer entries. */
+static DEFINE_SEQLOCK(tcp_fastopen_seqlock);
+
+static void tcp_fastopen_ctx_free(struct rcu_head *head)
+{
+	struct tcp_fastopen_context *ctx =
+		container_of(head, struct tcp_fastopen_context, rcu);
+
+	crypto_free_cipher(ctx->tfm);
+	kfree(ctx);
+}
+
+int tcp_fastopen_reset_cipher(void *key, unsigned int len)
+{
+	struct tcp_fastopen_context *ctx, *octx;
+	int err;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->tfm = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(ctx->tfm)) {
+		err = PTR_ERR(ctx->tfm);
+		goto error;
+	}
+	err = crypto_cipher_setkey(ctx->tfm, key, len);
+	if (err) {
+		crypto_free_cipher(ctx->tfm);
+		goto error;
+	}
+	memcpy(ctx->key, key, len);
+
+	spin_lock(&tcp_fastopen_ctx_lock);
+	octx = rcu_dereference_protected(tcp_fastopen_ctx,
+				lockdep_is_held(&tcp_fastopen_ctx_lock));
+	rcu_assign_pointer(tcp_fastopen_ctx, ctx);
+	spin_unlock(&tcp_fastopen_ctx_lock);
+
+	if (octx)
+		call_rcu(&octx->rcu, tcp_fastopen_ctx_free);
+	return 0;
+
+error:
+	kfree(ctx);
+	pr_err("TCP: TFO cipher setup failed (%d)\n", err);
+	return err;
+}
+
+/* Computes the fastopen cookie for the peer address.
+ * XXX: IPv4 only, the key covers a single AES block.
+ */
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	__be32 peer_addr[4] = { addr, 0, 0, 0 };
+	struct tcp_fastopen_context *ctx;
+
+	rcu_read_lock();
+	ctx = rcu_dereference(tcp_fastopen_ctx);
+	if (ctx) {
+		crypto_cipher_encrypt_one(ctx->tfm, foc->val,
+					  (__u8 *)peer_addr);
+		foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+	}
+	rcu_read_unlock();
+}
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct inet_peer *peer;
+	bool release_it;
+	unsigned int seq;
+
+	peer = icsk->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer) {
+		*syn_loss = 0;
+		return;
+	}
+
+	do {
+		seq = read_seqbegin(&tcp_fastopen_seqlock);
+		if (peer->tfo_mss)
+			*mss = peer->tfo_mss;
+		cookie->len = peer->tfo_cookie_len;
+		memcpy(cookie->val, peer->tfo_cookie, sizeof(cookie->val));
+		*syn_loss = peer->tfo_syn_loss;
+		*last_syn_loss = *syn_loss ? peer->tfo_last_syn_loss : 0;
+	} while (read_seqretry(&tcp_fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = icsk->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&tcp_fastopen_seqlock);
+	peer->tfo_mss = mss;
+	if (cookie->len > 0) {
+		peer->tfo_cookie_len = cookie->len;
+		memcpy(peer->tfo_cookie, cookie->val, cookie->len);
+	}
+	if (syn_lost) {
+		peer->tfo_syn_loss++;
+		peer->tfo_last_syn_loss = jiffies;
+	} else {
+		peer->tfo_syn_loss = 0;
+	}
+	write_sequnlock_bh(&tcp_fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+/* Called once the 3WHS of a passively opened Fast Open child has
+ * completed or the child is being closed: the listener no longer needs
+ * to account for it.  The request_sock is freed here if accept() has
+ * already taken the child, otherwise accept() frees it.
+ */
+void tcp_fastopen_remove_req(struct sock *sk, struct request_sock *req)
+{
+	struct sock *lsk = tcp_rsk(req)->listener;
+	struct request_sock_queue *queue = &inet_csk(lsk)->icsk_accept_queue;
+	bool accepted;
+
+	tcp_sk(sk)->fastopen_rsk = NULL;
+
+	write_lock_bh(&queue->syn_wait_lock);
+	queue->fastopenq.qlen--;
+	tcp_rsk(req)->listener = NULL;
+	accepted = req->sk == NULL;
+	write_unlock_bh(&queue->syn_wait_lock);
+
+	if (accepted)
+		reqsk_free(req);
+	sock_put(lsk);
+}
+
+static int __init tcp_fastopen_init(void)
+{
+	__u8 key[TCP_FASTOPEN_KEY_LENGTH];
+
+	get_random_bytes(key, sizeof(key));
+	tcp_fastopen_reset_cipher(key, sizeof(key));
+	return 0;
+}
+
+late_initcall(tcp_fastopen_init);
@@ -22,6 +22,11 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/workqueue.h>
+#include <linux/hardirq.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,13 +39,18 @@
 #include "classmap.h"
 
 #define AVC_CACHE_SLOTS			512
+#define AVC_MAX_CACHE_SLOTS		8192
+#define AVC_RULES_PER_SLOT		16
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_HOT_ENTRIES			16
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
+#define avc_cache_stats_add(field, num)	this_cpu_add(avc_cache_stats.field, num)
 #else
 #define avc_cache_stats_incr(field)	do {} while (0)
+#define avc_cache_stats_add(field, num)	do {} while (0)
 #endif
 
 struct avc_entry {
@@ -56,14 +66,38 @@ struct avc_node {
 	struct rcu_head		rhead;
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
+struct avc_table {
+	u32			mask;	/* number of slots - 1 */
+	struct avc_slot		slots[0];
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_table __rcu	*table;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
+	atomic_t		hot_gen;	/* bumped whenever a decision changes */
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * Copies of the decisions most recently used on this CPU.  An entry is
+ * only valid while its gen matches avc_cache.hot_gen, so changing or
+ * flushing any cached decision invalidates all of them at once.
+ */
+struct avc_hot_entry {
+	u32			gen;
+	struct avc_entry	ae;
+};
+
+struct avc_hot_cache {
+	struct avc_hot_entry	entries[AVC_HOT_ENTRIES];
+};
+
 struct avc_callback_node {
 	int (*callback) (u32 event, u32 ssid, u32 tsid,
 			 u16 tclass, u32 perms,
@@ -79,6 +113,9 @@ struct avc_callback_node {
 /* Exported via selinufs */
 unsigned int avc_cache_threshold = AVC_DEF_CACHE_THRESHOLD;
 
+/* The threshold last chosen by avc_ss_resize() */
+static unsigned int avc_auto_threshold = AVC_DEF_CACHE_THRESHOLD;
+
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
@@ -86,10 +123,50 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
+static DEFINE_PER_CPU(struct avc_hot_cache, avc_hot_cache);
+
+static void avc_reclaim_work_fn(struct work_struct *work);
+static DECLARE_WORK(avc_reclaim_work, avc_reclaim_work_fn);
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline u32 avc_hash(u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return ssid ^ (tsid<<2) ^ (tclass<<4);
+}
+
+static inline struct avc_slot *avc_slot(struct avc_table *table,
+					u32 ssid, u32 tsid, u16 tclass)
+{
+	return &table->slots[avc_hash(ssid, tsid, tclass) & table->mask];
+}
+
+static struct avc_table *avc_table_alloc(u32 nslots)
+{
+	struct avc_table *table;
+	size_t size;
+	u32 i;
+
+	size = sizeof(*table) + nslots * sizeof(table->slots[0]);
+	if (size <= PAGE_SIZE)
+		table = kzalloc(size, GFP_KERNEL);
+	else
+		table = vzalloc(size);
+	if (!table)
+		return NULL;
+
+	table->mask = nslots - 1;
+	for (i = 0; i < nslots; i++) {
+		INIT_HLIST_HEAD(&table->slots[i].head);
+		spin_lock_init(&table->slots[i].lock);
+	}
+	return table;
+}
+
+static void avc_table_free(struct avc_table *table)
+{
+	if (is_vmalloc_addr(table))
+		vfree(table);
+	else
+		kfree(table);
 }
 
 /**
@@ -166,14 +243,17 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  */
 void __init avc_init(void)
 {
-	int i;
+	struct avc_table *table;
+
+	table = avc_table_alloc(AVC_CACHE_SLOTS);
+	if (!table)
+		panic("SELinux:  unable to allocate the AVC\n");
+	RCU_INIT_POINTER(avc_cache.table, table);
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
-	}
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
+	/* Zeroed hot cache entries carry gen 0 and so start out invalid. */
+	atomic_set(&avc_cache.hot_gen, 1);
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					     0, SLAB_PANIC, NULL);
@@ -183,16 +263,19 @@ void __init avc_init(void)
 
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, chain_len, max_chain_len, slots_used, nslots;
+	struct avc_table *table;
 	struct avc_node *node;
 	struct hlist_head *head;
 
 	rcu_read_lock();
 
+	table = rcu_dereference(avc_cache.table);
+	nslots = table->mask + 1;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < nslots; i++) {
+		head = &table->slots[i].head;
 		if (!hlist_empty(head)) {
 			struct hlist_node *next;
 
@@ -210,7 +293,67 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, nslots, max_chain_len);
+}
+
+/*
+ * Invalidate every decision held in the per-CPU hot caches.  Callers
+ * change or remove the cached decision first, so that a lookup which
+ * sees the new generation also sees the new state of the cache.
+ */
+static inline void avc_hot_invalidate(void)
+{
+	smp_mb__before_atomic_inc();
+	atomic_inc(&avc_cache.hot_gen);
+}
+
+static inline u32 avc_hot_gen(void)
+{
+	u32 gen = atomic_read(&avc_cache.hot_gen);
+
+	smp_rmb();
+	return gen;
+}
+
+/*
+ * The hot caches are only used from process context: a lookup from an
+ * interrupt could otherwise see an entry half-written by the task it
+ * interrupted.
+ */
+static inline int avc_hot_lookup(u32 gen, u32 ssid, u32 tsid, u16 tclass,
+				 struct av_decision *avd)
+{
+	struct avc_hot_entry *e;
+	int hit = 0;
+
+	if (in_interrupt())
+		return 0;
+
+	e = &get_cpu_var(avc_hot_cache).entries[avc_hash(ssid, tsid, tclass) &
+						(AVC_HOT_ENTRIES - 1)];
+	if (e->gen == gen && e->ae.ssid == ssid && e->ae.tsid == tsid &&
+	    e->ae.tclass == tclass) {
+		memcpy(avd, &e->ae.avd, sizeof(*avd));
+		hit = 1;
+	}
+	put_cpu_var(avc_hot_cache);
+
+	return hit;
+}
+
+static inline void avc_hot_fill(u32 gen, struct avc_entry *ae)
+{
+	struct avc_hot_entry *e;
+
+	if (in_interrupt())
+		return;
+
+	e = &get_cpu_var(avc_hot_cache).entries[avc_hash(ae->ssid, ae->tsid,
+							 ae->tclass) &
+						(AVC_HOT_ENTRIES - 1)];
+	e->gen = gen;
+	memcpy(&e->ae, ae, sizeof(e->ae));
+	put_cpu_var(avc_hot_cache);
 }
 
 static void avc_node_free(struct rcu_head *rhead)
@@ -241,44 +384,56 @@ static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 	atomic_dec(&avc_cache.active_nodes);
 }
 
-static inline int avc_reclaim_node(void)
+static int avc_reclaim_node(void)
 {
+	struct avc_table *table;
 	struct avc_node *node;
-	int hvalue, try, ecx;
+	int hvalue, try, ecx, nslots;
 	unsigned long flags;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	rcu_read_lock();
+	table = rcu_dereference(avc_cache.table);
+	nslots = table->mask + 1;
+	for (try = 0, ecx = 0; try < nslots; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) & table->mask;
+		head = &table->slots[hvalue].head;
+		lock = &table->slots[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
 
-		rcu_read_lock();
 		hlist_for_each_entry(node, next, head, list) {
 			avc_node_delete(node);
 			avc_cache_stats_incr(reclaims);
 			ecx++;
 			if (ecx >= AVC_CACHE_RECLAIM) {
-				rcu_read_unlock();
 				spin_unlock_irqrestore(lock, flags);
 				goto out;
 			}
 		}
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	rcu_read_unlock();
 	return ecx;
 }
 
+static void avc_reclaim_work_fn(struct work_struct *work)
+{
+	while (atomic_read(&avc_cache.active_nodes) > avc_cache_threshold) {
+		if (!avc_reclaim_node())
+			break;
+		cond_resched();
+	}
+}
+
 static struct avc_node *avc_alloc_node(void)
 {
 	struct avc_node *node;
+	unsigned int active;
 
 	node = kmem_cache_zalloc(avc_node_cachep, GFP_ATOMIC);
 	if (!node)
@@ -287,8 +442,19 @@ static struct avc_node *avc_alloc_node(void)
 	INIT_HLIST_NODE(&node->list);
 	avc_cache_stats_incr(allocations);
 
-	if (atomic_inc_return(&avc_cache.active_nodes) > avc_cache_threshold)
-		avc_reclaim_node();
+	/*
+	 * Reclaim is left to a worker so that it stays out of the permission
+	 * check; only reclaim here before workqueues are up, or when the
+	 * worker has fallen far enough behind that the cache would grow
+	 * without bound.
+	 */
+	active = atomic_inc_return(&avc_cache.active_nodes);
+	if (active > avc_cache_threshold) {
+		if (!keventd_up() || active / 2 > avc_cache_threshold)
+			avc_reclaim_node();
+		else
+			schedule_work(&avc_reclaim_work);
+	}
 
 out:
 	return node;
@@ -305,12 +471,11 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
 	struct avc_node *node, *ret = NULL;
-	int hvalue;
 	struct hlist_head *head;
 	struct hlist_node *next;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	head = &avc_slot(rcu_dereference(avc_cache.table),
+			 ssid, tsid, tclass)->head;
 	hlist_for_each_entry_rcu(node, next, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -391,7 +556,7 @@ static int avc_latest_notif_update(int seqno, int is_insert)
 static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_decision *avd)
 {
 	struct avc_node *pos, *node = NULL;
-	int hvalue;
+	struct avc_slot *slot;
 	unsigned long flag;
 
 	if (avc_latest_notif_update(avd->seqno, 1))
@@ -403,11 +568,12 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 		struct hlist_node *next;
 		spinlock_t *lock;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		slot = avc_slot(rcu_dereference(avc_cache.table),
+				ssid, tsid, tclass);
+		head = &slot->head;
+		lock = &slot->lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, next, head, list) {
@@ -415,6 +581,7 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 			    pos->ae.tsid == tsid &&
 			    pos->ae.tclass == tclass) {
 				avc_node_replace(node, pos);
+				avc_hot_invalidate();
 				goto found;
 			}
 		}
@@ -603,9 +770,10 @@ static inline int avc_sidcmp(u32 x, u32 y)
 static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 			   u32 seqno)
 {
-	int hvalue, rc = 0;
+	int rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_slot *slot;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
@@ -617,10 +785,9 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
-
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	slot = avc_slot(rcu_dereference(avc_cache.table), ssid, tsid, tclass);
+	head = &slot->head;
+	lock = &slot->lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -668,6 +835,7 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 		break;
 	}
 	avc_node_replace(node, orig);
+	avc_hot_invalidate();
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
 out:
@@ -679,28 +847,82 @@ out:
  */
 static void avc_flush(void)
 {
+	struct avc_table *table;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	struct avc_node *node;
 	spinlock_t *lock;
 	unsigned long flag;
-	int i;
+	u32 i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	/*
+	 * With preemptable RCU, the slot spinlocks do not prevent RCU
+	 * grace periods from ending, and the table itself may be replaced
+	 * by avc_ss_resize().
+	 */
+	rcu_read_lock();
+	table = rcu_dereference(avc_cache.table);
+	for (i = 0; i <= table->mask; i++) {
+		head = &table->slots[i].head;
+		lock = &table->slots[i].lock;
 
 		spin_lock_irqsave(lock, flag);
-		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
-		 */
-		rcu_read_lock();
 		hlist_for_each_entry(node, next, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	rcu_read_unlock();
+	avc_hot_invalidate();
+}
+
+/**
+ * avc_ss_resize - Size the cache for a newly loaded policy.
+ * @nrules: number of type enforcement rules in the policy
+ *
+ * Larger policies have more domains and so more live decisions; give
+ * them more hash slots, and scale the reclaim threshold along with the
+ * slots unless it was set through selinuxfs.  Called from the policy
+ * load path, which is serialised, before avc_ss_reset().
+ */
+void avc_ss_resize(u32 nrules)
+{
+	struct avc_table *table, *old;
+	struct hlist_node *pos, *next;
+	struct avc_node *node;
+	u32 nslots, i;
+
+	nslots = clamp_t(u32, nrules / AVC_RULES_PER_SLOT,
+			 AVC_CACHE_SLOTS, AVC_MAX_CACHE_SLOTS);
+	nslots = roundup_pow_of_two(nslots);
+
+	old = rcu_dereference_protected(avc_cache.table, 1);
+	if (old->mask + 1 == nslots)
+		return;
+
+	table = avc_table_alloc(nslots);
+	if (!table) {
+		printk(KERN_WARNING "SELinux: avc:  unable to resize cache "
+		       "to %u slots\n", nslots);
+		return;
+	}
+
+	rcu_assign_pointer(avc_cache.table, table);
+	if (avc_cache_threshold == avc_auto_threshold)
+		avc_cache_threshold = nslots;
+	avc_auto_threshold = nslots;
+
+	/* All walkers of the old table do so under rcu_read_lock(). */
+	synchronize_rcu();
+
+	for (i = 0; i <= old->mask; i++) {
+		hlist_for_each_entry_safe(node, pos, next, &old->slots[i].head,
+					  list) {
+			hlist_del(&node->list);
+			avc_node_kill(node);
+		}
+	}
+	avc_table_free(old);
+	avc_hot_invalidate();
 }
 
 /**
@@ -729,6 +951,23 @@ int avc_ss_reset(u32 seqno)
 	return rc;
 }
 
+/*
+ * Ask the security server for a decision on a cache miss, and account
+ * the time it took in the cache statistics.
+ */
+static noinline void avc_compute_av(u32 ssid, u32 tsid, u16 tclass,
+				    struct av_decision *avd)
+{
+#ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
+	u64 start = local_clock();
+
+	security_compute_av(ssid, tsid, tclass, avd);
+	avc_cache_stats_add(miss_ns, local_clock() - start);
+#else
+	security_compute_av(ssid, tsid, tclass, avd);
+#endif
+}
+
 /**
  * avc_has_perm_noaudit - Check permissions but perform no auditing.
  * @ssid: source security identifier
@@ -756,23 +995,34 @@ int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 {
 	struct avc_node *node;
 	int rc = 0;
-	u32 denied;
+	u32 denied, gen;
 
 	BUG_ON(!requested);
 
+	gen = avc_hot_gen();
+
 	rcu_read_lock();
 
+	if (avc_hot_lookup(gen, ssid, tsid, tclass, avd)) {
+		avc_cache_stats_incr(lookups);
+		avc_cache_stats_incr(hot_hits);
+		goto check;
+	}
+
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node)) {
 		rcu_read_unlock();
-		security_compute_av(ssid, tsid, tclass, avd);
+		avc_compute_av(ssid, tsid, tclass, avd);
 		rcu_read_lock();
 		node = avc_insert(ssid, tsid, tclass, avd);
 	} else {
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
 		avd = &node->ae.avd;
 	}
+	if (node)
+		avc_hot_fill(gen, &node->ae);
 
+check:
 	denied = requested & ~(avd->allowed);
 
 	if (denied) {
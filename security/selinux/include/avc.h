@@ -45,6 +45,8 @@ struct avc_cache_stats {
 	unsigned int allocations;
 	unsigned int reclaims;
 	unsigned int frees;
+	u64 miss_ns;		/* time spent computing missed decisions */
+	unsigned int hot_hits;	/* lookups served from the per-CPU cache */
 };
 
 /*
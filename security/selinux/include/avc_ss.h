@@ -9,6 +9,7 @@
 #include "flask.h"
 
 int avc_ss_reset(u32 seqno);
+void avc_ss_resize(u32 nrules);
 
 /* Class/perm mapping support */
 struct security_class_mapping {
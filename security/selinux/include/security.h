@@ -88,6 +88,8 @@ int security_mls_enabled(void);
 int security_load_policy(void *data, size_t len);
 int security_read_policy(void **data, size_t *len);
 size_t security_policydb_len(void);
+int security_sidtab_hash_stats(char *page);
+int security_avtab_hash_stats(char *page);
 
 int security_policycap_supported(unsigned int req_cap);
 
@@ -1427,14 +1427,15 @@ static int sel_avc_stats_seq_show(struct seq_file *seq, void *v)
 
 	if (v == SEQ_START_TOKEN)
 		seq_printf(seq, "lookups hits misses allocations reclaims "
-			   "frees\n");
+			   "frees miss_ns hot_hits\n");
 	else {
 		unsigned int lookups = st->lookups;
 		unsigned int misses = st->misses;
 		unsigned int hits = lookups - misses;
-		seq_printf(seq, "%u %u %u %u %u %u\n", lookups,
+		seq_printf(seq, "%u %u %u %u %u %u %llu %u\n", lookups,
 			   hits, misses, st->allocations,
-			   st->reclaims, st->frees);
+			   st->reclaims, st->frees,
+			   (unsigned long long)st->miss_ns, st->hot_hits);
 	}
 	return 0;
 }
@@ -1494,6 +1495,80 @@ static int sel_make_avc_files(struct dentry *dir)
 	return 0;
 }
 
+static ssize_t sel_read_sidtab_hash_stats(struct file *filp, char __user *buf,
+					  size_t count, loff_t *ppos)
+{
+	char *page;
+	ssize_t length;
+
+	page = (char *)__get_free_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	length = security_sidtab_hash_stats(page);
+	if (length >= 0)
+		length = simple_read_from_buffer(buf, count, ppos, page, length);
+	free_page((unsigned long)page);
+
+	return length;
+}
+
+static const struct file_operations sel_sidtab_hash_stats_ops = {
+	.read		= sel_read_sidtab_hash_stats,
+	.llseek		= generic_file_llseek,
+};
+
+static ssize_t sel_read_avtab_hash_stats(struct file *filp, char __user *buf,
+					 size_t count, loff_t *ppos)
+{
+	char *page;
+	ssize_t length;
+
+	page = (char *)__get_free_page(GFP_KERNEL);
+	if (!page)
+		return -ENOMEM;
+
+	length = security_avtab_hash_stats(page);
+	if (length >= 0)
+		length = simple_read_from_buffer(buf, count, ppos, page, length);
+	free_page((unsigned long)page);
+
+	return length;
+}
+
+static const struct file_operations sel_avtab_hash_stats_ops = {
+	.read		= sel_read_avtab_hash_stats,
+	.llseek		= generic_file_llseek,
+};
+
+static int sel_make_ss_files(struct dentry *dir)
+{
+	int i;
+	static struct tree_descr files[] = {
+		{ "sidtab_hash_stats", &sel_sidtab_hash_stats_ops, S_IRUGO },
+		{ "avtab_hash_stats", &sel_avtab_hash_stats_ops, S_IRUGO },
+	};
+
+	for (i = 0; i < ARRAY_SIZE(files); i++) {
+		struct inode *inode;
+		struct dentry *dentry;
+
+		dentry = d_alloc_name(dir, files[i].name);
+		if (!dentry)
+			return -ENOMEM;
+
+		inode = sel_make_inode(dir->d_sb, S_IFREG|files[i].mode);
+		if (!inode)
+			return -ENOMEM;
+
+		inode->i_fop = files[i].ops;
+		inode->i_ino = ++sel_last_ino;
+		d_add(dentry, inode);
+	}
+
+	return 0;
+}
+
 static ssize_t sel_read_initcon(struct file *file, char __user *buf,
 				size_t count, loff_t *ppos)
 {
@@ -1894,6 +1969,19 @@ static int sel_fill_super(struct super_block *sb, void *data, int silent)
 	if (ret)
 		goto err;
 
+	ret = -ENOMEM;
+	dentry = d_alloc_name(sb->s_root, "ss");
+	if (!dentry)
+		goto err;
+
+	ret = sel_make_dir(root_inode, dentry, &sel_last_ino);
+	if (ret)
+		goto err;
+
+	ret = sel_make_ss_files(dentry);
+	if (ret)
+		goto err;
+
 	ret = -ENOMEM;
 	dentry = d_alloc_name(sb->s_root, "initial_contexts");
 	if (!dentry)
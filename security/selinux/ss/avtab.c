@@ -20,15 +20,16 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/errno.h>
+#include <linux/jhash.h>
 #include "avtab.h"
 #include "policydb.h"
 
 static struct kmem_cache *avtab_node_cachep;
 
-static inline int avtab_hash(struct avtab_key *keyp, u16 mask)
+static inline int avtab_hash(struct avtab_key *keyp, u32 mask)
 {
-	return ((keyp->target_class + (keyp->target_type << 2) +
-		 (keyp->source_type << 9)) & mask);
+	return jhash_3words(keyp->source_type, keyp->target_type,
+			    keyp->target_class, 0) & mask;
 }
 
 static struct avtab_node*
@@ -251,7 +252,7 @@ int avtab_init(struct avtab *h)
 
 int avtab_alloc(struct avtab *h, u32 nrules)
 {
-	u16 mask = 0;
+	u32 mask = 0;
 	u32 shift = 0;
 	u32 work = nrules;
 	u32 nslot = 0;
@@ -259,12 +260,11 @@ int avtab_alloc(struct avtab *h, u32 nrules)
 	if (nrules == 0)
 		goto avtab_alloc_out;
 
+	/* At least one slot per rule, so that chains stay about one long. */
 	while (work) {
 		work  = work >> 1;
 		shift++;
 	}
-	if (shift > 2)
-		shift = shift - 2;
 	nslot = 1 << shift;
 	if (nslot > MAX_AVTAB_HASH_BUCKETS)
 		nslot = MAX_AVTAB_HASH_BUCKETS;
@@ -283,30 +283,39 @@ int avtab_alloc(struct avtab *h, u32 nrules)
 	return 0;
 }
 
-void avtab_hash_eval(struct avtab *h, char *tag)
+static void avtab_chain_stats(struct avtab *h, int *slots_used,
+			      int *max_chain_len,
+			      unsigned long long *chain2_len_sum)
 {
-	int i, chain_len, slots_used, max_chain_len;
-	unsigned long long chain2_len_sum;
+	int i, chain_len;
 	struct avtab_node *cur;
 
-	slots_used = 0;
-	max_chain_len = 0;
-	chain2_len_sum = 0;
+	*slots_used = 0;
+	*max_chain_len = 0;
+	*chain2_len_sum = 0;
 	for (i = 0; i < h->nslot; i++) {
 		cur = h->htable[i];
 		if (cur) {
-			slots_used++;
+			(*slots_used)++;
 			chain_len = 0;
 			while (cur) {
 				chain_len++;
 				cur = cur->next;
 			}
 
-			if (chain_len > max_chain_len)
-				max_chain_len = chain_len;
-			chain2_len_sum += chain_len * chain_len;
+			if (chain_len > *max_chain_len)
+				*max_chain_len = chain_len;
+			*chain2_len_sum += chain_len * chain_len;
 		}
 	}
+}
+
+void avtab_hash_eval(struct avtab *h, char *tag)
+{
+	int slots_used, max_chain_len;
+	unsigned long long chain2_len_sum;
+
+	avtab_chain_stats(h, &slots_used, &max_chain_len, &chain2_len_sum);
 
 	printk(KERN_DEBUG "SELinux: %s:  %d entries and %d/%d buckets used, "
 	       "longest chain length %d sum of chain length^2 %llu\n",
@@ -314,6 +323,49 @@ void avtab_hash_eval(struct avtab *h, char *tag)
 	       chain2_len_sum);
 }
 
+int avtab_hash_stats(struct avtab *h, char *page)
+{
+	int slots_used, max_chain_len;
+	unsigned long long chain2_len_sum;
+
+	avtab_chain_stats(h, &slots_used, &max_chain_len, &chain2_len_sum);
+
+	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
+			 "longest chain: %d\nsum of chain length^2: %llu\n",
+			 h->nel, slots_used, h->nslot, max_chain_len,
+			 chain2_len_sum);
+}
+
+/*
+ * Set the bits of the source and target types (or attributes) that
+ * appear in some access vector rule of the table.
+ */
+int avtab_used_types(struct avtab *h, struct ebitmap *stypes,
+		     struct ebitmap *ttypes)
+{
+	int i, rc;
+	struct avtab_node *cur;
+
+	if (!h || !h->htable)
+		return 0;
+
+	for (i = 0; i < h->nslot; i++) {
+		for (cur = h->htable[i]; cur; cur = cur->next) {
+			if (!(cur->key.specified & AVTAB_AV))
+				continue;
+			rc = ebitmap_set_bit(stypes, cur->key.source_type - 1,
+					     1);
+			if (rc)
+				return rc;
+			rc = ebitmap_set_bit(ttypes, cur->key.target_type - 1,
+					     1);
+			if (rc)
+				return rc;
+		}
+	}
+	return 0;
+}
+
 static uint16_t spec_order[] = {
 	AVTAB_ALLOWED,
 	AVTAB_AUDITDENY,
@@ -752,6 +752,25 @@ static void ocontext_destroy(struct ocontext *c, int i)
 	kfree(c);
 }
 
+static void policydb_destroy_attr_map(struct policydb *p,
+				     struct flex_array *map)
+{
+	int i;
+
+	if (!map)
+		return;
+
+	for (i = 0; i < p->p_types.nprim; i++) {
+		struct ebitmap *e;
+
+		e = flex_array_get(map, i);
+		if (!e)
+			continue;
+		ebitmap_destroy(e);
+	}
+	flex_array_free(map);
+}
+
 /*
  * Free any memory allocated by a policy database structure.
  */
@@ -831,17 +850,9 @@ void policydb_destroy(struct policydb *p)
 	hashtab_map(p->range_tr, range_tr_destroy, NULL);
 	hashtab_destroy(p->range_tr);
 
-	if (p->type_attr_map_array) {
-		for (i = 0; i < p->p_types.nprim; i++) {
-			struct ebitmap *e;
-
-			e = flex_array_get(p->type_attr_map_array, i);
-			if (!e)
-				continue;
-			ebitmap_destroy(e);
-		}
-		flex_array_free(p->type_attr_map_array);
-	}
+	policydb_destroy_attr_map(p, p->type_attr_map_array);
+	policydb_destroy_attr_map(p, p->source_attr_map_array);
+	policydb_destroy_attr_map(p, p->target_attr_map_array);
 
 	ebitmap_destroy(&p->filename_trans_ttypes);
 	ebitmap_destroy(&p->policycaps);
@@ -2183,6 +2194,75 @@ out:
 	return rc;
 }
 
+static int policydb_filter_attr_map(struct policydb *p, struct ebitmap *used,
+				   struct flex_array **mapp)
+{
+	struct flex_array *map;
+	struct ebitmap_node *node;
+	unsigned int i, j;
+	int rc;
+
+	map = flex_array_alloc(sizeof(struct ebitmap), p->p_types.nprim,
+			       GFP_KERNEL | __GFP_ZERO);
+	if (!map)
+		return -ENOMEM;
+	*mapp = map;
+
+	rc = flex_array_prealloc(map, 0, p->p_types.nprim,
+				 GFP_KERNEL | __GFP_ZERO);
+	if (rc)
+		return rc;
+
+	for (i = 0; i < p->p_types.nprim; i++) {
+		struct ebitmap *attrs = flex_array_get(p->type_attr_map_array, i);
+		struct ebitmap *e = flex_array_get(map, i);
+
+		BUG_ON(!attrs || !e);
+		ebitmap_init(e);
+		ebitmap_for_each_positive_bit(attrs, node, j) {
+			if (!ebitmap_get_bit(used, j))
+				continue;
+			rc = ebitmap_set_bit(e, j, 1);
+			if (rc)
+				return rc;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Precompute the attribute expansion done when computing access vectors:
+ * of the types and attributes of a type, only those that are the source
+ * (target) of some access vector rule can contribute to a decision, so
+ * context_struct_compute_av() only needs to look up pairs of those.
+ */
+static int policydb_filter_attr_maps(struct policydb *p)
+{
+	struct ebitmap stypes, ttypes;
+	int rc;
+
+	ebitmap_init(&stypes);
+	ebitmap_init(&ttypes);
+
+	rc = avtab_used_types(&p->te_avtab, &stypes, &ttypes);
+	if (rc)
+		goto out;
+
+	rc = avtab_used_types(&p->te_cond_avtab, &stypes, &ttypes);
+	if (rc)
+		goto out;
+
+	rc = policydb_filter_attr_map(p, &stypes, &p->source_attr_map_array);
+	if (rc)
+		goto out;
+
+	rc = policydb_filter_attr_map(p, &ttypes, &p->target_attr_map_array);
+out:
+	ebitmap_destroy(&stypes);
+	ebitmap_destroy(&ttypes);
+	return rc;
+}
+
 /*
  * Read the configuration data from a policy database binary
  * representation file into a policy database structure.
@@ -2460,6 +2540,10 @@ int policydb_read(struct policydb *p, void *fp)
 			goto bad;
 	}
 
+	rc = policydb_filter_attr_maps(p);
+	if (rc)
+		goto bad;
+
 	rc = policydb_bounds_sanity_check(p);
 	if (rc)
 		goto bad;
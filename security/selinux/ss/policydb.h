@@ -260,6 +260,13 @@ struct policydb {
 	/* type -> attribute reverse mapping */
 	struct flex_array *type_attr_map_array;
 
+	/*
+	 * type_attr_map_array restricted to the types and attributes
+	 * that are the source (target) of some access vector rule
+	 */
+	struct flex_array *source_attr_map_array;
+	struct flex_array *target_attr_map_array;
+
 	struct ebitmap policycaps;
 
 	struct ebitmap permissive_map;
@@ -52,6 +52,7 @@
 #include <linux/selinux.h>
 #include <linux/flex_array.h>
 #include <linux/vmalloc.h>
+#include <linux/ktime.h>
 #include <net/netlabel.h>
 
 #include "flask.h"
@@ -649,9 +650,11 @@ static void context_struct_compute_av(struct context *scontext,
 	 */
 	avkey.target_class = tclass;
 	avkey.specified = AVTAB_AV;
-	sattr = flex_array_get(policydb.type_attr_map_array, scontext->type - 1);
+	sattr = flex_array_get(policydb.source_attr_map_array,
+			       scontext->type - 1);
 	BUG_ON(!sattr);
-	tattr = flex_array_get(policydb.type_attr_map_array, tcontext->type - 1);
+	tattr = flex_array_get(policydb.target_attr_map_array,
+			       tcontext->type - 1);
 	BUG_ON(!tattr);
 	ebitmap_for_each_positive_bit(sattr, snode, i) {
 		ebitmap_for_each_positive_bit(tattr, tnode, j) {
@@ -1793,6 +1796,10 @@ static void security_load_policycaps(void)
 extern void selinux_complete_init(void);
 static int security_preserve_bools(struct policydb *p);
 
+/* Duration of the last policy load, and of its SID table conversion */
+static s64 policy_load_us;
+static s64 sidtab_convert_us;
+
 /**
  * security_load_policy - Load a security policy configuration.
  * @data: binary policy data
@@ -1813,6 +1820,7 @@ int security_load_policy(void *data, size_t len)
 	u16 map_size;
 	int rc = 0;
 	struct policy_file file = { data, len }, *fp = &file;
+	ktime_t start = ktime_get(), convert_start;
 
 	if (!ss_initialized) {
 		avtab_cache_init();
@@ -1842,7 +1850,10 @@ int security_load_policy(void *data, size_t len)
 		security_load_policycaps();
 		ss_initialized = 1;
 		seqno = ++latest_granting;
+		policy_load_us = ktime_us_delta(ktime_get(), start);
 		selinux_complete_init();
+		avc_ss_resize(policydb.te_avtab.nel +
+			      policydb.te_cond_avtab.nel);
 		avc_ss_reset(seqno);
 		selnl_notify_policyload(seqno);
 		selinux_status_update_policyload(seqno);
@@ -1884,6 +1895,7 @@ int security_load_policy(void *data, size_t len)
 	}
 
 	/* Clone the SID table. */
+	convert_start = ktime_get();
 	sidtab_shutdown(&sidtab);
 
 	rc = sidtab_map(&sidtab, clone_sid, &newsidtab);
@@ -1904,6 +1916,10 @@ int security_load_policy(void *data, size_t len)
 		goto err;
 	}
 
+	/* The conversion changed the contexts the index is keyed on. */
+	sidtab_rehash_contexts(&newsidtab);
+	sidtab_convert_us = ktime_us_delta(ktime_get(), convert_start);
+
 	/* Save the old policydb and SID table to free later. */
 	memcpy(&oldpolicydb, &policydb, sizeof policydb);
 	sidtab_set(&oldsidtab, &sidtab);
@@ -1924,6 +1940,9 @@ int security_load_policy(void *data, size_t len)
 	sidtab_destroy(&oldsidtab);
 	kfree(oldmap);
 
+	policy_load_us = ktime_us_delta(ktime_get(), start);
+
+	avc_ss_resize(policydb.te_avtab.nel + policydb.te_cond_avtab.nel);
 	avc_ss_reset(seqno);
 	selnl_notify_policyload(seqno);
 	selinux_status_update_policyload(seqno);
@@ -1940,6 +1959,51 @@ err:
 
 }
 
+/**
+ * security_sidtab_hash_stats - Report SID table statistics.
+ * @page: buffer of PAGE_SIZE bytes to write the report to
+ *
+ * Returns the length of the report.
+ */
+int security_sidtab_hash_stats(char *page)
+{
+	int len;
+
+	if (!ss_initialized)
+		return scnprintf(page, PAGE_SIZE, "SELinux uninitialized\n");
+
+	read_lock(&policy_rwlock);
+	len = sidtab_hash_stats(&sidtab, page);
+	read_unlock(&policy_rwlock);
+
+	len += scnprintf(page + len, PAGE_SIZE - len,
+			 "last policy load: %lld us\n"
+			 "sid table conversion: %lld us\n",
+			 (long long)policy_load_us,
+			 (long long)sidtab_convert_us);
+	return len;
+}
+
+/**
+ * security_avtab_hash_stats - Report type enforcement rule table statistics.
+ * @page: buffer of PAGE_SIZE bytes to write the report to
+ *
+ * Returns the length of the report.
+ */
+int security_avtab_hash_stats(char *page)
+{
+	int len;
+
+	if (!ss_initialized)
+		return scnprintf(page, PAGE_SIZE, "SELinux uninitialized\n");
+
+	read_lock(&policy_rwlock);
+	len = avtab_hash_stats(&policydb.te_avtab, page);
+	read_unlock(&policy_rwlock);
+
+	return len;
+}
+
 size_t security_policydb_len(void)
 {
 	size_t len;
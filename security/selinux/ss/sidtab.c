@@ -7,6 +7,7 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/errno.h>
+#include <linux/jhash.h>
 #include "flask.h"
 #include "security.h"
 #include "sidtab.h"
@@ -14,6 +15,34 @@
 #define SIDTAB_HASH(sid) \
 (sid & SIDTAB_HASH_MASK)
 
+#define SIDTAB_CONTEXT_HASH(hash) \
+(hash & SIDTAB_CONTEXT_HASH_MASK)
+
+/*
+ * Hash a context consistently with context_cmp(): contexts that
+ * compare equal hash to the same value.  Equal ebitmaps have identical
+ * node lists, so their nodes can be hashed as they are.
+ */
+static u32 sidtab_context_hash(struct context *c)
+{
+	struct ebitmap_node *node;
+	u32 hash;
+	int l;
+
+	if (c->len)
+		return jhash(c->str, c->len, 0);
+
+	hash = jhash_3words(c->user, c->role, c->type, 0);
+	for (l = 0; l < 2; l++) {
+		hash = jhash_1word(c->range.level[l].sens, hash);
+		for (node = c->range.level[l].cat.node; node;
+		     node = node->next)
+			hash = jhash(node->maps, sizeof(node->maps),
+				     hash ^ node->startbit);
+	}
+	return hash;
+}
+
 int sidtab_init(struct sidtab *s)
 {
 	int i;
@@ -21,8 +50,17 @@ int sidtab_init(struct sidtab *s)
 	s->htable = kmalloc(sizeof(*(s->htable)) * SIDTAB_SIZE, GFP_ATOMIC);
 	if (!s->htable)
 		return -ENOMEM;
+	s->context_htable = kmalloc(sizeof(*(s->context_htable)) *
+				    SIDTAB_CONTEXT_HASH_BUCKETS, GFP_ATOMIC);
+	if (!s->context_htable) {
+		kfree(s->htable);
+		s->htable = NULL;
+		return -ENOMEM;
+	}
 	for (i = 0; i < SIDTAB_SIZE; i++)
 		s->htable[i] = NULL;
+	for (i = 0; i < SIDTAB_CONTEXT_HASH_BUCKETS; i++)
+		s->context_htable[i] = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 	s->shutdown = 0;
@@ -30,10 +68,26 @@ int sidtab_init(struct sidtab *s)
 	return 0;
 }
 
+/*
+ * Find the link a node goes behind in its context chain.  Like the SID
+ * chains, context chains are kept sorted by SID, so that a lookup finds
+ * the lowest SID of a context however the table was built.
+ */
+static struct sidtab_node **sidtab_context_link(struct sidtab *s,
+						struct sidtab_node *node)
+{
+	struct sidtab_node **link;
+
+	link = &s->context_htable[SIDTAB_CONTEXT_HASH(node->hash)];
+	while (*link && node->sid > (*link)->sid)
+		link = &(*link)->context_next;
+	return link;
+}
+
 int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 {
 	int hvalue, rc = 0;
-	struct sidtab_node *prev, *cur, *newnode;
+	struct sidtab_node *prev, *cur, *newnode, **link;
 
 	if (!s) {
 		rc = -ENOMEM;
@@ -65,6 +119,10 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		goto out;
 	}
 
+	newnode->hash = sidtab_context_hash(&newnode->context);
+	link = sidtab_context_link(s, newnode);
+	newnode->context_next = *link;
+
 	if (prev) {
 		newnode->next = prev->next;
 		wmb();
@@ -74,6 +132,7 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		wmb();
 		s->htable[hvalue] = newnode;
 	}
+	*link = newnode;
 
 	s->nel++;
 	if (sid >= s->next_sid)
@@ -159,20 +218,17 @@ static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc
 }
 
 static inline u32 sidtab_search_context(struct sidtab *s,
-						  struct context *context)
+					struct context *context, u32 hash)
 {
-	int i;
 	struct sidtab_node *cur;
 
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			if (context_cmp(&cur->context, context)) {
-				sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
-				return cur->sid;
-			}
-			cur = cur->next;
+	cur = s->context_htable[SIDTAB_CONTEXT_HASH(hash)];
+	while (cur) {
+		if (cur->hash == hash && context_cmp(&cur->context, context)) {
+			sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
+			return cur->sid;
 		}
+		cur = cur->context_next;
 	}
 	return 0;
 }
@@ -198,19 +254,26 @@ int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *out_sid)
 {
-	u32 sid;
+	u32 sid, hash;
 	int ret = 0;
 	unsigned long flags;
 
 	*out_sid = SECSID_NULL;
 
+	s->lookups++;
 	sid  = sidtab_search_cache(s, context);
-	if (!sid)
-		sid = sidtab_search_context(s, context);
-	if (!sid) {
+	if (sid) {
+		s->cache_hits++;
+		goto out;
+	}
+	hash = sidtab_context_hash(context);
+	sid = sidtab_search_context(s, context, hash);
+	if (sid) {
+		s->index_hits++;
+	} else {
 		spin_lock_irqsave(&s->lock, flags);
 		/* Rescan now that we hold the lock. */
-		sid = sidtab_search_context(s, context);
+		sid = sidtab_search_context(s, context, hash);
 		if (sid)
 			goto unlock_out;
 		/* No SID exists for the context.  Allocate a new one. */
@@ -226,10 +289,13 @@ int sidtab_context_to_sid(struct sidtab *s,
 		ret = sidtab_insert(s, sid, context);
 		if (ret)
 			s->next_sid--;
+		else
+			s->new_sids++;
 unlock_out:
 		spin_unlock_irqrestore(&s->lock, flags);
 	}
 
+out:
 	if (ret)
 		return ret;
 
@@ -237,6 +303,29 @@ unlock_out:
 	return 0;
 }
 
+/*
+ * Rebuild the context index after the contexts in the table have been
+ * changed in place, as when converting them to a new policy.  Must not
+ * race with lookups.
+ */
+void sidtab_rehash_contexts(struct sidtab *s)
+{
+	int i;
+	struct sidtab_node *cur, **link;
+
+	for (i = 0; i < SIDTAB_CONTEXT_HASH_BUCKETS; i++)
+		s->context_htable[i] = NULL;
+
+	for (i = 0; i < SIDTAB_SIZE; i++) {
+		for (cur = s->htable[i]; cur; cur = cur->next) {
+			cur->hash = sidtab_context_hash(&cur->context);
+			link = sidtab_context_link(s, cur);
+			cur->context_next = *link;
+			*link = cur;
+		}
+	}
+}
+
 void sidtab_hash_eval(struct sidtab *h, char *tag)
 {
 	int i, chain_len, slots_used, max_chain_len;
@@ -264,6 +353,50 @@ void sidtab_hash_eval(struct sidtab *h, char *tag)
 	       max_chain_len);
 }
 
+static void sidtab_chain_stats(struct sidtab_node **table, int size,
+			       bool by_context, int *slots_used,
+			       int *max_chain_len)
+{
+	int i, chain_len;
+	struct sidtab_node *cur;
+
+	*slots_used = 0;
+	*max_chain_len = 0;
+	for (i = 0; i < size; i++) {
+		cur = table[i];
+		if (!cur)
+			continue;
+		(*slots_used)++;
+		chain_len = 0;
+		while (cur) {
+			chain_len++;
+			cur = by_context ? cur->context_next : cur->next;
+		}
+		if (chain_len > *max_chain_len)
+			*max_chain_len = chain_len;
+	}
+}
+
+int sidtab_hash_stats(struct sidtab *h, char *page)
+{
+	int slots_used, max_chain_len;
+	int context_slots_used, max_context_chain_len;
+
+	sidtab_chain_stats(h->htable, SIDTAB_SIZE, false,
+			   &slots_used, &max_chain_len);
+	sidtab_chain_stats(h->context_htable, SIDTAB_CONTEXT_HASH_BUCKETS,
+			   true, &context_slots_used, &max_context_chain_len);
+
+	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
+			 "longest chain: %d\ncontext buckets used: %d/%d\n"
+			 "longest context chain: %d\ncontext lookups: %lu\n"
+			 "cache hits: %lu\nindex hits: %lu\nnew sids: %lu\n",
+			 h->nel, slots_used, SIDTAB_SIZE, max_chain_len,
+			 context_slots_used, SIDTAB_CONTEXT_HASH_BUCKETS,
+			 max_context_chain_len, h->lookups, h->cache_hits,
+			 h->index_hits, h->new_sids);
+}
+
 void sidtab_destroy(struct sidtab *s)
 {
 	int i;
@@ -284,6 +417,8 @@ void sidtab_destroy(struct sidtab *s)
 	}
 	kfree(s->htable);
 	s->htable = NULL;
+	kfree(s->context_htable);
+	s->context_htable = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 }
@@ -295,6 +430,7 @@ void sidtab_set(struct sidtab *dst, struct sidtab *src)
 
 	spin_lock_irqsave(&src->lock, flags);
 	dst->htable = src->htable;
+	dst->context_htable = src->context_htable;
 	dst->nel = src->nel;
 	dst->next_sid = src->next_sid;
 	dst->shutdown = 0;
@@ -1,6 +1,8 @@
 /*
  * A security identifier table (sidtab) is a hash table
  * of security context structures indexed by SID value.
+ * A second hash table indexes the same nodes by context,
+ * for context to SID lookups.
  *
  * Author : Stephen Smalley, <sds@epoch.ncsc.mil>
  */
@@ -11,8 +13,10 @@
 
 struct sidtab_node {
 	u32 sid;		/* security identifier */
+	u32 hash;		/* hash of the context */
 	struct context context;	/* security context structure */
 	struct sidtab_node *next;
+	struct sidtab_node *context_next; /* next node in context chain */
 };
 
 #define SIDTAB_HASH_BITS 7
@@ -21,14 +25,24 @@ struct sidtab_node {
 
 #define SIDTAB_SIZE SIDTAB_HASH_BUCKETS
 
+#define SIDTAB_CONTEXT_HASH_BITS 9
+#define SIDTAB_CONTEXT_HASH_BUCKETS (1 << SIDTAB_CONTEXT_HASH_BITS)
+#define SIDTAB_CONTEXT_HASH_MASK (SIDTAB_CONTEXT_HASH_BUCKETS-1)
+
 struct sidtab {
 	struct sidtab_node **htable;
+	struct sidtab_node **context_htable;	/* nodes indexed by context */
 	unsigned int nel;	/* number of elements */
 	unsigned int next_sid;	/* next SID to allocate */
 	unsigned char shutdown;
 #define SIDTAB_CACHE_LEN	3
 	struct sidtab_node *cache[SIDTAB_CACHE_LEN];
 	spinlock_t lock;
+	/* context to SID lookup statistics, not serialized */
+	unsigned long lookups;
+	unsigned long cache_hits;
+	unsigned long index_hits;
+	unsigned long new_sids;
 };
 
 int sidtab_init(struct sidtab *s);
@@ -46,7 +60,10 @@ int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *sid);
 
+void sidtab_rehash_contexts(struct sidtab *s);
+
 void sidtab_hash_eval(struct sidtab *h, char *tag);
+int sidtab_hash_stats(struct sidtab *h, char *page);
 void sidtab_destroy(struct sidtab *s);
 void sidtab_set(struct sidtab *dst, struct sidtab *src);
 void sidtab_shutdown(struct sidtab *s);
@@ -4,6 +4,16 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_net_reuseport(int argc, const char **argv, const char *prefix);
+extern int bench_net_epoll(int argc, const char **argv, const char *prefix);
+extern int bench_net_bql(int argc, const char **argv, const char *prefix);
+extern int bench_net_qdisc(int argc, const char **argv, const char *prefix);
+extern int bench_sync_signal(int argc, const char **argv, const char *prefix);
+extern int bench_sync_genlock(int argc, const char **argv, const char *prefix);
+extern int bench_security_avc(int argc, const char **argv, const char *prefix);
+extern int bench_fs_aio(int argc, const char **argv, const char *prefix);
+extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
+extern int bench_futex_wake(int argc, const char **argv, const char *prefix);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,294 @@
+/*
+ *
+ * fs-aio.c
+ *
+ * aio: Benchmark for buffered asynchronous I/O
+ *
+ * Keeps a number of random reads (or writes) of one block each in flight
+ * on a file with io_submit() and io_getevents(), without O_DIRECT, the
+ * way fio's libaio engine does with --direct=0.  Running it with a
+ * growing --depth shows whether buffered aio scales with queue depth or
+ * is executed one request at a time by io_submit() itself.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <endian.h>
+#include <sys/syscall.h>
+#include <linux/types.h>
+
+/* From include/linux/aio_abi.h */
+typedef unsigned long aio_context_t;
+
+enum {
+	IOCB_CMD_PREAD = 0,
+	IOCB_CMD_PWRITE = 1,
+	IOCB_CMD_FSYNC = 2,
+};
+
+struct io_event {
+	__u64		data;
+	__u64		obj;
+	__s64		res;
+	__s64		res2;
+};
+
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+#define PADDED(x, y)	x, y
+#else
+#define PADDED(x, y)	y, x
+#endif
+
+struct iocb {
+	__u64	aio_data;
+	__u32	PADDED(aio_key, aio_reserved1);
+	__u16	aio_lio_opcode;
+	__s16	aio_reqprio;
+	__u32	aio_fildes;
+	__u64	aio_buf;
+	__u64	aio_nbytes;
+	__s64	aio_offset;
+	__u64	aio_reserved2;
+	__u32	aio_flags;
+	__u32	aio_resfd;
+};
+
+static const char *file_path = "perf-bench-aio.dat";
+static int file_mb = 256;
+static int block_size = 4096;
+static int depth = 32;
+static int nr_ios = 100000;
+static bool do_write;
+static int fsync_every;
+
+static const struct option options[] = {
+	OPT_STRING('f', "file", &file_path, "path",
+		   "Specify the file to do I/O on"),
+	OPT_INTEGER('s', "size", &file_mb,
+		    "Specify the size of the file in MB"),
+	OPT_INTEGER('b', "block", &block_size,
+		    "Specify the size of each I/O in bytes"),
+	OPT_INTEGER('q', "depth", &depth,
+		    "Specify number of I/Os kept in flight"),
+	OPT_INTEGER('l', "loop", &nr_ios,
+		    "Specify number of I/Os"),
+	OPT_BOOLEAN('w', "write", &do_write,
+		    "Do random writes instead of random reads"),
+	OPT_INTEGER('F', "fsync", &fsync_every,
+		    "Queue an fsync after every N writes"),
+	OPT_END()
+};
+
+static const char * const bench_fs_aio_usage[] = {
+	"perf bench fs aio <options>",
+	NULL
+};
+
+static unsigned long long timespec_nsec(const struct timespec *ts)
+{
+	return (unsigned long long)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static int open_file(void)
+{
+	off_t size = (off_t)file_mb << 20;
+	struct stat st;
+	char *buf;
+	off_t pos;
+	int fd;
+
+	fd = open(file_path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		die("%s: %s\n", file_path, strerror(errno));
+	if (fstat(fd, &st) < 0)
+		die("fstat: %s\n", strerror(errno));
+	if (st.st_size >= size)
+		return fd;
+
+	/* Fill the file so that reads hit real blocks, not holes. */
+	buf = malloc(1 << 20);
+	if (!buf)
+		die("malloc: %s\n", strerror(errno));
+	memset(buf, 0xa5, 1 << 20);
+	for (pos = 0; pos < size; pos += 1 << 20)
+		if (pwrite(fd, buf, 1 << 20, pos) != 1 << 20)
+			die("pwrite: %s\n", strerror(errno));
+	free(buf);
+	fsync(fd);
+
+	return fd;
+}
+
+static void prep_iocb(struct iocb *cb, int fd, char *buf, unsigned int *seed,
+		      int fsync_now)
+{
+	unsigned long nr_blocks = ((unsigned long)file_mb << 20) / block_size;
+
+	memset(cb, 0, sizeof(*cb));
+	cb->aio_fildes = fd;
+	cb->aio_data = (unsigned long)cb;
+	if (fsync_now) {
+		cb->aio_lio_opcode = IOCB_CMD_FSYNC;
+		return;
+	}
+	cb->aio_lio_opcode = do_write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+	cb->aio_buf = (unsigned long)buf;
+	cb->aio_nbytes = block_size;
+	cb->aio_offset = (long long)(rand_r(seed) % nr_blocks) * block_size;
+}
+
+int bench_fs_aio(int argc, const char **argv,
+		 const char *prefix __used)
+{
+	struct timespec start, stop, t0, t1;
+	unsigned long long total_nsec, submit_nsec = 0;
+	struct iocb *cbs, **ptrs;
+	struct io_event *events;
+	aio_context_t ctx = 0;
+	unsigned int seed = 1;
+	int fd, i, n, submitted = 0, completed = 0, writes = 0;
+	char *bufs;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_aio_usage, 0);
+	if (file_mb < 1 || block_size < 1 || depth < 1 || nr_ios < 1 ||
+	    fsync_every < 0 ||
+	    ((unsigned long)file_mb << 20) < (unsigned long)block_size)
+		usage_with_options(bench_fs_aio_usage, options);
+	if (depth > nr_ios)
+		depth = nr_ios;
+
+	fd = open_file();
+
+	cbs = calloc(depth, sizeof(*cbs));
+	ptrs = calloc(depth, sizeof(*ptrs));
+	events = calloc(depth, sizeof(*events));
+	bufs = malloc((size_t)depth * block_size);
+	if (!cbs || !ptrs || !events || !bufs)
+		die("calloc: %s\n", strerror(errno));
+	memset(bufs, 0x5a, (size_t)depth * block_size);
+
+	if (syscall(__NR_io_setup, depth, &ctx) < 0)
+		die("io_setup: %s\n", strerror(errno));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* ptrs[0..n) are the iocbs free to be (re)submitted */
+	for (i = 0; i < depth; i++)
+		ptrs[i] = &cbs[i];
+	n = depth;
+
+	while (completed < nr_ios) {
+		int want = nr_ios - submitted;
+		int ret;
+
+		if (want > n)
+			want = n;
+		for (i = 0; i < want; i++) {
+			int fsync_now = do_write && fsync_every &&
+					writes && !(writes % fsync_every);
+
+			prep_iocb(ptrs[i], fd,
+				  bufs + (ptrs[i] - cbs) * block_size,
+				  &seed, fsync_now);
+			if (fsync_now)
+				writes = 0;
+			else if (do_write)
+				writes++;
+		}
+
+		if (want) {
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			ret = syscall(__NR_io_submit, ctx, want, ptrs);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			if (ret < 0)
+				die("io_submit: %s\n", strerror(errno));
+			submit_nsec += timespec_nsec(&t1) - timespec_nsec(&t0);
+
+			/* An fsync doesn't count as one of the I/Os. */
+			for (i = 0; i < ret; i++)
+				if (ptrs[i]->aio_lio_opcode != IOCB_CMD_FSYNC)
+					submitted++;
+
+			/* Keep any iocbs that were not taken at the front. */
+			memmove(ptrs, ptrs + ret, (n - ret) * sizeof(*ptrs));
+			n -= ret;
+		}
+
+		ret = syscall(__NR_io_getevents, ctx, 1, depth, events, NULL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die("io_getevents: %s\n", strerror(errno));
+		}
+		for (i = 0; i < ret; i++) {
+			struct iocb *cb = (struct iocb *)(unsigned long)
+					  events[i].data;
+
+			if ((long long)events[i].res < 0)
+				die("aio: %s\n", strerror(-events[i].res));
+			ptrs[n++] = cb;
+			if (cb->aio_lio_opcode != IOCB_CMD_FSYNC)
+				completed++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	total_nsec = timespec_nsec(&stop) - timespec_nsec(&start);
+
+	syscall(__NR_io_destroy, ctx);
+	close(fd);
+	free(bufs);
+	free(events);
+	free(ptrs);
+	free(cbs);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d random %d byte buffered %s, queue depth %d, "
+		       "on %s (%d MB)\n\n", nr_ios, block_size,
+		       do_write ? "writes" : "reads", depth, file_path,
+		       file_mb);
+
+		printf(" %14s: %llu.%03llu [sec]\n\n", "Total time",
+		       total_nsec / 1000000000ULL,
+		       (total_nsec % 1000000000ULL) / 1000000ULL);
+
+		printf(" %14llu IOPS\n",
+		       (unsigned long long)((double)nr_ios /
+			     ((double)total_nsec / 1000000000.0)));
+		printf(" %14lf MB/sec\n",
+		       (double)nr_ios * block_size / (1 << 20) /
+		       ((double)total_nsec / 1000000000.0));
+		printf(" %14lf usecs in io_submit() per I/O\n",
+		       (double)submit_nsec / 1000.0 / (double)nr_ios);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n",
+		       (unsigned long long)((double)nr_ios /
+			     ((double)total_nsec / 1000000000.0)));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Benchmark for futex hash table lookups
+ *
+ * A number of threads each own an array of futexes and call FUTEX_WAIT
+ * on them in turn with a value that doesn't match, so that every call
+ * only hashes the futex, takes and drops its bucket lock and returns
+ * EAGAIN.  The rate of those calls shows how well the futex hash table
+ * spreads many busy futexes over its buckets as threads are added.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static int nr_threads = 4;
+static int nr_futexes = 1024;
+static int runtime = 10;
+static bool shared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads"),
+	OPT_INTEGER('f', "futexes", &nr_futexes,
+		    "Specify number of futexes per thread"),
+	OPT_INTEGER('r', "runtime", &runtime,
+		    "Specify runtime in seconds"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+struct worker {
+	pthread_t	thread;
+	unsigned int	*futexes;
+	unsigned long	ops;
+};
+
+static volatile int done;
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	int i;
+
+	while (!done) {
+		for (i = 0; i < nr_futexes; i++) {
+			/* The futexes are all 0, so this never sleeps. */
+			if (futex_wait(&w->futexes[i], 1, !shared) != -1 ||
+			    errno != EAGAIN)
+				die("FUTEX_WAIT: %s\n", strerror(errno));
+		}
+		ops += nr_futexes;
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct worker *workers;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total_ops = 0;
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+	if (nr_threads < 1 || nr_futexes < 1 || runtime < 1)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		die("calloc: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].futexes = calloc(nr_futexes,
+					    sizeof(*workers[i].futexes));
+		if (!workers[i].futexes)
+			die("calloc: %s\n", strerror(errno));
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_create(&workers[i].thread, NULL, worker_fn,
+				       &workers[i]));
+
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		total_ops += workers[i].ops;
+		free(workers[i].futexes);
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	free(workers);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d threads, %d %s futexes each\n\n",
+		       nr_threads, nr_futexes, shared ? "shared" : "private");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14llu ops\n", total_ops);
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total_ops /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14llu ops/sec/thread\n",
+		       (unsigned long long)((double)total_ops / nr_threads /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n",
+		       (unsigned long long)((double)total_ops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
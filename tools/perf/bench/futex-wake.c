@@ -0,0 +1,151 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Benchmark for waking the waiters of one futex
+ *
+ * A number of threads block in FUTEX_WAIT on the same futex, and once
+ * they are all asleep the main thread wakes them with FUTEX_WAKE calls of
+ * --nwakes waiters each, the way a condition variable broadcast or a
+ * string of unlocks does.  Only the FUTEX_WAKE calls are timed; the whole
+ * round is repeated --loop times.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <time.h>
+
+/* How long the waiters are given to block before waking them, in usecs */
+#define WAITER_SETTLE_TIME 100000
+
+static int nr_threads = 16;
+static int nr_wakes = 1;
+static int loops = 10;
+static bool shared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of waiting threads"),
+	OPT_INTEGER('w', "nwakes", &nr_wakes,
+		    "Specify number of waiters woken per FUTEX_WAKE"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of rounds"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static unsigned int futex_word;
+
+static void *waiter_fn(void *arg __used)
+{
+	/* The word stays 0, so only a FUTEX_WAKE lets us out. */
+	while (futex_wait(&futex_word, 0, !shared) < 0) {
+		if (errno != EINTR)
+			die("FUTEX_WAIT: %s\n", strerror(errno));
+	}
+	return NULL;
+}
+
+static unsigned long long timespec_nsec(const struct timespec *ts)
+{
+	return (unsigned long long)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timespec start, stop;
+	unsigned long long total_nsec = 0, min_nsec = ~0ULL, max_nsec = 0;
+	pthread_t *waiters;
+	int i, j;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_wake_usage, 0);
+	if (nr_threads < 1 || nr_wakes < 1 || loops < 1)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	waiters = calloc(nr_threads, sizeof(*waiters));
+	if (!waiters)
+		die("calloc: %s\n", strerror(errno));
+
+	for (i = 0; i < loops; i++) {
+		unsigned long long nsec;
+		int woken = 0, ret;
+
+		for (j = 0; j < nr_threads; j++)
+			assert(!pthread_create(&waiters[j], NULL, waiter_fn,
+					       NULL));
+		usleep(WAITER_SETTLE_TIME);
+
+		/* Keep going in case some waiter was slow to block. */
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while (woken < nr_threads) {
+			ret = futex_wake(&futex_word, nr_wakes, !shared);
+			if (ret < 0)
+				die("FUTEX_WAKE: %s\n", strerror(errno));
+			woken += ret;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+
+		for (j = 0; j < nr_threads; j++)
+			pthread_join(waiters[j], NULL);
+
+		nsec = timespec_nsec(&stop) - timespec_nsec(&start);
+		total_nsec += nsec;
+		if (nsec < min_nsec)
+			min_nsec = nsec;
+		if (nsec > max_nsec)
+			max_nsec = nsec;
+	}
+
+	free(waiters);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d rounds of waking %d threads, %d per call, "
+		       "on a %s futex\n\n", loops, nr_threads, nr_wakes,
+		       shared ? "shared" : "private");
+
+		printf(" %14s: %llu.%03llu [msec]\n\n", "Total time",
+		       total_nsec / 1000000ULL,
+		       (total_nsec % 1000000ULL) / 1000ULL);
+
+		printf(" %14llu nsecs/round (avg)\n", total_nsec / loops);
+		printf(" %14llu nsecs/round (min)\n", min_nsec);
+		printf(" %14llu nsecs/round (max)\n", max_nsec);
+		printf(" %14llu nsecs/waiter (avg)\n",
+		       total_nsec / loops / nr_threads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n", total_nsec / loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef BENCH_FUTEX_H
+#define BENCH_FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* From include/linux/futex.h */
+#define FUTEX_WAIT		0
+#define FUTEX_WAKE		1
+#define FUTEX_PRIVATE_FLAG	128
+
+/*
+ * Both suites use PROCESS_PRIVATE futexes unless told otherwise, which
+ * is what pthread mutexes and condition variables use.
+ */
+static inline int futex_wait(unsigned int *uaddr, unsigned int val,
+			     int private)
+{
+	return syscall(__NR_futex, uaddr,
+		       FUTEX_WAIT | (private ? FUTEX_PRIVATE_FLAG : 0),
+		       val, NULL, NULL, 0);
+}
+
+static inline int futex_wake(unsigned int *uaddr, int nr_wake, int private)
+{
+	return syscall(__NR_futex, uaddr,
+		       FUTEX_WAKE | (private ? FUTEX_PRIVATE_FLAG : 0),
+		       nr_wake, NULL, NULL, 0);
+}
+
+#endif /* BENCH_FUTEX_H */
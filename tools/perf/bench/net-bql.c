@@ -0,0 +1,205 @@
+/*
+ *
+ * net-bql.c
+ *
+ * bql: Benchmark for latency under load through a transmit queue
+ *
+ * Times round trips of small UDP (or TCP) messages through an echo
+ * service, first on an idle path and then while a number of bulk TCP
+ * flows saturate it, and samples the byte queue limit of one transmit
+ * queue of the device the flows leave by.  The difference between the
+ * idle and the loaded round trips is the queueing delay the bulk flows
+ * add, most of which sits in the driver's ring when BQL is not used.
+ *
+ * Run against an address on this host, everything goes through the
+ * loopback device.  To measure a real device, run the services on the
+ * other end with --server (in another network namespace for a veth
+ * pair) and point --addr at it with --remote.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "net-load.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* How long the bulk flows run before probing starts, in usecs */
+#define LOAD_WARMUP_TIME	1000000
+/* How often the queue limit is sampled, in usecs */
+#define BQL_SAMPLE_INTERVAL	10000
+
+static const char *addr_str = "127.0.0.1";
+static const char *dev_name = "lo";
+static int queue;
+static int nr_flows = 4;
+static int nr_probes = 500;
+static int interval = 10;
+static bool use_tcp;
+static bool remote;
+static bool server;
+
+static const struct option options[] = {
+	OPT_STRING('a', "addr", &addr_str, "addr",
+		   "Specify the IPv4 address of the sink and echo services"),
+	OPT_STRING('i', "dev", &dev_name, "dev",
+		   "Specify the device whose queue limit is sampled"),
+	OPT_INTEGER('q', "queue", &queue,
+		    "Specify the transmit queue whose limit is sampled"),
+	OPT_INTEGER('f', "flows", &nr_flows,
+		    "Specify number of bulk TCP flows"),
+	OPT_INTEGER('n', "probes", &nr_probes,
+		    "Specify number of round trips timed, idle and loaded"),
+	OPT_INTEGER('I', "interval", &interval,
+		    "Specify msecs between round trips"),
+	OPT_BOOLEAN('T', "tcp", &use_tcp,
+		    "Time round trips over TCP instead of UDP"),
+	OPT_BOOLEAN('R', "remote", &remote,
+		    "The services run elsewhere, started with --server"),
+	OPT_BOOLEAN('S', "server", &server,
+		    "Only run the sink and echo services, until killed"),
+	OPT_END()
+};
+
+static const char * const bench_net_bql_usage[] = {
+	"perf bench net bql <options>",
+	NULL
+};
+
+struct bql_sample {
+	pthread_t		thread;
+	int			available;
+	unsigned long		nr;
+	unsigned long long	inflight_sum;
+	unsigned long		inflight_max;
+	unsigned long		limit;
+};
+
+static volatile int sampling;
+
+static int read_bql(const char *file, unsigned long *val)
+{
+	char path[256];
+	FILE *fp;
+	int ret;
+
+	snprintf(path, sizeof(path),
+		 "/sys/class/net/%s/queues/tx-%d/byte_queue_limits/%s",
+		 dev_name, queue, file);
+	fp = fopen(path, "r");
+	if (!fp)
+		return 0;
+	ret = fscanf(fp, "%lu", val) == 1;
+	fclose(fp);
+	return ret;
+}
+
+static void *sample_fn(void *arg)
+{
+	struct bql_sample *s = arg;
+	unsigned long inflight;
+
+	while (sampling) {
+		if (read_bql("inflight", &inflight)) {
+			s->nr++;
+			s->inflight_sum += inflight;
+			if (inflight > s->inflight_max)
+				s->inflight_max = inflight;
+		}
+		usleep(BQL_SAMPLE_INTERVAL);
+	}
+	s->available = read_bql("limit", &s->limit) && s->nr;
+	return NULL;
+}
+
+int bench_net_bql(int argc, const char **argv,
+		  const char *prefix __used)
+{
+	struct net_rtt idle, loaded;
+	struct bql_sample bql;
+	struct timeval start, stop, diff;
+	unsigned long long bytes, result_usec;
+	struct in_addr addr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_bql_usage, 0);
+	if (nr_flows < 1 || nr_probes < 1 || interval < 0 || queue < 0)
+		usage_with_options(bench_net_bql_usage, options);
+	if (!inet_aton(addr_str, &addr))
+		die("invalid address: %s\n", addr_str);
+
+	if (server) {
+		net_load_serve(&addr);
+		for (;;)
+			pause();
+	}
+	if (!remote)
+		net_load_serve(&addr);
+
+	net_probe_rtt(&addr, use_tcp, nr_probes, interval, &idle);
+
+	memset(&bql, 0, sizeof(bql));
+	gettimeofday(&start, NULL);
+	net_load_start(&addr, nr_flows);
+	usleep(LOAD_WARMUP_TIME);
+
+	sampling = 1;
+	assert(!pthread_create(&bql.thread, NULL, sample_fn, &bql));
+	net_probe_rtt(&addr, use_tcp, nr_probes, interval, &loaded);
+	sampling = 0;
+	pthread_join(bql.thread, NULL);
+
+	bytes = net_load_stop();
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d %s round trips to %s, idle and under %d bulk "
+		       "TCP flows\n\n", nr_probes, use_tcp ? "TCP" : "UDP",
+		       addr_str, nr_flows);
+
+		net_print_rtt("Idle", &idle);
+		net_print_rtt("Loaded", &loaded);
+		printf(" %14lf Mbit/sec of bulk traffic\n",
+		       (double)bytes * 8 / (double)result_usec);
+
+		if (bql.available) {
+			printf("\n %s tx-%d byte queue limit:\n",
+			       dev_name, queue);
+			printf(" %14lu bytes limit\n", bql.limit);
+			printf(" %14llu bytes inflight (avg)\n",
+			       bql.inflight_sum / bql.nr);
+			printf(" %14lu bytes inflight (max)\n",
+			       bql.inflight_max);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu\n", loaded.avg);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
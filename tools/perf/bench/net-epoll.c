@@ -0,0 +1,260 @@
+/*
+ *
+ * net-epoll.c
+ *
+ * epoll: Benchmark for epoll wakeups on a shared listening socket
+ *
+ * A number of server threads each have their own epoll instance watching
+ * the same non-blocking listening socket, the way event-loop servers do,
+ * while the same number of client threads connect to it.  Every return
+ * from epoll_wait() is counted as a wakeup, and a wakeup that finds no
+ * connection to accept as a wasted one.  With --exclusive the socket is
+ * added with EPOLLEXCLUSIVE, so that a connection wakes only one server.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1 << 28)
+#endif
+
+#ifndef RUSAGE_THREAD
+#define RUSAGE_THREAD 1
+#endif
+
+/* How often idle servers look at whether the run is over, in msecs */
+#define SERVER_POLL_TIMEOUT 100
+
+static int nr_threads = 4;
+static int loops = 10000;
+static bool exclusive;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of server and client threads"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of connections per client"),
+	OPT_BOOLEAN('x', "exclusive", &exclusive,
+		    "Add the listening socket with EPOLLEXCLUSIVE"),
+	OPT_END()
+};
+
+static const char * const bench_net_epoll_usage[] = {
+	"perf bench net epoll <options>",
+	NULL
+};
+
+struct server {
+	pthread_t	thread;
+	int		epfd;
+	unsigned long	count;
+	unsigned long	wakeups;
+	unsigned long	wasted;
+	struct timeval	cpu;		/* user + system time of the thread */
+};
+
+static struct sockaddr_in server_addr;
+static unsigned long total_count;
+static int listen_fd;
+static volatile int done;
+
+static void *server_worker(void *arg)
+{
+	struct server *s = arg;
+	struct epoll_event ev;
+	struct rusage ru;
+	int n, fd, accepted;
+
+	while (!done) {
+		n = epoll_wait(s->epfd, &ev, 1, SERVER_POLL_TIMEOUT);
+		if (n < 0 && errno != EINTR)
+			die("epoll_wait: %s\n", strerror(errno));
+		if (n <= 0)
+			continue;
+
+		s->wakeups++;
+		accepted = 0;
+		while ((fd = accept(listen_fd, NULL, NULL)) >= 0) {
+			close(fd);
+			accepted++;
+		}
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			die("accept: %s\n", strerror(errno));
+
+		if (!accepted)
+			s->wasted++;
+		s->count += accepted;
+		__sync_fetch_and_add(&total_count, accepted);
+	}
+
+	getrusage(RUSAGE_THREAD, &ru);
+	timeradd(&ru.ru_utime, &ru.ru_stime, &s->cpu);
+	return NULL;
+}
+
+static void *client_worker(void *arg __used)
+{
+	struct linger lin = { .l_onoff = 1, .l_linger = 0 };
+	int i, fd;
+
+	for (i = 0; i < loops; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		assert(fd >= 0);
+		/* Reset on close so that we don't run out of local ports. */
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+		if (connect(fd, (struct sockaddr *)&server_addr,
+			    sizeof(server_addr)) < 0)
+			die("connect: %s\n", strerror(errno));
+		close(fd);
+	}
+	return NULL;
+}
+
+int bench_net_epoll(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct server *servers;
+	pthread_t *clients;
+	struct epoll_event ev;
+	struct timeval start, stop, diff, cpu;
+	unsigned long long result_usec, cpu_usec;
+	unsigned long expected, wakeups = 0, wasted = 0;
+	socklen_t len = sizeof(server_addr);
+	int i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_epoll_usage, 0);
+	if (nr_threads < 1 || loops < 1)
+		usage_with_options(bench_net_epoll_usage, options);
+
+	servers = calloc(nr_threads, sizeof(*servers));
+	clients = calloc(nr_threads, sizeof(*clients));
+	assert(servers && clients);
+
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	server_addr.sin_port = 0;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		die("socket: %s\n", strerror(errno));
+	if (bind(listen_fd, (struct sockaddr *)&server_addr,
+		 sizeof(server_addr)) < 0)
+		die("bind: %s\n", strerror(errno));
+	if (listen(listen_fd, 1024) < 0)
+		die("listen: %s\n", strerror(errno));
+	if (getsockname(listen_fd, (struct sockaddr *)&server_addr, &len) < 0)
+		die("getsockname: %s\n", strerror(errno));
+	if (fcntl(listen_fd, F_SETFL, O_NONBLOCK) < 0)
+		die("fcntl: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_threads; i++) {
+		servers[i].epfd = epoll_create1(0);
+		if (servers[i].epfd < 0)
+			die("epoll_create1: %s\n", strerror(errno));
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		if (exclusive)
+			ev.events |= EPOLLEXCLUSIVE;
+		if (epoll_ctl(servers[i].epfd, EPOLL_CTL_ADD, listen_fd,
+			      &ev) < 0)
+			die("EPOLL_CTL_ADD: %s\n", strerror(errno));
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_create(&servers[i].thread, NULL,
+				       server_worker, &servers[i]));
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_create(&clients[i], NULL, client_worker,
+				       NULL));
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(clients[i], NULL);
+
+	/* Connections are reset on close, so each one is accepted once. */
+	expected = (unsigned long)nr_threads * loops;
+	while (total_count < expected)
+		usleep(1000);
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	done = 1;
+	timerclear(&cpu);
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(servers[i].thread, NULL);
+		close(servers[i].epfd);
+		wakeups += servers[i].wakeups;
+		wasted += servers[i].wasted;
+		timeradd(&cpu, &servers[i].cpu, &cpu);
+	}
+	close(listen_fd);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	cpu_usec = cpu.tv_sec * 1000000;
+	cpu_usec += cpu.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d epoll server threads%s, %d clients x %d "
+		       "connections\n\n", nr_threads,
+		       exclusive ? " (EPOLLEXCLUSIVE)" : "",
+		       nr_threads, loops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lu connections accepted\n", total_count);
+		printf(" %14d ops/sec\n",
+		       (int)((double)total_count /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14lu wakeups\n", wakeups);
+		printf(" %14lu wakeups with nothing to accept\n", wasted);
+		printf(" %14lf wakeups/connection\n",
+		       (double)wakeups / (double)total_count);
+		printf(" %14lf server CPU usecs/connection\n",
+		       (double)cpu_usec / (double)total_count);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(clients);
+	free(servers);
+	return 0;
+}
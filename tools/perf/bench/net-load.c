@@ -0,0 +1,393 @@
+/*
+ *
+ * net-load.c
+ *
+ * Latency under load helpers for the 'perf bench net' suites
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "net-load.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* Size of the messages timed by the echo service */
+#define PROBE_SIZE		64
+/* How long a UDP probe may take before it counts as lost, in msecs */
+#define PROBE_TIMEOUT		1000
+/* Size of each write of the bulk flows */
+#define BULK_WRITE_SIZE		65536
+
+static void set_addr(struct sockaddr_in *sin, const struct in_addr *addr,
+		     int port)
+{
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr = *addr;
+	sin->sin_port = htons(port);
+}
+
+static int listen_on(const struct in_addr *addr, int port, int type)
+{
+	struct sockaddr_in sin;
+	int fd, one = 1;
+
+	fd = socket(AF_INET, type, 0);
+	if (fd < 0)
+		die("socket: %s\n", strerror(errno));
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	set_addr(&sin, addr, port);
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+		die("bind %s:%d: %s\n", inet_ntoa(*addr), port,
+		    strerror(errno));
+	if (type == SOCK_STREAM && listen(fd, 128) < 0)
+		die("listen: %s\n", strerror(errno));
+	return fd;
+}
+
+static int connect_to(const struct in_addr *addr, int port, int type)
+{
+	struct sockaddr_in sin;
+	int fd;
+
+	fd = socket(AF_INET, type, 0);
+	if (fd < 0)
+		die("socket: %s\n", strerror(errno));
+	set_addr(&sin, addr, port);
+	if (connect(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0)
+		die("connect %s:%d: %s\n", inet_ntoa(*addr), port,
+		    strerror(errno));
+	return fd;
+}
+
+static unsigned long timeval_usec(const struct timeval *tv)
+{
+	return tv->tv_sec * 1000000UL + tv->tv_usec;
+}
+
+/*
+ * The services.  They run until the process exits; every accepted
+ * connection gets a detached thread of its own.
+ */
+
+static void *sink_conn(void *arg)
+{
+	static char buf[BULK_WRITE_SIZE];
+	int fd = (long)arg;
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	close(fd);
+	return NULL;
+}
+
+static void *echo_conn(void *arg)
+{
+	char buf[PROBE_SIZE];
+	int fd = (long)arg, one = 1;
+	ssize_t n;
+
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		if (write(fd, buf, n) != n)
+			break;
+	close(fd);
+	return NULL;
+}
+
+struct acceptor {
+	int	fd;
+	void	*(*fn)(void *);
+};
+
+static void *acceptor_fn(void *arg)
+{
+	struct acceptor *a = arg;
+	pthread_attr_t attr;
+	pthread_t thread;
+	long fd;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while ((fd = accept(a->fd, NULL, NULL)) >= 0)
+		assert(!pthread_create(&thread, &attr, a->fn, (void *)fd));
+	return NULL;
+}
+
+static void *udp_echo_fn(void *arg)
+{
+	struct sockaddr_in from;
+	socklen_t len;
+	char buf[PROBE_SIZE];
+	int fd = (long)arg;
+	ssize_t n;
+
+	for (;;) {
+		len = sizeof(from);
+		n = recvfrom(fd, buf, sizeof(buf), 0,
+			     (struct sockaddr *)&from, &len);
+		if (n < 0)
+			break;
+		sendto(fd, buf, n, 0, (struct sockaddr *)&from, len);
+	}
+	return NULL;
+}
+
+void net_load_serve(const struct in_addr *addr)
+{
+	static struct acceptor sink, echo;
+	static int serving;
+	pthread_t thread;
+	long fd;
+
+	if (serving)
+		return;
+	serving = 1;
+
+	sink.fd = listen_on(addr, NET_LOAD_PORT, SOCK_STREAM);
+	sink.fn = sink_conn;
+	echo.fd = listen_on(addr, NET_LOAD_PORT + 1, SOCK_STREAM);
+	echo.fn = echo_conn;
+	fd = listen_on(addr, NET_LOAD_PORT + 1, SOCK_DGRAM);
+
+	assert(!pthread_create(&thread, NULL, acceptor_fn, &sink));
+	assert(!pthread_create(&thread, NULL, acceptor_fn, &echo));
+	assert(!pthread_create(&thread, NULL, udp_echo_fn, (void *)fd));
+}
+
+/* The bulk flows */
+
+struct flow {
+	pthread_t		thread;
+	int			fd;
+	unsigned long long	bytes;
+};
+
+static struct flow *flows;
+static int nr_flows;
+static volatile int load_done;
+
+static void *flow_fn(void *arg)
+{
+	static char buf[BULK_WRITE_SIZE];
+	struct flow *f = arg;
+	ssize_t n;
+
+	while (!load_done) {
+		n = send(f->fd, buf, sizeof(buf), MSG_NOSIGNAL);
+		if (n < 0)
+			break;
+		f->bytes += n;
+	}
+	return NULL;
+}
+
+void net_load_start(const struct in_addr *addr, int nr)
+{
+	int i;
+
+	flows = calloc(nr, sizeof(*flows));
+	if (!flows)
+		die("calloc: %s\n", strerror(errno));
+	nr_flows = nr;
+	load_done = 0;
+
+	for (i = 0; i < nr_flows; i++) {
+		flows[i].fd = connect_to(addr, NET_LOAD_PORT, SOCK_STREAM);
+		assert(!pthread_create(&flows[i].thread, NULL, flow_fn,
+				       &flows[i]));
+	}
+}
+
+unsigned long long net_load_stop(void)
+{
+	unsigned long long bytes = 0;
+	int i;
+
+	load_done = 1;
+	for (i = 0; i < nr_flows; i++) {
+		/* Gets a sender blocked on a full socket going again. */
+		shutdown(flows[i].fd, SHUT_RDWR);
+		pthread_join(flows[i].thread, NULL);
+		close(flows[i].fd);
+		bytes += flows[i].bytes;
+	}
+	free(flows);
+	flows = NULL;
+	nr_flows = 0;
+
+	return bytes;
+}
+
+/* The probes */
+
+static int cmp_ulong(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *)a;
+	unsigned long y = *(const unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void net_probe_rtt(const struct in_addr *addr, int use_tcp, int count,
+		   int interval_ms, struct net_rtt *rtt)
+{
+	struct timeval timeout = { PROBE_TIMEOUT / 1000,
+				   (PROBE_TIMEOUT % 1000) * 1000 };
+	struct timeval start, stop;
+	unsigned long *samples, sum = 0;
+	char buf[PROBE_SIZE];
+	int fd, i, one = 1;
+	ssize_t n;
+
+	samples = calloc(count, sizeof(*samples));
+	if (!samples)
+		die("calloc: %s\n", strerror(errno));
+	memset(rtt, 0, sizeof(*rtt));
+	memset(buf, 0x5a, sizeof(buf));
+
+	fd = connect_to(addr, NET_LOAD_PORT + 1,
+			use_tcp ? SOCK_STREAM : SOCK_DGRAM);
+	if (use_tcp)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	else
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+			   sizeof(timeout));
+
+	for (i = 0; i < count; i++) {
+		memcpy(buf, &i, sizeof(i));
+		gettimeofday(&start, NULL);
+		if (send(fd, buf, sizeof(buf), MSG_NOSIGNAL) != sizeof(buf))
+			die("send: %s\n", strerror(errno));
+		/*
+		 * TCP may hand the echo back in pieces; UDP may first hand
+		 * back the late echo of a probe already counted as lost.
+		 */
+		n = 0;
+		while (n < (ssize_t)sizeof(buf)) {
+			ssize_t ret = recv(fd, buf + n, sizeof(buf) - n, 0);
+
+			if (ret <= 0)
+				break;
+			if (!use_tcp) {
+				if (ret >= (ssize_t)sizeof(i) &&
+				    !memcmp(buf, &i, sizeof(i))) {
+					n = ret;
+					break;
+				}
+				continue;
+			}
+			n += ret;
+		}
+		gettimeofday(&stop, NULL);
+
+		if (n <= 0) {
+			if (use_tcp || (errno != EAGAIN &&
+					errno != EWOULDBLOCK))
+				die("recv: %s\n", strerror(errno));
+			rtt->lost++;
+		} else {
+			samples[rtt->nr] = timeval_usec(&stop) -
+					   timeval_usec(&start);
+			sum += samples[rtt->nr++];
+		}
+
+		if (interval_ms)
+			usleep(interval_ms * 1000);
+	}
+	close(fd);
+
+	if (rtt->nr) {
+		qsort(samples, rtt->nr, sizeof(*samples), cmp_ulong);
+		rtt->min = samples[0];
+		rtt->max = samples[rtt->nr - 1];
+		rtt->avg = sum / rtt->nr;
+		rtt->p50 = samples[rtt->nr / 2];
+		rtt->p99 = samples[(rtt->nr * 99) / 100];
+	}
+	free(samples);
+}
+
+void net_print_rtt(const char *what, const struct net_rtt *rtt)
+{
+	printf(" %14s: %lu/%lu/%lu/%lu/%lu usecs min/avg/p50/p99/max",
+	       what, rtt->min, rtt->avg, rtt->p50, rtt->p99, rtt->max);
+	if (rtt->lost)
+		printf(", %lu lost", rtt->lost);
+	printf("\n");
+}
+
+/* Shaping */
+
+static void run_tc(const char *fmt, ...)
+{
+	char cmd[512];
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(cmd, sizeof(cmd), fmt, ap);
+	va_end(ap);
+
+	if (system(cmd))
+		die("failed: %s\n", cmd);
+}
+
+void net_shape(const char *dev, const char *rate, const char *leaf)
+{
+	const char *parent = "root";
+
+	net_unshape(dev);
+
+	if (rate) {
+		run_tc("tc qdisc add dev %s root handle 1: tbf rate %s "
+		       "burst 16kb latency 1s", dev, rate);
+		parent = "parent 1:1";
+	}
+	if (leaf)
+		run_tc("tc qdisc add dev %s %s handle 2: %s",
+		       dev, parent, leaf);
+}
+
+static void del_root(const char *dev, const char *netns)
+{
+	char cmd[256];
+
+	/* Fails harmlessly when there is nothing to remove. */
+	snprintf(cmd, sizeof(cmd), "%s%s%stc qdisc del dev %s root 2>/dev/null",
+		 netns ? "ip netns exec " : "", netns ? netns : "",
+		 netns ? " " : "", dev);
+	if (system(cmd))
+		return;
+}
+
+void net_unshape(const char *dev)
+{
+	del_root(dev, NULL);
+}
+
+void net_delay(const char *dev, const char *netns, const char *delay)
+{
+	del_root(dev, netns);
+	run_tc("%s%s%stc qdisc add dev %s root netem delay %s",
+	       netns ? "ip netns exec " : "", netns ? netns : "",
+	       netns ? " " : "", dev, delay);
+}
+
+void net_undelay(const char *dev, const char *netns)
+{
+	del_root(dev, netns);
+}
@@ -0,0 +1,60 @@
+#ifndef BENCH_NET_LOAD_H
+#define BENCH_NET_LOAD_H
+
+#include <netinet/in.h>
+
+/*
+ * Helpers shared by the latency under load suites of 'perf bench net':
+ * bulk TCP flows into a sink, a small echo service to time round trips
+ * through while they run, and tc shaping of the path in between.
+ */
+
+/* TCP port of the sink; the echo service uses the next port, TCP and UDP */
+#define NET_LOAD_PORT		12800
+
+struct net_rtt {
+	unsigned long	nr;		/* probes answered */
+	unsigned long	lost;		/* UDP probes not answered in time */
+	unsigned long	min;		/* usecs */
+	unsigned long	avg;
+	unsigned long	p50;
+	unsigned long	p99;
+	unsigned long	max;
+};
+
+/* Start the sink and echo services on @addr, once per process. */
+extern void net_load_serve(const struct in_addr *addr);
+
+/* Start @nr_flows bulk TCP flows to the sink on @addr. */
+extern void net_load_start(const struct in_addr *addr, int nr_flows);
+/* Stop them again; returns the number of bytes they sent. */
+extern unsigned long long net_load_stop(void);
+
+/*
+ * Time @count round trips of a small message through the echo service
+ * on @addr, one every @interval_ms.  A TCP probe uses one connection
+ * with TCP_NODELAY, the way an interactive session does.
+ */
+extern void net_probe_rtt(const struct in_addr *addr, int use_tcp,
+			  int count, int interval_ms, struct net_rtt *rtt);
+
+extern void net_print_rtt(const char *what, const struct net_rtt *rtt);
+
+/*
+ * Build a bottleneck on @dev out of tc qdiscs: tbf limiting the rate to
+ * @rate at the root, and @leaf under it as the qdisc where packets queue.
+ * Either may be NULL to leave that stage out.  Needs tc and CAP_NET_ADMIN.
+ */
+extern void net_shape(const char *dev, const char *rate, const char *leaf);
+extern void net_unshape(const char *dev);
+
+/*
+ * Add @delay with netem on @dev, in network namespace @netns if that is
+ * not NULL.  This has to be another device than the bottleneck: netem
+ * and the CoDel based qdiscs both keep their timestamps in the qdisc
+ * control block of an skb, so one can't sit on top of the other.
+ */
+extern void net_delay(const char *dev, const char *netns, const char *delay);
+extern void net_undelay(const char *dev, const char *netns);
+
+#endif /* BENCH_NET_LOAD_H */
@@ -0,0 +1,185 @@
+/*
+ *
+ * net-qdisc.c
+ *
+ * qdisc: Benchmark for latency under load with different qdiscs
+ *
+ * Builds a bottleneck out of a tbf rate limit on a device and puts each
+ * of a list of qdiscs under it in turn.  For each one, round trips of
+ * small UDP (or TCP) messages are timed on the idle path and again while
+ * bulk TCP flows saturate the bottleneck, so that the queueing delay each
+ * qdisc lets the bulk flows build up can be compared directly.  netem
+ * can add delay on another device, the return path of a veth pair for
+ * example, to give the flows a realistic round trip time.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "net-load.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* How long the bulk flows run before probing starts, in usecs */
+#define LOAD_WARMUP_TIME	2000000
+
+/*
+ * pfifo_fast can't be set up with tc, so a pfifo of the usual
+ * txqueuelen stands in for it.
+ */
+static const char *qdiscs = "pfifo limit 1000,sfq,fq_codel";
+static const char *addr_str = "127.0.0.1";
+static const char *dev_name = "lo";
+static const char *rate = "10mbit";
+static const char *delay;
+static const char *delay_dev;
+static const char *delay_netns;
+static int nr_flows = 4;
+static int nr_probes = 200;
+static int interval = 10;
+static bool use_tcp;
+static bool remote;
+
+static const struct option options[] = {
+	OPT_STRING('Q', "qdiscs", &qdiscs, "list",
+		   "Specify the comma separated qdiscs to compare"),
+	OPT_STRING('a', "addr", &addr_str, "addr",
+		   "Specify the IPv4 address of the sink and echo services"),
+	OPT_STRING('i', "dev", &dev_name, "dev",
+		   "Specify the device the bottleneck is built on"),
+	OPT_STRING('r', "rate", &rate, "rate",
+		   "Specify the rate of the bottleneck, in tc syntax"),
+	OPT_STRING('D', "delay", &delay, "delay",
+		   "Specify the delay netem adds, in tc syntax"),
+	OPT_STRING('P', "delay-dev", &delay_dev, "dev",
+		   "Specify the device netem adds the delay on"),
+	OPT_STRING('N', "delay-netns", &delay_netns, "netns",
+		   "Specify the network namespace of --delay-dev"),
+	OPT_INTEGER('f', "flows", &nr_flows,
+		    "Specify number of bulk TCP flows"),
+	OPT_INTEGER('n', "probes", &nr_probes,
+		    "Specify number of round trips timed, idle and loaded"),
+	OPT_INTEGER('I', "interval", &interval,
+		    "Specify msecs between round trips"),
+	OPT_BOOLEAN('T', "tcp", &use_tcp,
+		    "Time round trips over TCP instead of UDP"),
+	OPT_BOOLEAN('R', "remote", &remote,
+		    "The services run elsewhere, see 'perf bench net bql'"),
+	OPT_END()
+};
+
+static const char * const bench_net_qdisc_usage[] = {
+	"perf bench net qdisc <options>",
+	NULL
+};
+
+struct qdisc_result {
+	const char		*qdisc;
+	struct net_rtt		idle;
+	struct net_rtt		loaded;
+	unsigned long long	bytes;
+	unsigned long long	usecs;
+};
+
+static void run_one(const struct in_addr *addr, struct qdisc_result *r)
+{
+	struct timeval start, stop, diff;
+
+	net_shape(dev_name, rate, r->qdisc);
+	net_probe_rtt(addr, use_tcp, nr_probes, interval, &r->idle);
+
+	gettimeofday(&start, NULL);
+	net_load_start(addr, nr_flows);
+	usleep(LOAD_WARMUP_TIME);
+	net_probe_rtt(addr, use_tcp, nr_probes, interval, &r->loaded);
+	r->bytes = net_load_stop();
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	r->usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+}
+
+int bench_net_qdisc(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct qdisc_result *results;
+	struct in_addr addr;
+	char *list, *tok, *save;
+	int i, nr = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_qdisc_usage, 0);
+	if (nr_flows < 1 || nr_probes < 1 || interval < 0 ||
+	    (delay && !delay_dev))
+		usage_with_options(bench_net_qdisc_usage, options);
+	if (!inet_aton(addr_str, &addr))
+		die("invalid address: %s\n", addr_str);
+
+	list = strdup(qdiscs);
+	results = calloc(strlen(qdiscs) / 2 + 1, sizeof(*results));
+	if (!list || !results)
+		die("calloc: %s\n", strerror(errno));
+	for (tok = strtok_r(list, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save))
+		results[nr++].qdisc = tok;
+	if (!nr)
+		usage_with_options(bench_net_qdisc_usage, options);
+
+	if (!remote)
+		net_load_serve(&addr);
+	if (delay)
+		net_delay(delay_dev, delay_netns, delay);
+
+	for (i = 0; i < nr; i++)
+		run_one(&addr, &results[i]);
+
+	net_unshape(dev_name);
+	if (delay)
+		net_undelay(delay_dev, delay_netns);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d %s round trips to %s, idle and under %d bulk "
+		       "TCP flows, through %s at %s", nr_probes,
+		       use_tcp ? "TCP" : "UDP", addr_str, nr_flows,
+		       dev_name, rate);
+		if (delay)
+			printf(", %s delay on %s", delay, delay_dev);
+		printf("\n");
+
+		for (i = 0; i < nr; i++) {
+			printf("\n %s:\n", results[i].qdisc);
+			net_print_rtt("Idle", &results[i].idle);
+			net_print_rtt("Loaded", &results[i].loaded);
+			printf(" %14lf Mbit/sec of bulk traffic\n",
+			       (double)results[i].bytes * 8 /
+			       (double)results[i].usecs);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		for (i = 0; i < nr; i++)
+			printf("%s %lu\n", results[i].qdisc,
+			       results[i].loaded.avg);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(results);
+	free(list);
+	return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ *
+ * net-reuseport.c
+ *
+ * reuseport: Benchmark for SO_REUSEPORT listeners
+ *
+ * A number of server threads accept() TCP connections (or recv() UDP
+ * datagrams) on one loopback port while the same number of client
+ * threads connect to (or send to) it.  By default every server thread
+ * owns its own SO_REUSEPORT socket; with --shared they all block on a
+ * single socket instead, which is what servers had to do before.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+
+/* Sockets each UDP client spreads its datagrams over. */
+#define UDP_CLIENT_FLOWS 16
+
+static int nr_threads = 4;
+static int loops = 10000;
+static bool use_udp;
+static bool shared;
+
+static const struct option options[] = {
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of server and client threads"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of connections (datagrams) per client"),
+	OPT_BOOLEAN('u', "udp", &use_udp,
+		    "Use UDP datagrams instead of TCP connections"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Share one socket among all servers (no SO_REUSEPORT)"),
+	OPT_END()
+};
+
+static const char * const bench_net_reuseport_usage[] = {
+	"perf bench net reuseport <options>",
+	NULL
+};
+
+struct server {
+	pthread_t	thread;
+	int		fd;
+	unsigned long	count;
+};
+
+static struct sockaddr_in server_addr;
+static unsigned long total_count;
+
+static int server_socket(void)
+{
+	int fd, one = 1;
+
+	fd = socket(AF_INET, use_udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket: %s\n", strerror(errno));
+	if (!shared &&
+	    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0)
+		die("SO_REUSEPORT: %s\n", strerror(errno));
+	if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+		die("bind: %s\n", strerror(errno));
+	if (!use_udp && listen(fd, 1024) < 0)
+		die("listen: %s\n", strerror(errno));
+	return fd;
+}
+
+static void *server_worker(void *arg)
+{
+	struct server *s = arg;
+	char buf[64];
+	int fd;
+
+	for (;;) {
+		if (use_udp) {
+			if (recv(s->fd, buf, sizeof(buf), 0) <= 0)
+				break;
+		} else {
+			fd = accept(s->fd, NULL, NULL);
+			if (fd < 0)
+				break;
+			close(fd);
+		}
+		s->count++;
+		__sync_fetch_and_add(&total_count, 1);
+	}
+	return NULL;
+}
+
+static void *tcp_client_worker(void *arg __used)
+{
+	struct linger lin = { .l_onoff = 1, .l_linger = 0 };
+	int i, fd;
+
+	for (i = 0; i < loops; i++) {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		assert(fd >= 0);
+		/* Reset on close so that we don't run out of local ports. */
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+		if (connect(fd, (struct sockaddr *)&server_addr,
+			    sizeof(server_addr)) < 0)
+			die("connect: %s\n", strerror(errno));
+		close(fd);
+	}
+	return NULL;
+}
+
+static void *udp_client_worker(void *arg __used)
+{
+	int fds[UDP_CLIENT_FLOWS];
+	char buf[32] = { 0 };
+	int __used ret;
+	int i;
+
+	for (i = 0; i < UDP_CLIENT_FLOWS; i++) {
+		fds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+		assert(fds[i] >= 0);
+		if (connect(fds[i], (struct sockaddr *)&server_addr,
+			    sizeof(server_addr)) < 0)
+			die("connect: %s\n", strerror(errno));
+	}
+	for (i = 0; i < loops; i++)
+		ret = send(fds[i % UDP_CLIENT_FLOWS], buf, sizeof(buf), 0);
+	for (i = 0; i < UDP_CLIENT_FLOWS; i++)
+		close(fds[i]);
+	return NULL;
+}
+
+int bench_net_reuseport(int argc, const char **argv,
+			const char *prefix __used)
+{
+	struct server *servers;
+	pthread_t *clients;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	unsigned long expected, last, min, max;
+	socklen_t len = sizeof(server_addr);
+	int i, idle;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_reuseport_usage, 0);
+	if (nr_threads < 1 || loops < 1)
+		usage_with_options(bench_net_reuseport_usage, options);
+
+	servers = calloc(nr_threads, sizeof(*servers));
+	clients = calloc(nr_threads, sizeof(*clients));
+	assert(servers && clients);
+
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	server_addr.sin_port = 0;
+
+	/* The first socket picks the port the others then bind to. */
+	servers[0].fd = server_socket();
+	if (getsockname(servers[0].fd, (struct sockaddr *)&server_addr,
+			&len) < 0)
+		die("getsockname: %s\n", strerror(errno));
+	for (i = 1; i < nr_threads; i++)
+		servers[i].fd = shared ? servers[0].fd : server_socket();
+
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_create(&servers[i].thread, NULL,
+				       server_worker, &servers[i]));
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		assert(!pthread_create(&clients[i], NULL,
+				       use_udp ? udp_client_worker :
+						 tcp_client_worker,
+				       NULL));
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(clients[i], NULL);
+
+	/*
+	 * UDP datagrams may be dropped on a full receive queue: stop
+	 * waiting once nothing has arrived for a second, and only count
+	 * the time up to the last arrival.
+	 */
+	expected = (unsigned long)nr_threads * loops;
+	last = total_count;
+	idle = 0;
+	gettimeofday(&stop, NULL);
+	while (total_count < expected && idle < 1000) {
+		usleep(1000);
+		if (total_count == last) {
+			idle++;
+			continue;
+		}
+		idle = 0;
+		last = total_count;
+		gettimeofday(&stop, NULL);
+	}
+	timersub(&stop, &start, &diff);
+
+	for (i = 0; i < nr_threads; i++)
+		if (!shared || !i)
+			shutdown(servers[i].fd, SHUT_RDWR);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(servers[i].thread, NULL);
+	for (i = 0; i < nr_threads; i++)
+		if (!shared || !i)
+			close(servers[i].fd);
+
+	min = max = servers[0].count;
+	for (i = 1; i < nr_threads; i++) {
+		if (servers[i].count < min)
+			min = servers[i].count;
+		if (servers[i].count > max)
+			max = servers[i].count;
+	}
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d %s server threads on %s, %d clients x %d %s\n\n",
+		       nr_threads, use_udp ? "recv()" : "accept()",
+		       shared ? "one shared socket" : "SO_REUSEPORT sockets",
+		       nr_threads, loops,
+		       use_udp ? "datagrams" : "connections");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lu %s received\n", total_count,
+		       use_udp ? "datagrams" : "connections");
+		printf(" %14d ops/sec\n",
+		       (int)((double)total_count /
+			     ((double)result_usec / (double)1000000)));
+		printf(" %14lu min per server\n", min);
+		printf(" %14lu max per server\n", max);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	free(clients);
+	free(servers);
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ *
+ * security-avc.c
+ *
+ * avc: Benchmark for the cost of permission checks
+ *
+ * Calls stat() and access() on every entry of a directory in a loop.
+ * Neither has side effects, but each goes through the inode permission
+ * checks, so with SELinux enabled the run is dominated by AVC lookups for
+ * the labels found in that directory.  When the AVC statistics are
+ * available in selinuxfs, the change in them over the run is shown too.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+static const char *dir_path = "/dev";
+static int nr_files = 256;
+static int loops = 1000;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &dir_path, "path",
+		   "Specify the directory whose entries are checked"),
+	OPT_INTEGER('f', "files", &nr_files,
+		    "Specify the maximum number of entries to use"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of passes over the entries"),
+	OPT_END()
+};
+
+static const char * const bench_security_avc_usage[] = {
+	"perf bench security avc <options>",
+	NULL
+};
+
+static const char * const avc_stats_paths[] = {
+	"/sys/fs/selinux/avc/cache_stats",
+	"/selinux/avc/cache_stats",
+	NULL
+};
+
+enum {
+	AVC_LOOKUPS,
+	AVC_HITS,
+	AVC_MISSES,
+	AVC_HOT_HITS,
+	AVC_RECLAIMS,
+	AVC_NR_STATS
+};
+
+static const char * const avc_stat_names[AVC_NR_STATS] = {
+	"lookups", "hits", "misses", "hot_hits", "reclaims"
+};
+
+/*
+ * Sum the per-CPU lines of cache_stats, finding the columns by the names
+ * in its header.  Returns 0 if the file cannot be read.
+ */
+static int read_avc_stats(unsigned long long *stats)
+{
+	char line[BUFSIZ];
+	int column[AVC_NR_STATS];
+	FILE *fp = NULL;
+	char *tok, *save;
+	int i, col;
+
+	for (i = 0; avc_stats_paths[i] && !fp; i++)
+		fp = fopen(avc_stats_paths[i], "r");
+	if (!fp)
+		return 0;
+
+	if (!fgets(line, sizeof(line), fp)) {
+		fclose(fp);
+		return 0;
+	}
+
+	for (i = 0; i < AVC_NR_STATS; i++)
+		column[i] = -1;
+	for (col = 0, tok = strtok_r(line, " \n", &save); tok;
+	     col++, tok = strtok_r(NULL, " \n", &save)) {
+		for (i = 0; i < AVC_NR_STATS; i++)
+			if (!strcmp(tok, avc_stat_names[i]))
+				column[i] = col;
+	}
+
+	memset(stats, 0, AVC_NR_STATS * sizeof(*stats));
+	while (fgets(line, sizeof(line), fp)) {
+		for (col = 0, tok = strtok_r(line, " \n", &save); tok;
+		     col++, tok = strtok_r(NULL, " \n", &save)) {
+			for (i = 0; i < AVC_NR_STATS; i++)
+				if (column[i] == col)
+					stats[i] += strtoull(tok, NULL, 10);
+		}
+	}
+
+	fclose(fp);
+	return 1;
+}
+
+static char **read_entries(int *nr)
+{
+	struct dirent *ent;
+	char **paths;
+	DIR *dir;
+	int n = 0;
+
+	dir = opendir(dir_path);
+	if (!dir)
+		die("%s: %s\n", dir_path, strerror(errno));
+
+	paths = calloc(nr_files, sizeof(*paths));
+	if (!paths)
+		die("calloc: %s\n", strerror(errno));
+
+	while (n < nr_files && (ent = readdir(dir))) {
+		char path[PATH_MAX];
+
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir_path, ent->d_name);
+		paths[n] = strdup(path);
+		if (!paths[n])
+			die("strdup: %s\n", strerror(errno));
+		n++;
+	}
+	closedir(dir);
+
+	if (!n)
+		die("%s: no entries\n", dir_path);
+
+	*nr = n;
+	return paths;
+}
+
+int bench_security_avc(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	unsigned long long before[AVC_NR_STATS], after[AVC_NR_STATS];
+	unsigned long long result_usec, total_calls;
+	struct timeval start, stop, diff;
+	struct stat st;
+	char **paths;
+	int nr, i, j, have_stats;
+
+	argc = parse_options(argc, argv, options,
+			     bench_security_avc_usage, 0);
+	if (nr_files < 1 || loops < 1)
+		usage_with_options(bench_security_avc_usage, options);
+
+	paths = read_entries(&nr);
+
+	have_stats = read_avc_stats(before);
+	gettimeofday(&start, NULL);
+
+	/* Errors are expected (and still checked) for some entries. */
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < nr; j++) {
+			stat(paths[j], &st);
+			access(paths[j], R_OK);
+		}
+	}
+
+	gettimeofday(&stop, NULL);
+	if (have_stats)
+		have_stats = read_avc_stats(after);
+	timersub(&stop, &start, &diff);
+
+	for (i = 0; i < nr; i++)
+		free(paths[i]);
+	free(paths);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	total_calls = 2ULL * nr * loops;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d passes over %d entries of %s\n\n",
+		       loops, nr, dir_path);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/call\n",
+		       (double)result_usec / (double)total_calls);
+		printf(" %14llu calls/sec\n",
+		       (unsigned long long)((double)total_calls /
+			     ((double)result_usec / (double)1000000)));
+
+		if (have_stats) {
+			printf("\n");
+			for (i = 0; i < AVC_NR_STATS; i++)
+				printf(" %14llu avc %s\n",
+				       after[i] - before[i],
+				       avc_stat_names[i]);
+		}
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)result_usec / (double)total_calls);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ *
+ * sync-genlock.c
+ *
+ * genlock: Benchmark for genlock lock/unlock
+ *
+ * A number of processes attach to one exported genlock and lock and
+ * unlock it in a loop, the way several processes take turns on one
+ * graphics buffer.  Each lock is a read lock unless --write says
+ * otherwise for that percentage of them.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/* From include/linux/genlock.h */
+#define GENLOCK_UNLOCK 0
+#define GENLOCK_WRLOCK 1
+#define GENLOCK_RDLOCK 2
+
+struct genlock_lock {
+	int fd;
+	int op;
+	int flags;
+	int timeout;
+};
+
+#define GENLOCK_IOC_MAGIC     'G'
+
+#define GENLOCK_IOC_NEW _IO(GENLOCK_IOC_MAGIC, 0)
+#define GENLOCK_IOC_EXPORT _IOR(GENLOCK_IOC_MAGIC, 1, \
+	struct genlock_lock)
+#define GENLOCK_IOC_ATTACH _IOW(GENLOCK_IOC_MAGIC, 2, \
+	struct genlock_lock)
+#define GENLOCK_IOC_DREADLOCK _IOW(GENLOCK_IOC_MAGIC, 6, \
+	struct genlock_lock)
+
+/* Milliseconds a single lock may wait before the run is failed */
+#define LOCK_TIMEOUT 10000
+
+static const char *dev_path = "/dev/genlock";
+static int nr_procs = 4;
+static int loops = 100000;
+static int write_pct;
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "procs", &nr_procs,
+		    "Specify number of processes sharing the lock"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of lock/unlock pairs per process"),
+	OPT_INTEGER('w', "write", &write_pct,
+		    "Specify percentage of write locks"),
+	OPT_STRING('d', "device", &dev_path, "path",
+		   "Specify the genlock device"),
+	OPT_END()
+};
+
+static const char * const bench_sync_genlock_usage[] = {
+	"perf bench sync genlock <options>",
+	NULL
+};
+
+static void do_lock(int handle, int op)
+{
+	struct genlock_lock param;
+
+	memset(&param, 0, sizeof(param));
+	param.op = op;
+	param.timeout = LOCK_TIMEOUT;
+
+	if (ioctl(handle, GENLOCK_IOC_DREADLOCK, &param) < 0)
+		die("GENLOCK_IOC_DREADLOCK: %s\n", strerror(errno));
+}
+
+static void worker(int lock_fd, int start_fd, unsigned int seed)
+{
+	struct genlock_lock param;
+	char c;
+	int handle, i;
+
+	handle = open(dev_path, O_RDWR);
+	if (handle < 0)
+		die("%s: %s\n", dev_path, strerror(errno));
+
+	memset(&param, 0, sizeof(param));
+	param.fd = lock_fd;
+	if (ioctl(handle, GENLOCK_IOC_ATTACH, &param) < 0)
+		die("GENLOCK_IOC_ATTACH: %s\n", strerror(errno));
+
+	/* Wait for the parent to close the pipe, then go */
+	if (read(start_fd, &c, 1) < 0)
+		die("read: %s\n", strerror(errno));
+
+	for (i = 0; i < loops; i++) {
+		int op = GENLOCK_RDLOCK;
+
+		if (write_pct && (int)(rand_r(&seed) % 100) < write_pct)
+			op = GENLOCK_WRLOCK;
+
+		do_lock(handle, op);
+		do_lock(handle, GENLOCK_UNLOCK);
+	}
+
+	close(handle);
+	exit(0);
+}
+
+int bench_sync_genlock(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct genlock_lock param;
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total_ops;
+	pid_t *pids;
+	int handle, start_pipe[2];
+	int i, status, failed = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sync_genlock_usage, 0);
+	if (nr_procs < 1 || loops < 1 || write_pct < 0 || write_pct > 100)
+		usage_with_options(bench_sync_genlock_usage, options);
+
+	handle = open(dev_path, O_RDWR);
+	if (handle < 0)
+		die("%s: %s\n", dev_path, strerror(errno));
+
+	if (ioctl(handle, GENLOCK_IOC_NEW) < 0)
+		die("GENLOCK_IOC_NEW: %s\n", strerror(errno));
+
+	memset(&param, 0, sizeof(param));
+	if (ioctl(handle, GENLOCK_IOC_EXPORT, &param) < 0)
+		die("GENLOCK_IOC_EXPORT: %s\n", strerror(errno));
+
+	if (pipe(start_pipe) < 0)
+		die("pipe: %s\n", strerror(errno));
+
+	pids = calloc(nr_procs, sizeof(*pids));
+	if (!pids)
+		die("calloc: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_procs; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0)
+			die("fork: %s\n", strerror(errno));
+		if (!pids[i]) {
+			close(start_pipe[1]);
+			worker(param.fd, start_pipe[0], i + 1);
+		}
+	}
+
+	close(start_pipe[0]);
+	gettimeofday(&start, NULL);
+	close(start_pipe[1]);
+
+	for (i = 0; i < nr_procs; i++) {
+		if (waitpid(pids[i], &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status))
+			failed++;
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	close(param.fd);
+	close(handle);
+	free(pids);
+
+	if (failed)
+		die("%d of %d processes failed\n", failed, nr_procs);
+
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+	/* A lock and an unlock are two operations */
+	total_ops = 2ULL * nr_procs * loops;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d processes, %d lock/unlock pairs each, "
+		       "%d%% write locks\n\n", nr_procs, loops, write_pct);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14llu ops/sec\n",
+		       (unsigned long long)((double)total_ops /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ *
+ * sync-signal.c
+ *
+ * signal: Benchmark for sync_timeline signalling
+ *
+ * Keeps a number of sw_sync fences outstanding on one timeline and
+ * advances the timeline one step at a time, so that every step signals
+ * exactly one of them.  Only the SW_SYNC_IOC_INC calls are timed; the
+ * fence that was signaled is replaced by a new one at the far end of the
+ * timeline before the next step.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+
+/* From include/linux/sw_sync.h */
+struct sw_sync_create_fence_data {
+	__u32	value;
+	char	name[32];
+	__s32	fence;
+};
+
+#define SW_SYNC_IOC_MAGIC	'W'
+
+#define SW_SYNC_IOC_CREATE_FENCE	_IOWR(SW_SYNC_IOC_MAGIC, 0,\
+		struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC			_IOW(SW_SYNC_IOC_MAGIC, 1, __u32)
+
+static const char *dev_path = "/dev/sw_sync";
+static int nr_points = 256;
+static int loops = 10000;
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "points", &nr_points,
+		    "Specify number of outstanding fences on the timeline"),
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of signals"),
+	OPT_STRING('d', "device", &dev_path, "path",
+		   "Specify the sw_sync device"),
+	OPT_END()
+};
+
+static const char * const bench_sync_signal_usage[] = {
+	"perf bench sync signal <options>",
+	NULL
+};
+
+static int create_fence(int timeline, __u32 value)
+{
+	struct sw_sync_create_fence_data data;
+
+	memset(&data, 0, sizeof(data));
+	data.value = value;
+	snprintf(data.name, sizeof(data.name), "bench-%u", value);
+
+	if (ioctl(timeline, SW_SYNC_IOC_CREATE_FENCE, &data) < 0)
+		die("SW_SYNC_IOC_CREATE_FENCE: %s\n", strerror(errno));
+
+	return data.fence;
+}
+
+static unsigned long long timespec_nsec(const struct timespec *ts)
+{
+	return (unsigned long long)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+int bench_sync_signal(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timespec start, stop;
+	unsigned long long total_nsec = 0, min_nsec = ~0ULL, max_nsec = 0;
+	__u32 one = 1;
+	int *fences;
+	int timeline, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sync_signal_usage, 0);
+	if (nr_points < 1 || loops < 1)
+		usage_with_options(bench_sync_signal_usage, options);
+
+	/* Every open of the device is a new timeline at value 0. */
+	timeline = open(dev_path, O_RDWR);
+	if (timeline < 0)
+		die("%s: %s\n", dev_path, strerror(errno));
+
+	fences = calloc(nr_points, sizeof(*fences));
+	if (!fences)
+		die("calloc: %s\n", strerror(errno));
+
+	for (i = 0; i < nr_points; i++)
+		fences[i] = create_fence(timeline, i + 1);
+
+	for (i = 0; i < loops; i++) {
+		unsigned long long nsec;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (ioctl(timeline, SW_SYNC_IOC_INC, &one) < 0)
+			die("SW_SYNC_IOC_INC: %s\n", strerror(errno));
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+
+		nsec = timespec_nsec(&stop) - timespec_nsec(&start);
+		total_nsec += nsec;
+		if (nsec < min_nsec)
+			min_nsec = nsec;
+		if (nsec > max_nsec)
+			max_nsec = nsec;
+
+		/* Value i + 1 has just signaled: requeue it at the end. */
+		close(fences[i % nr_points]);
+		fences[i % nr_points] = create_fence(timeline,
+						     i + 1 + nr_points);
+	}
+
+	for (i = 0; i < nr_points; i++)
+		close(fences[i]);
+	close(timeline);
+	free(fences);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d signals with %d outstanding fences\n\n",
+		       loops, nr_points);
+
+		printf(" %14s: %llu.%03llu [msec]\n\n", "Total time",
+		       total_nsec / 1000000ULL,
+		       (total_nsec % 1000000ULL) / 1000ULL);
+
+		printf(" %14llu nsecs/signal (avg)\n", total_nsec / loops);
+		printf(" %14llu nsecs/signal (min)\n", min_nsec);
+		printf(" %14llu nsecs/signal (max)\n", max_nsec);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%llu\n", total_nsec / loops);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -13,6 +13,11 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  net   ... networking stack
+ *  sync  ... buffer synchronization (sync fences, genlock)
+ *  security ... security module overhead
+ *  fs    ... file system I/O
+ *  futex ... futex operations
  *
  */
 
@@ -58,6 +63,71 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite net_suites[] = {
+	{ "reuseport",
+	  "accept()/recv() rate of threads sharing a port",
+	  bench_net_reuseport },
+	{ "epoll",
+	  "Wakeups of epoll instances sharing a listening socket",
+	  bench_net_epoll },
+	{ "bql",
+	  "Round trip times under bulk load through a transmit queue",
+	  bench_net_bql },
+	{ "qdisc",
+	  "Round trip times under bulk load with several qdiscs",
+	  bench_net_qdisc },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL                }
+};
+
+static struct bench_suite sync_suites[] = {
+	{ "signal",
+	  "Cost of signalling a timeline with many outstanding fences",
+	  bench_sync_signal },
+	{ "genlock",
+	  "Lock/unlock rate of processes sharing a genlock",
+	  bench_sync_genlock },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL              }
+};
+
+static struct bench_suite security_suites[] = {
+	{ "avc",
+	  "Cost of stat() and access() with their permission checks",
+	  bench_security_avc },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL               }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "aio",
+	  "Random buffered I/O through io_submit() at a given queue depth",
+	  bench_fs_aio },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL         }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "FUTEX_WAIT rate of threads each with many futexes",
+	  bench_futex_hash },
+	{ "wake",
+	  "Time to wake the threads waiting on one futex",
+	  bench_futex_wake },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +141,21 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "net",
+	  "networking stack",
+	  net_suites },
+	{ "sync",
+	  "buffer synchronization (sync fences, genlock)",
+	  sync_suites },
+	{ "security",
+	  "security module overhead",
+	  security_suites },
+	{ "fs",
+	  "file system I/O",
+	  fs_suites },
+	{ "futex",
+	  "futex operations",
+	  futex_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
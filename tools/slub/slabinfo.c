@@ -30,7 +30,7 @@ struct slabinfo {
 	int aliases, align, cache_dma, cpu_slabs, destroy_by_rcu;
 	int hwcache_align, object_size, objs_per_slab;
 	int sanity_checks, slab_size, store_user, trace;
-	int order, poison, reclaim_account, red_zone;
+	int order, poison, reclaim_account, red_zone, cpu_partial;
 	unsigned long partial, objects, slabs, objects_partial, objects_total;
 	unsigned long alloc_fastpath, alloc_slowpath;
 	unsigned long free_fastpath, free_slowpath;
@@ -39,6 +39,8 @@ struct slabinfo {
 	unsigned long cpuslab_flush, deactivate_full, deactivate_empty;
 	unsigned long deactivate_to_head, deactivate_to_tail;
 	unsigned long deactivate_remote_frees, order_fallback;
+	unsigned long cpu_partial_alloc, cpu_partial_free;
+	unsigned long cpu_partial_node, cpu_partial_drain;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -452,6 +454,11 @@ static void slab_stats(struct slabinfo *s)
 		s->alloc_from_partial * 100 / total_alloc,
 		s->free_remove_partial * 100 / total_free);
 
+	printf("Cpu partial list     %8lu %8lu %3lu %3lu\n",
+		s->cpu_partial_alloc, s->cpu_partial_free,
+		s->cpu_partial_alloc * 100 / total_alloc,
+		s->cpu_partial_free * 100 / total_free);
+
 	printf("RemoteObj/SlabFrozen %8lu %8lu %3lu %3lu\n",
 		s->deactivate_remote_frees, s->free_frozen,
 		s->deactivate_remote_frees * 100 / total_alloc,
@@ -465,6 +472,11 @@ static void slab_stats(struct slabinfo *s)
 	if (s->alloc_refill)
 		printf("Refill %8lu\n", s->alloc_refill);
 
+	if (s->cpu_partial_node || s->cpu_partial_drain)
+		printf("Cpu partial (limit %d objects) FromNode=%lu Drain=%lu\n",
+			s->cpu_partial, s->cpu_partial_node,
+			s->cpu_partial_drain);
+
 	total = s->deactivate_full + s->deactivate_empty +
 			s->deactivate_to_head + s->deactivate_to_tail;
 
@@ -1150,6 +1162,7 @@ static void read_slab_dir(void)
 			slab->align = get_obj("align");
 			slab->cache_dma = get_obj("cache_dma");
 			slab->cpu_slabs = get_obj("cpu_slabs");
+			slab->cpu_partial = get_obj("cpu_partial");
 			slab->destroy_by_rcu = get_obj("destroy_by_rcu");
 			slab->hwcache_align = get_obj("hwcache_align");
 			slab->object_size = get_obj("object_size");
@@ -1190,6 +1203,10 @@ static void read_slab_dir(void)
 			slab->deactivate_to_tail = get_obj("deactivate_to_tail");
 			slab->deactivate_remote_frees = get_obj("deactivate_remote_frees");
 			slab->order_fallback = get_obj("order_fallback");
+			slab->cpu_partial_alloc = get_obj("cpu_partial_alloc");
+			slab->cpu_partial_free = get_obj("cpu_partial_free");
+			slab->cpu_partial_node = get_obj("cpu_partial_node");
+			slab->cpu_partial_drain = get_obj("cpu_partial_drain");
 			chdir("..");
 			if (slab->name[0] == ':')
 				alias_targets++;